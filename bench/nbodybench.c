@@ -0,0 +1,140 @@
+//========================================================================
+// Barnes-Hut N-body benchmark
+//
+// Builds the quadtree of nbody.h over growing numbers of bodies spread
+// over a disc and times the tree build and the Barnes-Hut forces. Up to
+// the direct limit it also times the O(n^2) reference sum and prints the
+// RMS error of the approximation relative to the RMS acceleration. Then
+// the largest count is run again with 1, 2, 4, ... threads up to the
+// number of CPUs.
+//
+// usage: nbodyBench [max bodies] [theta] [direct limit]
+//
+//========================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#define GL_WORKPOOL_IMPLEMENTATION
+#include "../workpool.h"
+#define GL_SIMDLEVEL_IMPLEMENTATION
+#include "../simdlevel.h"
+#define GL_NBODY_IMPLEMENTATION
+#include "../nbody.h"
+
+static const char* simd_names[] = { "auto", "scalar", "SSE2", "AVX2" };
+
+static double Now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+/* Time one tree build and force pass over count bodies, in milliseconds */
+static int TimeBarnesHut(NBody* nb, WorkPool* pool, const float* x, const float* y, int count,
+                         float* ax, float* ay, double* build_ms, double* force_ms)
+{
+    double t0 = Now(), t1;
+
+    if (!BuildNBodyTree(nb, pool, x, y, NULL, count))
+        return 0;
+    t1 = Now();
+    ComputeNBodyForces(nb, pool, ax, ay);
+    *build_ms = (t1 - t0) * 1e3;
+    *force_ms = (Now() - t1) * 1e3;
+    return 1;
+}
+
+int main(int argc, char** argv)
+{
+    const int max_count = (argc > 1) ? atoi(argv[1]) : 1 << 20;
+    const float theta = (argc > 2) ? (float) atof(argv[2]) : 0.5f;
+    const int direct_limit = (argc > 3) ? atoi(argv[3]) : 1 << 15;
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    float *x, *y, *ax, *ay, *rx, *ry;
+    double build_ms, force_ms, first_ms = 0.0;
+    WorkPool pool;
+    NBody nb;
+    int count, threads, ii;
+
+    x = (float*) malloc(sizeof(float) * (size_t) max_count * 6);
+    if (x == NULL || !InitNBody(&nb, max_count) || !CreateWorkPool(&pool, 0))
+    {
+        fprintf(stderr, "ERROR: Unable to allocate %d bodies\n", max_count);
+        return EXIT_FAILURE;
+    }
+    y = x + max_count;
+    ax = y + max_count;
+    ay = ax + max_count;
+    rx = ay + max_count;
+    ry = rx + max_count;
+
+    /* denser to the center, like a galaxy */
+    srand(1);
+    for (ii = 0 ; ii < max_count ; ++ii)
+    {
+        const float r = 300.0f * powf((float) rand() / (float) RAND_MAX, 0.75f);
+        const float a = 2.0f * (float) M_PI * (float) rand() / (float) RAND_MAX;
+
+        x[ii] = 400.0f + r * cosf(a);
+        y[ii] = 300.0f + r * sinf(a);
+    }
+    nb.theta = theta;
+
+    printf("theta %.2f, %d threads, direct sum with %s\n\n", theta, GetWorkPoolSize(&pool),
+           simd_names[SetNBodySimd(SIMD_AUTO)]);
+    printf("%10s %10s %10s %10s %10s %12s\n", "bodies", "nodes", "build ms", "forces ms", "direct ms", "rms error");
+    for (count = 4096 ; count <= max_count ; count *= 2)
+    {
+        if (!TimeBarnesHut(&nb, &pool, x, y, count, ax, ay, &build_ms, &force_ms))
+        {
+            printf("%10d %10s\n", count, "out of memory");
+            break;
+        }
+        printf("%10d %10d %10.2f %10.2f", count, nb.num_nodes, build_ms, force_ms);
+
+        if (count <= direct_limit)
+        {
+            double t0 = Now(), ms, err = 0.0, norm = 0.0;
+
+            ComputeNBodyDirect(&nb, &pool, x, y, NULL, count, rx, ry);
+            ms = (Now() - t0) * 1e3;
+            for (ii = 0 ; ii < count ; ++ii)
+            {
+                err += (double) (ax[ii] - rx[ii]) * (ax[ii] - rx[ii]) + (double) (ay[ii] - ry[ii]) * (ay[ii] - ry[ii]);
+                norm += (double) rx[ii] * rx[ii] + (double) ry[ii] * ry[ii];
+            }
+            printf(" %10.2f %12.2e\n", ms, sqrt(err / norm));
+        }
+        else
+            printf(" %10s %12s\n", "-", "-");
+        if (count > max_count / 2)
+            break;
+    }
+
+    count = (count <= max_count) ? count : count / 2;
+    printf("\n%10s %10s %10s %10s\n", "threads", "build ms", "forces ms", "speedup");
+    for (threads = 1 ; threads <= cpus ; threads *= 2)
+    {
+        WorkPool scaling = { 0 };
+
+        if (threads > 1 && !CreateWorkPool(&scaling, threads - 1))
+            break;
+        TimeBarnesHut(&nb, &scaling, x, y, count, ax, ay, &build_ms, &force_ms);
+        if (threads == 1)
+            first_ms = build_ms + force_ms;
+        printf("%10d %10.2f %10.2f %10.2f\n", threads, build_ms, force_ms, first_ms / (build_ms + force_ms));
+        if (threads > 1)
+            DestroyWorkPool(&scaling);
+    }
+
+    FreeNBody(&nb);
+    DestroyWorkPool(&pool);
+    free(x);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,176 @@
+//========================================================================
+// Instanced particle renderer benchmark
+//
+// Draws growing numbers of particles with particlegl.h and the
+// point_particle_instanced shaders into a hidden 800x600 window and prints
+// the GPU time per frame, then the largest count that still fits a 60 Hz
+// frame. Vsync is off and every frame is finished with glFinish(), so the
+// time is the real draw cost and not the swap interval.
+//
+// usage: particleBench [max particles] [frames]
+//        run from the repository root, the shaders are read from resources/
+//
+//========================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glad/gl.h>
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#define GL_STATE_IMPLEMENTATION
+#include "../glstate.h"
+#define GL_UTIL_IMPLEMENTATION
+#include "../glutil.h"
+#define GL_STREAMBUF_IMPLEMENTATION
+#include "../streambuf.h"
+#define GL_FRAMEUNIFORMS_IMPLEMENTATION
+#include "../frameuniforms.h"
+#define GL_PARTICLEGL_IMPLEMENTATION
+#include "../particlegl.h"
+
+#include "../deps/linmath.h"
+
+#define WIDTH 800
+#define HEIGHT 600
+#define FRAME_BUDGET_MS (1000.0 / 60.0)
+
+// Text of the shader file at path with the frame uniforms included
+static char* ReadText(const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    char *text, *expanded;
+    long size;
+
+    if (file == NULL)
+        return NULL;
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    text = (char*) malloc((size_t) size + 1);
+    if (text != NULL)
+    {
+        size = (long) fread(text, 1, (size_t) size, file);
+        text[size] = '\0';
+    }
+    fclose(file);
+    expanded = (text != NULL) ? IncludeFrameUniforms(text) : NULL;
+    free(text);
+    return expanded;
+}
+
+int main(int argc, char** argv)
+{
+    const int max_count = (argc > 1) ? atoi(argv[1]) : 16 << 20;
+    const int num_frames = (argc > 2) ? atoi(argv[2]) : 30;
+    int best = 0;
+    GLFWwindow* window;
+    ParticleRenderer renderer;
+    FrameUniforms uniforms;
+    Particle* particles;
+    char *vs_text, *fs_text;
+    GLuint program;
+    mat4x4 mvp;
+    int count, ii;
+
+    if (!glfwInit())
+        return EXIT_FAILURE;
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    window = glfwCreateWindow(WIDTH, HEIGHT, "particleBench", NULL, NULL);
+    if (window == NULL)
+    {
+        glfwTerminate();
+        return EXIT_FAILURE;
+    }
+    glfwMakeContextCurrent(window);
+    gladLoadGL(glfwGetProcAddress);
+    glfwSwapInterval(0);
+    InvalidateGLState();
+    InitStreamBuffers(glfwGetProcAddress);
+
+    vs_text = ReadText("resources/shaders/glsl330/point_particle_instanced.vs");
+    fs_text = ReadText("resources/shaders/glsl330/point_particle_instanced.fs");
+    if (vs_text == NULL || fs_text == NULL)
+    {
+        fprintf(stderr, "ERROR: Unable to read the point_particle_instanced shaders\n");
+        glfwTerminate();
+        return EXIT_FAILURE;
+    }
+    program = CreateShaderProgram(vs_text, fs_text);
+    free(vs_text);
+    free(fs_text);
+
+    particles = (Particle*) malloc(sizeof(Particle) * (size_t) max_count);
+    if (program == 0 || particles == NULL || !CreateParticleRenderer(&renderer, program, 1) ||
+        !CreateFrameUniforms(&uniforms))
+    {
+        glfwTerminate();
+        return EXIT_FAILURE;
+    }
+    for (ii = 0 ; ii < max_count ; ++ii)
+    {
+        particles[ii].x = (float) (20 + rand() % (WIDTH - 40));
+        particles[ii].y = (float) (50 + rand() % (HEIGHT - 70));
+        particles[ii].period = (float) (10 + rand() % 20) / 10.0f;
+    }
+
+    mat4x4_ortho(mvp, 0.f, (float) WIDTH, (float) HEIGHT, 0.f, -1.f, 1.f);
+    memcpy(uniforms.data.project, mvp, sizeof(uniforms.data.project));
+    uniforms.data.resolution[0] = (float) WIDTH;
+    uniforms.data.resolution[1] = (float) HEIGHT;
+    StateUseProgram(program);
+    BindFrameUniforms(program);
+    glUniform4f(glGetUniformLocation(program, "color"), 0.f, 0.f, 1.f, 0.5f);
+    StateEnable(GL_BLEND, GL_TRUE);
+    StateBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glViewport(0, 0, WIDTH, HEIGHT);
+
+    printf("%12s %12s %16s\n", "particles", "ms/frame", "particles/ms");
+    for (count = 1 << 16 ; count <= max_count ; count *= 2)
+    {
+        double t0, ms;
+
+        if (!UploadParticles(&renderer, particles, count))
+        {
+            printf("%12d %12s\n", count, "out of memory");
+            break;
+        }
+
+        // warm up, then time whole frames
+        WriteFrameUniforms(&uniforms);
+        glClear(GL_COLOR_BUFFER_BIT);
+        DrawParticles(&renderer);
+        glFinish();
+
+        t0 = glfwGetTime();
+        for (ii = 0 ; ii < num_frames ; ++ii)
+        {
+            uniforms.data.time = (float) ii / 60.0f;
+            WriteFrameUniforms(&uniforms);
+            glClear(GL_COLOR_BUFFER_BIT);
+            DrawParticles(&renderer);
+            glFinish();
+        }
+        ms = (glfwGetTime() - t0) * 1e3 / num_frames;
+        printf("%12d %12.2f %16.0f\n", count, ms, count / ms);
+        if (ms <= FRAME_BUDGET_MS)
+            best = count;
+        else
+            break;
+    }
+    printf("\n%d particles per frame at 60 Hz\n\n", best);
+    PrintGLStateStats();
+
+    DeleteParticleRenderer(&renderer);
+    DeleteFrameUniforms(&uniforms);
+    glDeleteProgram(program);
+    free(particles);
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,143 @@
+//========================================================================
+// Shader compile benchmark
+//
+// Builds the same number of programs twice in a hidden window: one after
+// the other with CreateShaderProgram(), then all submitted at once with
+// SubmitShaderProgram() and polled until every one completed. Every
+// program differs from all others, also from those of earlier runs, so
+// the shader cache of the driver does not help either way. Only the
+// parallel compile of the driver makes the second way faster, it says
+// whether KHR_parallel_shader_compile is used.
+//
+// usage: shaderBench [programs]
+//
+//========================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <glad/gl.h>
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#define GL_UTIL_IMPLEMENTATION
+#include "../glutil.h"
+
+static const char* vertex_shader_text =
+"#version 330\n"
+"const vec2 corners[3] = vec2[3](vec2(-1.0, -1.0), vec2(3.0, -1.0), vec2(-1.0, 3.0));\n"
+"out vec2 st;\n"
+"void main()\n"
+"{\n"
+"    st = corners[gl_VertexID];\n"
+"    gl_Position = vec4(st, %u.0 * 1e-9, 1.0);\n"
+"}\n";
+
+// a few octaves of value noise, enough work for the optimizer
+static const char* fragment_shader_text =
+"#version 330\n"
+"in vec2 st;\n"
+"out vec4 color;\n"
+"uniform float uTime;\n"
+"float hash(vec2 p) { return fract(sin(dot(p, vec2(12.9898, 78.233)) + %u.0) * 43758.5453); }\n"
+"float noise(vec2 p)\n"
+"{\n"
+"    vec2 i = floor(p), f = fract(p), u = f * f * (3.0 - 2.0 * f);\n"
+"    return mix(mix(hash(i), hash(i + vec2(1.0, 0.0)), u.x),\n"
+"               mix(hash(i + vec2(0.0, 1.0)), hash(i + vec2(1.0, 1.0)), u.x), u.y);\n"
+"}\n"
+"void main()\n"
+"{\n"
+"    float v = 0.0, a = 0.5;\n"
+"    vec2 p = st * 4.0 + uTime;\n"
+"    for (int ii = 0 ; ii < 6 ; ++ii, p *= 2.0, a *= 0.5)\n"
+"        v += a * noise(p);\n"
+"    color = vec4(vec3(v), 1.0);\n"
+"}\n";
+
+// Sources of program number, salt makes them differ from other runs
+static void MakeSources(char* vs, char* fs, size_t size, unsigned salt, int number)
+{
+    snprintf(vs, size, vertex_shader_text, salt + (unsigned) number);
+    snprintf(fs, size, fragment_shader_text, salt + (unsigned) number);
+}
+
+int main(int argc, char** argv)
+{
+    const int num_programs = (argc > 1) ? atoi(argv[1]) : 32;
+    const unsigned salt = (unsigned) time(NULL) * 4096u;
+    char vs[4096], fs[4096];
+    GLFWwindow* window;
+    ProgramBuild* builds;
+    GLuint* programs;
+    double t0, serial_ms, parallel_ms;
+    int parallel, pending, failed = 0, ii;
+
+    if (!glfwInit())
+        return EXIT_FAILURE;
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    window = glfwCreateWindow(64, 64, "shaderBench", NULL, NULL);
+    if (window == NULL)
+    {
+        glfwTerminate();
+        return EXIT_FAILURE;
+    }
+    glfwMakeContextCurrent(window);
+    gladLoadGL(glfwGetProcAddress);
+    parallel = InitParallelShaderCompile(glfwGetProcAddress);
+
+    builds = (ProgramBuild*) malloc(sizeof(ProgramBuild) * (size_t) num_programs);
+    programs = (GLuint*) malloc(sizeof(GLuint) * (size_t) num_programs);
+    if (builds == NULL || programs == NULL)
+    {
+        glfwTerminate();
+        return EXIT_FAILURE;
+    }
+    printf("%s, parallel shader compile %s\n\n", (const char*) glGetString(GL_RENDERER), parallel ? "on" : "off");
+
+    t0 = glfwGetTime();
+    for (ii = 0 ; ii < num_programs ; ++ii)
+    {
+        MakeSources(vs, fs, sizeof(vs), salt, ii);
+        programs[ii] = CreateShaderProgram(vs, fs);
+        failed += (programs[ii] == 0u);
+    }
+    serial_ms = (glfwGetTime() - t0) * 1e3;
+
+    t0 = glfwGetTime();
+    for (ii = 0 ; ii < num_programs ; ++ii)
+    {
+        MakeSources(vs, fs, sizeof(vs), salt, num_programs + ii);
+        SubmitShaderProgram(&builds[ii], vs, fs);
+    }
+    do
+    {
+        pending = 0;
+        for (ii = 0 ; ii < num_programs ; ++ii)
+            pending += (PollShaderProgram(&builds[ii]) == PROGRAM_PENDING);
+    } while (pending > 0);
+    parallel_ms = (glfwGetTime() - t0) * 1e3;
+    for (ii = 0 ; ii < num_programs ; ++ii)
+        failed += (builds[ii].status == PROGRAM_FAILED);
+
+    printf("%10s %12s %12s %10s\n", "programs", "serial ms", "submit ms", "speedup");
+    printf("%10d %12.1f %12.1f %10.2f\n", num_programs, serial_ms, parallel_ms, serial_ms / parallel_ms);
+    if (failed > 0)
+        printf("\n%d programs failed\n", failed);
+
+    for (ii = 0 ; ii < num_programs ; ++ii)
+    {
+        glDeleteProgram(programs[ii]);
+        glDeleteProgram(builds[ii].program);
+    }
+    free(programs);
+    free(builds);
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return (failed > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
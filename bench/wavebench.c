@@ -0,0 +1,155 @@
+//========================================================================
+// Wave integrator benchmark
+//
+// Runs the explicit and the implicit integrator of wave.h over the same
+// simulated time with growing steps and prints the cost per simulated
+// second next to the height error against a run with tiny explicit steps.
+// Equal visual quality is the error of the explicit scheme at its default
+// WAVE_MAX_DELTA_T step. Then times one AdvanceWaveGrid() call per frame
+// for growing frame times, as a slow frame would.
+//
+// usage: waveBench [size] [seconds]
+//
+//========================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#define GL_WORKPOOL_IMPLEMENTATION
+#include "../workpool.h"
+#define GL_SIMDLEVEL_IMPLEMENTATION
+#include "../simdlevel.h"
+#define GL_WAVE_IMPLEMENTATION
+#include "../wave.h"
+
+static const double steps[] = { 0.005, 0.01, 0.02, 0.04, 0.06, 0.08, 0.12, 0.16, 0.25 };
+static const double frames[] = { 1.0 / 60.0, 1.0 / 30.0, 0.1, 0.25, 0.5 };
+
+static double Now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+/* Run seconds of simulated time in steps of dt, returns the wall time */
+static double Simulate(WaveGrid* grid, WaveIntegrator integrator, double dt, double seconds)
+{
+    double t0, left;
+
+    ResetWaveGrid(grid);
+    t0 = Now();
+    for (left = seconds ; left > 1e-9 ; left -= dt)
+    {
+        double h = (left < dt) ? left : dt;
+        if (integrator == WAVE_INTEGRATOR_IMPLICIT)
+            StepWaveGridImplicit(grid, h);
+        else
+            StepWaveGrid(grid, h);
+    }
+    return Now() - t0;
+}
+
+/* Largest height difference relative to the largest reference height,
+ * infinite once the run blew up
+ */
+static double HeightError(const WaveGrid* grid, const float* reference)
+{
+    const size_t count = (size_t) grid->width * (size_t) grid->height;
+    double err = 0.0, peak = 0.0;
+    size_t ii;
+
+    for (ii = 0 ; ii < count ; ++ii)
+    {
+        double d = fabs((double) grid->p[ii] - (double) reference[ii]);
+        if (!(d <= err))
+            err = d;
+        if (fabs(reference[ii]) > peak)
+            peak = fabs(reference[ii]);
+    }
+    return (err == err && peak > 0.0) ? err / peak : INFINITY;
+}
+
+int main(int argc, char** argv)
+{
+    const int size = (argc > 1) ? atoi(argv[1]) : 256;
+    const double seconds = (argc > 2) ? atof(argv[2]) : 2.0;
+    const int num_steps = (int) (sizeof(steps) / sizeof(steps[0]));
+    double cost[2][sizeof(steps) / sizeof(steps[0])];
+    double error[2][sizeof(steps) / sizeof(steps[0])];
+    double target = 0.0;
+    const char* names[2] = { "explicit", "implicit" };
+    WaveGrid grid;
+    float* reference;
+    int ii, kk, best;
+
+    if (!InitWaveGrid(&grid, size, size) || !SetWaveIntegrator(&grid, WAVE_INTEGRATOR_IMPLICIT))
+    {
+        fprintf(stderr, "ERROR: Unable to allocate a %dx%d grid\n", size, size);
+        return EXIT_FAILURE;
+    }
+    reference = (float*) malloc(sizeof(float) * (size_t) size * (size_t) size);
+    if (reference == NULL)
+        return EXIT_FAILURE;
+
+    Simulate(&grid, WAVE_INTEGRATOR_EXPLICIT, 0.0005, seconds);
+    memcpy(reference, grid.p, sizeof(float) * (size_t) size * (size_t) size);
+
+    printf("%dx%d grid, %.2f s simulated\n\n", size, size, seconds);
+    printf("%-10s %8s %12s %14s %10s\n", "integrator", "step", "steps/sim-s", "ms/sim-s", "error");
+    for (kk = 0 ; kk < 2 ; ++kk)
+    {
+        for (ii = 0 ; ii < num_steps ; ++ii)
+        {
+            cost[kk][ii] = Simulate(&grid, (WaveIntegrator) kk, steps[ii], seconds) * 1e3 / seconds;
+            error[kk][ii] = HeightError(&grid, reference);
+            if (error[kk][ii] < 10.0)
+                printf("%-10s %8.3f %12.0f %14.2f %10.4f\n", names[kk], steps[ii],
+                       ceil(1.0 / steps[ii]), cost[kk][ii], error[kk][ii]);
+            else
+                printf("%-10s %8.3f %12.0f %14.2f %10s\n", names[kk], steps[ii],
+                       ceil(1.0 / steps[ii]), cost[kk][ii], "unstable");
+            if (kk == WAVE_INTEGRATOR_EXPLICIT && steps[ii] == WAVE_MAX_DELTA_T)
+                target = error[kk][ii];
+        }
+    }
+
+    printf("\nat the error of the explicit %.3f s step (%.4f):\n", WAVE_MAX_DELTA_T, target);
+    for (kk = 0 ; kk < 2 ; ++kk)
+    {
+        best = -1;
+        for (ii = 0 ; ii < num_steps ; ++ii)
+            if (error[kk][ii] <= target * 1.05 && (best < 0 || cost[kk][ii] < cost[kk][best]))
+                best = ii;
+        if (best < 0)
+            printf("  %-10s no step reaches it\n", names[kk]);
+        else
+            printf("  %-10s step %.3f, %.2f ms per simulated second\n",
+                   names[kk], steps[best], cost[kk][best]);
+    }
+
+    printf("\n%-10s %8s %14s\n", "integrator", "frame", "ms/frame");
+    for (kk = 0 ; kk < 2 ; ++kk)
+    {
+        SetWaveIntegrator(&grid, (WaveIntegrator) kk);
+        for (ii = 0 ; ii < (int) (sizeof(frames) / sizeof(frames[0])) ; ++ii)
+        {
+            double t0;
+            int frame;
+
+            ResetWaveGrid(&grid);
+            t0 = Now();
+            for (frame = 0 ; frame < 20 ; ++frame)
+                AdvanceWaveGrid(&grid, frames[ii]);
+            printf("%-10s %8.3f %14.2f\n", names[kk], frames[ii], (Now() - t0) * 1e3 / 20.0);
+        }
+    }
+
+    free(reference);
+    FreeWaveGrid(&grid);
+    return EXIT_SUCCESS;
+}
@@ -34,8 +34,14 @@
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 
+#define GL_STATE_IMPLEMENTATION
+#include "glstate.h"
 #define GL_UTIL_IMPLEMENTATION 
 #include "glutil.h"
+#define GL_STREAMBUF_IMPLEMENTATION
+#include "streambuf.h"
+#define GL_FRAMEUNIFORMS_IMPLEMENTATION
+#include "frameuniforms.h"
 
 #include "deps/linmath.h"
 /**********************************************************************
@@ -57,8 +63,7 @@
                
 static const char* defaultVS =
 "#version 150\n"
-"uniform mat4 project;\n"
-"uniform mat4 modelview;\n"
+FRAME_UNIFORMS_GLSL
 "attribute vec3 vCol;\n"
 "attribute vec2 vPos;\n"
 "varying vec3 color;\n"
@@ -75,8 +80,7 @@ static const char* defaultVS =
 
 static const char* defaultFS =
 "#version 150\n"
-"uniform vec2 uResolution;\n"
-"uniform float uTime;\n"
+FRAME_UNIFORMS_GLSL
 "varying vec3 color;\n"
 "out vec4 finalColor;\n"
 "void main()\n"
@@ -146,9 +150,9 @@ int main(int argc, char** argv)
     GLFWwindow* window;
     double dt, last_update_time;
     float f;
-    GLint vertex_buffer, uloc_modelview;
-    GLint uloc_project, uTimeLoc, uResLoc, vpos_location, vcol_location;
-    int iter, frame, width, height;
+    GLint vertex_buffer, vpos_location, vcol_location;
+    FrameUniforms uniforms;
+    int iter, frame;
 
     GLuint shader_program;
 
@@ -174,9 +178,11 @@ int main(int argc, char** argv)
     glfwMakeContextCurrent(window);
     gladLoadGL(glfwGetProcAddress);
     glfwSwapInterval(1);
+    InvalidateGLState();
+    InitStreamBuffers(glfwGetProcAddress);
     
     glGenBuffers(1, &vertex_buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+    StateBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
     
     /* Prepare opengl resources for rendering */
@@ -187,14 +193,15 @@ int main(int argc, char** argv)
         exit(EXIT_FAILURE);
     }
     
-    glUseProgram(shader_program);
+    StateUseProgram(shader_program);
     vpos_location = glGetAttribLocation(shader_program, "vPos");
     vcol_location = glGetAttribLocation(shader_program, "vCol");
-    
-    uloc_project   = glGetUniformLocation(shader_program, "project");
-    uloc_modelview = glGetUniformLocation(shader_program, "modelview");
-    uTimeLoc =  glGetUniformLocation(shader_program, "uTime");
-    uResLoc =  glGetUniformLocation(shader_program, "uResolution");
+    BindFrameUniforms(shader_program);
+    if (!CreateFrameUniforms(&uniforms))
+    {
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
     
     glEnableVertexAttribArray(vpos_location);
     glVertexAttribPointer(vpos_location, 2, GL_FLOAT, GL_FALSE,
@@ -210,21 +217,19 @@ int main(int argc, char** argv)
     projection_matrix[10] = (z_far + z_near)/ (z_near - z_far);
     projection_matrix[11] = -1.0f;
     projection_matrix[14] = 2.0f * (z_far * z_near) / (z_near - z_far);
-    glUniformMatrix4fv(uloc_project, 1, GL_FALSE, projection_matrix);
+    memcpy(uniforms.data.project, projection_matrix, sizeof(projection_matrix));
 
     /* Set the camera position */
     modelview_matrix[12]  = -5.0f;
     modelview_matrix[13]  = -5.0f;
     modelview_matrix[14]  = -20.0f;
-    glUniformMatrix4fv(uloc_modelview, 1, GL_FALSE, modelview_matrix);
+    memcpy(uniforms.data.modelview, modelview_matrix, sizeof(modelview_matrix));
 
     /* Create vao + vbo to store the mesh */
     /* Create the vbo to store all the information for the grid and the height */
 
     /* setup the scene ready for rendering */
     glClearColor(0.0f, 0.0f, 0.0f, 255.0f);
-    float res[2] = {width, height};
-    glUniform2fv(uResLoc, 1, &res);
     glEnable(GL_PROGRAM_POINT_SIZE);
     
     glPointSize(299);
@@ -250,22 +255,25 @@ int main(int argc, char** argv)
         mat4x4_ortho(p, -ratio, ratio, -1.f, 1.f, 1.f, -1.f);
         mat4x4_mul(mvp, p, m);
                 
-        float uTime = dt;//(dt - last_update_time);
-        glUniform1fv(uTimeLoc, 1, &uTime);
+        uniforms.data.time = dt;//(dt - last_update_time);
+        uniforms.data.resolution[0] = (GLfloat) width;
+        uniforms.data.resolution[1] = (GLfloat) height;
         
-        /* render the next frame */
+        /* render the next frame, all its programs read the same uniforms */
+        WriteFrameUniforms(&uniforms);
         glClear(GL_COLOR_BUFFER_BIT);
         
-        glUseProgram(shader_program);
-            glBindVertexArray(vertex_buffer);
+        StateUseProgram(shader_program);
+            StateBindVertexArray(vertex_buffer);
             glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-        glUseProgram(0);
         
         /* display and process events through callbacks */
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
+    PrintGLStateStats();
+    DeleteFrameUniforms(&uniforms);
     glfwTerminate();
     exit(EXIT_SUCCESS);
 }
@@ -34,10 +34,28 @@
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 
+#define GL_STATE_IMPLEMENTATION
+#include "glstate.h"
+#define GL_STREAMBUF_IMPLEMENTATION
+#include "streambuf.h"
+#define GL_FRAMEUNIFORMS_IMPLEMENTATION
+#include "frameuniforms.h"
 #define GL_HEIGHTMAP_IMPLEMENTATION 
 #include "heightmap.h"
 #define GL_UTIL_IMPLEMENTATION 
 #include "glutil.h"
+#define GL_SIMCLOCK_IMPLEMENTATION
+#include "simclock.h"
+#define GL_SIMDLEVEL_IMPLEMENTATION
+#include "simdlevel.h"
+#define GL_MAPPARTICLES_IMPLEMENTATION
+#include "mapparticles.h"
+
+/* Seconds between two heightmap iterations and most iterations run to
+ * catch up in one frame
+ */
+#define MAP_UPDATE_STEP (0.2)
+#define MAX_STEPS_PER_FRAME (2)
 
 /**********************************************************************
  * Values for shader uniforms
@@ -86,12 +104,15 @@ int main(int argc, char** argv)
 {
     GLFWwindow* window;
     int iter;
-    double dt;
-    double last_update_time;
+    int num_steps;
+    int updated;
+    SimClock sim_clock;
+    MapParticles particles;
+    int num_particles;
+    double now, last_time;
     int frame;
     float f;
-    GLint uloc_modelview;
-    GLint uloc_project, uTimeLoc, uResLoc;
+    FrameUniforms uniforms;
     int width, height;
 
     GLuint shader_program;
@@ -119,6 +140,9 @@ int main(int argc, char** argv)
 
     glfwMakeContextCurrent(window);
     gladLoadGL(glfwGetProcAddress);
+    InvalidateGLState();
+    InitStreamBuffers(glfwGetProcAddress);
+    InitProgramCache("shadercache", glfwGetProcAddress);
 
     /* Prepare opengl resources for rendering */
     shader_program = CreateShaderProgram(vertex_shader_text, fragment_shader_text);
@@ -128,11 +152,13 @@ int main(int argc, char** argv)
         exit(EXIT_FAILURE);
     }
 
-    glUseProgram(shader_program);
-    uloc_project   = glGetUniformLocation(shader_program, "project");
-    uloc_modelview = glGetUniformLocation(shader_program, "modelview");
-    uTimeLoc =  glGetUniformLocation(shader_program, "uTime");
-    uResLoc =  glGetUniformLocation(shader_program, "uResolution");
+    StateUseProgram(shader_program);
+    BindFrameUniforms(shader_program);
+    if (!CreateFrameUniforms(&uniforms))
+    {
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
     
     /* Compute the projection matrix */
     f = 1.0f / tanf(view_angle / 2.0f);
@@ -141,17 +167,29 @@ int main(int argc, char** argv)
     projection_matrix[10] = (z_far + z_near)/ (z_near - z_far);
     projection_matrix[11] = -1.0f;
     projection_matrix[14] = 2.0f * (z_far * z_near) / (z_near - z_far);
-    glUniformMatrix4fv(uloc_project, 1, GL_FALSE, projection_matrix);
+    memcpy(uniforms.data.project, projection_matrix, sizeof(projection_matrix));
 
     /* Set the camera position */
     modelview_matrix[12]  = -5.0f;
     modelview_matrix[13]  = -5.0f;
     modelview_matrix[14]  = -20.0f;
-    glUniformMatrix4fv(uloc_modelview, 1, GL_FALSE, modelview_matrix);
+    memcpy(uniforms.data.modelview, modelview_matrix, sizeof(modelview_matrix));
 
     /* Create mesh data */
     InitMap();
-    CreateMesh(shader_program);
+    if (!CreateMesh(shader_program))
+    {
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+
+    /* Optionally rain particles on the terrain: glfwbase.heightmap [particles] */
+    num_particles = (argc > 1) ? atoi(argv[1]) : 0;
+    if (num_particles > 0 && !CreateMapParticles(&particles, shader_program, num_particles))
+    {
+        fprintf(stderr, "ERROR: Unable to create %d particles\n", num_particles);
+        num_particles = 0;
+    }
 
     /* Create vao + vbo to store the mesh */
     /* Create the vbo to store all the information for the grid and the height */
@@ -160,43 +198,73 @@ int main(int argc, char** argv)
     glfwGetFramebufferSize(window, &width, &height);
     glViewport(0, 0, width, height);
     glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-    float res[2] = {width, height};
-    glUniform2fv(uResLoc, 1, &res);
+    uniforms.data.resolution[0] = (GLfloat) width;
+    uniforms.data.resolution[1] = (GLfloat) height;
     
     /* main loop */
     frame = 0;
     iter = 0;
-    last_update_time = glfwGetTime();
+    last_time = glfwGetTime();
+    InitSimClock(&sim_clock, MAP_UPDATE_STEP, MAX_STEPS_PER_FRAME, last_time);
     while (!glfwWindowShouldClose(window))
     {
         ++frame;
-        /* render the next frame */
+        now = glfwGetTime();
+        /* generate the iterations of the heightmap that are due */
+        num_steps = TickSimClock(&sim_clock, now);
+        updated = 0;
+        for ( ; num_steps > 0 && iter < MAX_ITER ; --num_steps)
+        {
+            UpdateMap(NUM_ITER_AT_A_TIME);
+            iter += NUM_ITER_AT_A_TIME;
+            updated = 1;
+        }
+        if (updated)
+        {
+            uniforms.data.time = sim_clock.sim_time/10;
+            frame = 0;
+        }
+
+        /* move smoothly between the last two iterations */
+        if (iter < MAX_ITER)
+            UpdateMeshLerp(sim_clock.alpha);
+        else if (updated)
+            UpdateMesh();
+
+        /* against the surface just streamed, at most a 20th of a second per
+         * frame so a stall does not shoot the particles through it
+         */
+        if (num_particles > 0)
+            UpdateMapParticles(&particles, (float) ((now - last_time < 0.05) ? now - last_time : 0.05));
+        last_time = now;
+
+        /* render the next frame, all its programs read the same uniforms */
+        WriteFrameUniforms(&uniforms);
         glClear(GL_COLOR_BUFFER_BIT);
         
+        StateBindVertexArray(mesh);
         glDrawElements(GL_LINES, 2* MAP_NUM_LINES , GL_UNSIGNED_INT, 0);
+        if (num_particles > 0)
+            DrawMapParticles(&particles);
 
         /* display and process events through callbacks */
         glfwSwapBuffers(window);
         glfwPollEvents();
-        /* Check the frame rate and update the heightmap if needed */
-        dt = glfwGetTime();
-        if ((dt - last_update_time) > 0.2)
-        {
-            /* generate the next iteration of the heightmap */
-            if (iter < MAX_ITER)
-            {
-                float uTime = dt/10;//(dt - last_update_time);
-                glUniform1fv(uTimeLoc, 1, &uTime);
-                
-                UpdateMap(NUM_ITER_AT_A_TIME);
-                UpdateMesh();
-                iter += NUM_ITER_AT_A_TIME;
-            }
-            last_update_time = dt;
-            frame = 0;
-        }        
     }
 
+    printf("%lu heightmap steps, %lu late, %lu dropped\n",
+           sim_clock.step_count, sim_clock.late_steps, sim_clock.dropped_steps);
+    printf("%lu height uploads (%s), %lu stalled\n", mesh_heights.maps,
+           mesh_heights.persistent ? "persistent" : "orphaned", mesh_heights.stalls);
+    printf("%lu programs loaded from the cache, %lu compiled\n", program_cache.hits, program_cache.misses);
+    PrintGLStateStats();
+    if (num_particles > 0)
+    {
+        printf("%d particles, %d on the terrain\n", num_particles, particles.contacts);
+        DeleteMapParticles(&particles);
+    }
+    DeleteFrameUniforms(&uniforms);
+
     glfwTerminate();
     exit(EXIT_SUCCESS);
 }
@@ -0,0 +1,324 @@
+//========================================================================
+// re-used by: Suwandi Tanuwijaya (swndtan[at]gmail.com)
+// based-on Wave Simulation in OpenGL
+// (C) 2002 Jakob Thomsen
+// Modified for GLFW by Sylvain Hellegouarch
+// Modified for variable frame rate by Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+//
+// reference/wave.c ported to an OpenGL 3.3 core profile context. Run with
+// --gpu to keep the simulation on the GPU instead of the CPU. Press D to
+// drop a disturbance at a random spot of the grid and I to switch the CPU
+// simulation between the explicit and the implicit integrator.
+//
+//========================================================================
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <stddef.h>
+
+#include <glad/gl.h>
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#define GL_STATE_IMPLEMENTATION
+#include "glstate.h"
+#define GL_UTIL_IMPLEMENTATION
+#include "glutil.h"
+#define GL_STREAMBUF_IMPLEMENTATION
+#include "streambuf.h"
+#define GL_WORKPOOL_IMPLEMENTATION
+#include "workpool.h"
+#define GL_SIMDLEVEL_IMPLEMENTATION
+#include "simdlevel.h"
+#define GL_WAVE_IMPLEMENTATION
+#include "wave.h"
+#define GL_WAVEGL_IMPLEMENTATION
+#include "wavegl.h"
+#define GL_WAVEGPU_IMPLEMENTATION
+#include "wavegpu.h"
+#define GL_SIMCLOCK_IMPLEMENTATION
+#include "simclock.h"
+
+#include "deps/linmath.h"
+
+#define GRIDW 50
+#define GRIDH 50
+
+/* Pressure and velocity below which a part of the grid goes to sleep */
+#define ACTIVITY_THRESHOLD (1e-3f)
+
+/* Most simulation steps run in one frame, the rest is dropped */
+#define MAX_STEPS_PER_FRAME (10)
+
+/**********************************************************************
+ * Camera and simulation state
+ *********************************************************************/
+static GLfloat alpha = 210.f, beta = -70.f;
+static GLfloat zoom = 2.f;
+
+static double cursorX;
+static double cursorY;
+
+static mat4x4 projection;
+
+static WaveGrid grid;
+static WaveGpu wave_gpu;
+static int use_gpu = 0;
+
+/* Pressure before the last step, to interpolate the CPU heights from */
+static float* p_prev;
+static SimClock sim_clock;
+
+/**********************************************************************
+ * GLFW callback functions
+ *********************************************************************/
+static void error_callback(int error, const char* description)
+{
+    fprintf(stderr, "Error: %s\n", description);
+}
+
+static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    if (action != GLFW_PRESS)
+        return;
+
+    switch (key)
+    {
+        case GLFW_KEY_ESCAPE:
+            glfwSetWindowShouldClose(window, GLFW_TRUE);
+            break;
+        case GLFW_KEY_SPACE:
+            ResetWaveGrid(&grid);
+            if (use_gpu)
+                UploadWaveGpu(&wave_gpu, &grid);
+            else
+                memcpy(p_prev, grid.p, sizeof(float) * GRIDW * GRIDH);
+            break;
+        case GLFW_KEY_D:
+            if (use_gpu)
+                ReadWaveGpu(&wave_gpu, &grid);
+            DisturbWaveGrid(&grid, 1 + rand() % (GRIDW - 1), 1 + rand() % (GRIDH - 1),
+                            GRIDW / 10, 100.f);
+            if (use_gpu)
+                UploadWaveGpu(&wave_gpu, &grid);
+            break;
+        case GLFW_KEY_I:
+            if (!use_gpu && SetWaveIntegrator(&grid, grid.integrator == WAVE_INTEGRATOR_EXPLICIT ?
+                                              WAVE_INTEGRATOR_IMPLICIT : WAVE_INTEGRATOR_EXPLICIT))
+                sim_clock.step = (grid.integrator == WAVE_INTEGRATOR_IMPLICIT) ?
+                                 WAVE_IMPLICIT_DELTA_T : WAVE_MAX_DELTA_T;
+            break;
+        case GLFW_KEY_LEFT:
+            alpha += 5;
+            break;
+        case GLFW_KEY_RIGHT:
+            alpha -= 5;
+            break;
+        case GLFW_KEY_UP:
+            beta -= 5;
+            break;
+        case GLFW_KEY_DOWN:
+            beta += 5;
+            break;
+        case GLFW_KEY_PAGE_UP:
+            zoom -= 0.25f;
+            if (zoom < 0.f)
+                zoom = 0.f;
+            break;
+        case GLFW_KEY_PAGE_DOWN:
+            zoom += 0.25f;
+            break;
+        default:
+            break;
+    }
+}
+
+static void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+{
+    if (button != GLFW_MOUSE_BUTTON_LEFT)
+        return;
+
+    if (action == GLFW_PRESS)
+    {
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+        glfwGetCursorPos(window, &cursorX, &cursorY);
+    }
+    else
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
+}
+
+static void cursor_position_callback(GLFWwindow* window, double x, double y)
+{
+    if (glfwGetInputMode(window, GLFW_CURSOR) == GLFW_CURSOR_DISABLED)
+    {
+        alpha += (GLfloat) (x - cursorX) / 10.f;
+        beta += (GLfloat) (y - cursorY) / 10.f;
+
+        cursorX = x;
+        cursorY = y;
+    }
+}
+
+static void scroll_callback(GLFWwindow* window, double x, double y)
+{
+    zoom += (float) y / 4.f;
+    if (zoom < 0)
+        zoom = 0;
+}
+
+static void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+{
+    float ratio = 1.f;
+
+    if (height > 0)
+        ratio = (float) width / (float) height;
+
+    glViewport(0, 0, width, height);
+    mat4x4_perspective(projection,
+                       60.f * (float) M_PI / 180.f,
+                       ratio,
+                       1.f, 1024.f);
+}
+
+int main(int argc, char** argv)
+{
+    GLFWwindow* window;
+    WaveMesh mesh;
+    int num_steps;
+    int width, height;
+
+    use_gpu = (argc > 1 && strcmp(argv[1], "--gpu") == 0);
+
+    glfwSetErrorCallback(error_callback);
+
+    if (!glfwInit())
+        exit(EXIT_FAILURE);
+
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GLFW_TRUE);
+
+    window = glfwCreateWindow(640, 480, "Wave Simulation", NULL, NULL);
+    if (!window)
+    {
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+
+    glfwSetKeyCallback(window, key_callback);
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetMouseButtonCallback(window, mouse_button_callback);
+    glfwSetCursorPosCallback(window, cursor_position_callback);
+    glfwSetScrollCallback(window, scroll_callback);
+
+    glfwMakeContextCurrent(window);
+    gladLoadGL(glfwGetProcAddress);
+    InvalidateGLState();
+    InitStreamBuffers(glfwGetProcAddress);
+    glfwSwapInterval(1);
+
+    glfwGetFramebufferSize(window, &width, &height);
+    framebuffer_size_callback(window, width, height);
+
+    /* Initialize simulation and the renderer of the selected backend */
+    p_prev = (float*) malloc(sizeof(float) * GRIDW * GRIDH);
+    if (p_prev == NULL || !InitWaveGrid(&grid, GRIDW, GRIDH) ||
+        (!use_gpu && !SetWaveActivity(&grid, ACTIVITY_THRESHOLD)))
+    {
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+    if (use_gpu ? !CreateWaveGpu(&wave_gpu, &grid) : !CreateWaveMesh(&mesh, &grid))
+    {
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+
+    StateEnable(GL_DEPTH_TEST, GL_TRUE);
+    glClearColor(0, 0, 0, 0);
+
+    memcpy(p_prev, grid.p, sizeof(float) * GRIDW * GRIDH);
+    InitSimClock(&sim_clock, WAVE_MAX_DELTA_T, MAX_STEPS_PER_FRAME, glfwGetTime());
+    while (!glfwWindowShouldClose(window))
+    {
+        mat4x4 modelview, mvp;
+
+        /* Calculate wave propagation in fixed steps and upload the heights
+         * interpolated between the last two of them
+         */
+        num_steps = TickSimClock(&sim_clock, glfwGetTime());
+        if (use_gpu)
+            StepWaveGpu(&wave_gpu, num_steps, sim_clock.step);
+        else
+        {
+            for ( ; num_steps > 0 ; --num_steps)
+            {
+                if (num_steps == 1)
+                    memcpy(p_prev, grid.p, sizeof(float) * GRIDW * GRIDH);
+                if (grid.integrator == WAVE_INTEGRATOR_IMPLICIT)
+                    StepWaveGridImplicit(&grid, sim_clock.step);
+                else
+                    StepWaveGrid(&grid, sim_clock.step);
+            }
+            UpdateWaveMesh(&mesh, &grid, p_prev, sim_clock.alpha);
+        }
+
+        /* Move back and rotate the view */
+        mat4x4_translate(modelview, 0.f, 0.f, -zoom);
+        mat4x4_rotate_X(modelview, modelview, beta * (float) M_PI / 180.f);
+        mat4x4_rotate_Z(modelview, modelview, alpha * (float) M_PI / 180.f);
+        mat4x4_mul(mvp, projection, modelview);
+
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        if (use_gpu)
+            DrawWaveGpu(&wave_gpu, (const GLfloat*) mvp, sim_clock.alpha);
+        else
+            DrawWaveMesh(&mesh, (const GLfloat*) mvp);
+
+        glfwSwapBuffers(window);
+        glfwPollEvents();
+    }
+
+    if (use_gpu)
+        DeleteWaveGpu(&wave_gpu);
+    else
+    {
+        printf("%lu vertex uploads (%s), %lu stalled\n", mesh.stream.maps,
+               mesh.stream.persistent ? "persistent" : "orphaned", mesh.stream.stalls);
+        DeleteWaveMesh(&mesh);
+    }
+    FreeWaveGrid(&grid);
+    free(p_prev);
+
+    printf("%lu simulation steps, %lu late, %lu dropped\n",
+           sim_clock.step_count, sim_clock.late_steps, sim_clock.dropped_steps);
+    PrintGLStateStats();
+
+    glfwTerminate();
+    exit(EXIT_SUCCESS);
+}
@@ -36,6 +36,10 @@
 
 #define GL_UTIL_IMPLEMENTATION 
 #include "glutil.h"
+#define GL_SHADERRELOAD_IMPLEMENTATION
+#include "shaderreload.h"
+#define GL_UNIFORMCACHE_IMPLEMENTATION
+#include "uniformcache.h"
 
 #include "deps/linmath.h"
 /**********************************************************************
@@ -154,16 +158,84 @@ static void error_callback(int error, const char* description) {
     fprintf(stderr, "Error: %s\n", description);
 }
 
+/* Location of the uniform called name if it has the type the viewer sends
+ * it, -1 otherwise: the table uploads as many values as the type holds.
+ */
+static GLint FindViewerUniform(const UniformTable* table, const char* name, GLenum type)
+{
+    GLint location = FindUniform(table, name);
+    int ii;
+
+    for (ii = 0 ; ii < table->count ; ++ii)
+        if (table->uniforms[ii].location == location)
+            return (table->uniforms[ii].type == type) ? location : -1;
+    return -1;
+}
+
+/* Make program current and give it the uniforms and vertex attributes, also
+ * after a reload. vertex_array and vertex_buffer are bound here, so the
+ * attributes land in the same place whatever the caller left bound.
+ * uniforms is rebuilt for program, its upload counts carry on.
+ * Returns the location of uTime, set every frame through uniforms.
+ */
+static GLint SetupViewerProgram(GLuint program, GLuint vertex_array, GLuint vertex_buffer,
+                                UniformTable* uniforms, int width, int height)
+{
+    unsigned long issued = uniforms->issued, skipped = uniforms->skipped;
+    GLint vpos_location, vcol_location;
+    float res[2];
+
+    glUseProgram(program);
+    glBindVertexArray(vertex_array);
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+    vpos_location = glGetAttribLocation(program, "vPos");
+    vcol_location = glGetAttribLocation(program, "vCol");
+
+    if (vpos_location >= 0)
+    {
+        glEnableVertexAttribArray(vpos_location);
+        glVertexAttribPointer(vpos_location, 2, GL_FLOAT, GL_FALSE,
+                              sizeof(vertices[0]), (void*) 0);
+    }
+    if (vcol_location >= 0)
+    {
+        glEnableVertexAttribArray(vcol_location);
+        glVertexAttribPointer(vcol_location, 3, GL_FLOAT, GL_FALSE,
+                              sizeof(vertices[0]), (void*) (sizeof(float) * 2));
+    }
+
+    /* a new program, none of the values cached for the last one hold */
+    DeleteUniformTable(uniforms);
+    CreateUniformTable(uniforms, program);
+    uniforms->issued = issued;
+    uniforms->skipped = skipped;
+    SetUniform(uniforms, FindViewerUniform(uniforms, "project", GL_FLOAT_MAT4), projection_matrix, 1);
+    SetUniform(uniforms, FindViewerUniform(uniforms, "modelview", GL_FLOAT_MAT4), modelview_matrix, 1);
+    res[0] = (float) width;
+    res[1] = (float) height;
+    SetUniform(uniforms, FindViewerUniform(uniforms, "uResolution", GL_FLOAT_VEC2), res, 1);
+    return FindViewerUniform(uniforms, "uTime", GL_FLOAT);
+}
+
 int main(int argc, char** argv)
 {
     GLFWwindow* window;
     double dt, last_update_time;
     float f;
-    GLint vertex_buffer, uloc_modelview;
-    GLint uloc_project, uTimeLoc, uResLoc, vpos_location, vcol_location;
+    GLuint vertex_array, vertex_buffer;
+    GLint uTimeLoc;
     int iter, frame, width, height;
 
-    GLuint shader_program;
+    GLuint shader_program, reloaded;
+    ShaderReload reload;
+    UniformTable uniforms = { 0 };
+    /* glfwBase [fragment shader file] [vertex shader file], the files are
+     * reloaded whenever they change
+     */
+    const char* fs_path = (argc > 1) ? argv[1] : NULL;
+    const char* vs_path = (argc > 2) ? argv[2] : NULL;
+    char* fs_text = (fs_path != NULL) ? ReadShaderFile(fs_path) : NULL;
+    char* vs_text = (vs_path != NULL) ? ReadShaderFile(vs_path) : NULL;
 
     glfwSetErrorCallback(error_callback);
 
@@ -190,33 +262,28 @@ int main(int argc, char** argv)
     gladLoadGL(glfwGetProcAddress);
     glfwSwapInterval(1);
     
+    glGenVertexArrays(1, &vertex_array);
     glGenBuffers(1, &vertex_buffer);
     glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
     
-    /* Prepare opengl resources for rendering */
-    shader_program = CreateShaderProgram(defaultVS, defaultFS);
+    /* Prepare opengl resources for rendering, the embedded shaders stand in
+     * for missing or broken files until they are fixed
+     */
+    shader_program = CreateShaderProgram((vs_text != NULL) ? vs_text : defaultVS,
+                                         (fs_text != NULL) ? fs_text : defaultFS);
+    if (shader_program == 0u && (vs_text != NULL || fs_text != NULL))
+        shader_program = CreateShaderProgram(defaultVS, defaultFS);
+    free(vs_text);
+    free(fs_text);
     if (shader_program == 0u)
     {
         glfwTerminate();
         exit(EXIT_FAILURE);
     }
-    
-    glUseProgram(shader_program);
-    vpos_location = glGetAttribLocation(shader_program, "vPos");
-    vcol_location = glGetAttribLocation(shader_program, "vCol");
-    
-    uloc_project   = glGetUniformLocation(shader_program, "project");
-    uloc_modelview = glGetUniformLocation(shader_program, "modelview");
-    uTimeLoc =  glGetUniformLocation(shader_program, "uTime");
-    uResLoc =  glGetUniformLocation(shader_program, "uResolution");
-    
-    glEnableVertexAttribArray(vpos_location);
-    glVertexAttribPointer(vpos_location, 2, GL_FLOAT, GL_FALSE,
-                          sizeof(vertices[0]), (void*) 0);
-    glEnableVertexAttribArray(vcol_location);
-    glVertexAttribPointer(vcol_location, 3, GL_FLOAT, GL_FALSE,
-                          sizeof(vertices[0]), (void*) (sizeof(float) * 2));
+    if (StartShaderReload(&reload, window, vs_path, fs_path, defaultVS, defaultFS))
+        printf("Reloading shaders when %s%s%s change\n", (fs_path != NULL) ? fs_path : "",
+               (fs_path != NULL && vs_path != NULL) ? " or " : "", (vs_path != NULL) ? vs_path : "");
                           
     /* Compute the projection matrix */
     f = 1.0f / tanf(view_angle / 2.0f);
@@ -225,23 +292,20 @@ int main(int argc, char** argv)
     projection_matrix[10] = (z_far + z_near)/ (z_near - z_far);
     projection_matrix[11] = -1.0f;
     projection_matrix[14] = 2.0f * (z_far * z_near) / (z_near - z_far);
-    glUniformMatrix4fv(uloc_project, 1, GL_FALSE, projection_matrix);
 
     /* Set the camera position */
     modelview_matrix[12]  = -5.0f;
     modelview_matrix[13]  = -5.0f;
     modelview_matrix[14]  = -20.0f;
-    glUniformMatrix4fv(uloc_modelview, 1, GL_FALSE, modelview_matrix);
 
     /* Create vao + vbo to store the mesh */
     /* Create the vbo to store all the information for the grid and the height */
 
     /* setup the scene ready for rendering */
-    //glfwGetFramebufferSize(window, &width, &height);
+    glfwGetFramebufferSize(window, &width, &height);
     //glViewport(0, 0, width, height);
     glClearColor(0.0f, 0.0f, 0.0f, 255.0f);
-    float res[2] = {width, height};
-    glUniform2fv(uResLoc, 1, &res);
+    uTimeLoc = SetupViewerProgram(shader_program, vertex_array, vertex_buffer, &uniforms, width, height);
     glEnable(GL_PROGRAM_POINT_SIZE);
     
     glPointSize(299);
@@ -257,6 +321,14 @@ int main(int argc, char** argv)
         
         ++frame;
         glfwGetFramebufferSize(window, &width, &height);
+        /* swap in a rebuilt program between two frames, never waiting */
+        reloaded = TakeReloadedProgram(&reload);
+        if (reloaded != 0u)
+        {
+            glDeleteProgram(shader_program);
+            shader_program = reloaded;
+            uTimeLoc = SetupViewerProgram(shader_program, vertex_array, vertex_buffer, &uniforms, width, height);
+        }
         ratio = width / (float) height;
 
         glViewport(0, 0, width, height);
@@ -270,15 +342,15 @@ int main(int argc, char** argv)
         
         
         float uTime = dt;//(dt - last_update_time);
-        glUniform1fv(uTimeLoc, 1, &uTime);
         
         /* render the next frame */
         glClear(GL_COLOR_BUFFER_BIT);
         
         glUseProgram(shader_program);
+            SetUniform(&uniforms, uTimeLoc, &uTime, 1);
             //glUniformMatrix4fv(uloc_project, 1, GL_FALSE, (const GLfloat*) p);
             //glUniformMatrix4fv(uloc_modelview, 1, GL_FALSE, (const GLfloat*) m);
-            glBindVertexArray(vertex_buffer);
+            glBindVertexArray(vertex_array);
             glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
         //glDrawElements(GL_LINES, 2* MAP_NUM_LINES , GL_UNSIGNED_INT, 0);
         glUseProgram(0);
@@ -305,6 +377,12 @@ int main(int argc, char** argv)
         } */       
     }
 
+    if (vs_path != NULL || fs_path != NULL)
+        printf("%lu shader reloads, %lu failed\n", reload.reloads, reload.failures);
+    printf("%lu uniform uploads, %lu skipped as unchanged\n", uniforms.issued, uniforms.skipped);
+    StopShaderReload(&reload);
+    DeleteUniformTable(&uniforms);
+    glDeleteProgram(shader_program);
     glfwTerminate();
     exit(EXIT_SUCCESS);
 }
@@ -1,8 +1,100 @@
 #ifndef GL_UTIL_H
 #define GL_UTIL_H
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+ #define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+ #define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+ #define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+#ifndef GL_PROGRAM_BINARY_FORMATS
+ #define GL_PROGRAM_BINARY_FORMATS 0x87FF
+#endif
+
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+ #define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+ #define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+/* First bytes of a program cache file */
+#define PROGRAM_CACHE_MAGIC 0x42504c47u
+
+/**********************************************************************
+ * Program binary cache
+ *********************************************************************/
+
+/* Linked programs saved to files in dir with glGetProgramBinary(), so the
+ * next launch loads them with glProgramBinary() instead of compiling. A
+ * file is named after a 64 bit hash of the shader sources, the vendor,
+ * renderer and version strings and the binary formats of the driver: a
+ * driver update or another GPU makes new keys instead of loading stale
+ * binaries. A binary the driver still refuses, or a damaged file, is a
+ * miss and is replaced once the program compiled.
+ *
+ * Needs OpenGL 4.1 or ARB_get_program_binary with at least one binary
+ * format, CreateShaderProgram() compiles every time otherwise.
+ */
+typedef struct ProgramCache
+{
+    int enabled;
+    char dir[256];
+    unsigned long long driver_hash;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long stores;
+} ProgramCache;
+
+/**********************************************************************
+ * Asynchronous program builds
+ *********************************************************************/
+
+typedef enum ProgramStatus
+{
+    PROGRAM_PENDING = 0,
+    PROGRAM_READY,
+    PROGRAM_FAILED
+} ProgramStatus;
+
+/* A program compiled and linked while the caller goes on, the handle
+ * returned by SubmitShaderProgram(). Submitting every program before
+ * polling any lets the driver compile them side by side: with
+ * KHR_parallel_shader_compile (or the ARB one) on its compiler threads,
+ * and PollShaderProgram() asks GL_COMPLETION_STATUS_KHR, which never
+ * waits. Without the extension the first poll waits for the build.
+ *
+ * Nothing is queried until the build completed, the logs are only read
+ * when it failed. Programs found in the program cache are ready at once.
+ */
+typedef struct ProgramBuild
+{
+    GLuint program;
+    GLuint vertex_shader;
+    GLuint fragment_shader;
+    unsigned long long key;
+    ProgramStatus status;
+} ProgramBuild;
+
+/* Function loader, e.g. glfwGetProcAddress */
+typedef void (*ShaderProc)(void);
+typedef ShaderProc (*ShaderLoadFunc)(const char* name);
+
+    static int    InitProgramCache(const char* dir, ShaderLoadFunc load);
+    static int    InitParallelShaderCompile(ShaderLoadFunc load);
     static GLuint CreateShader(GLenum type, const char* text);
     static GLuint CreateShaderProgram(const char* vs_text, const char* fs_text);    
+    static ProgramStatus SubmitShaderProgram(ProgramBuild* build, const char* vs_text, const char* fs_text);
+    static ProgramStatus PollShaderProgram(ProgramBuild* build);
+    static GLuint FinishShaderProgram(ProgramBuild* build);
 
 
 
@@ -10,6 +102,184 @@
 
 #if defined GL_UTIL_IMPLEMENTATION
     /* implementation here */
+
+    typedef void (GLAPIENTRY* ProgramCacheGetBinaryFunc)(GLuint program, GLsizei size, GLsizei* length,
+                                                         GLenum* format, void* binary);
+    typedef void (GLAPIENTRY* ProgramCacheBinaryFunc)(GLuint program, GLenum format, const void* binary,
+                                                      GLsizei length);
+    typedef void (GLAPIENTRY* ProgramCacheParameterFunc)(GLuint program, GLenum name, GLint value);
+
+    /* File header, the binary follows */
+    typedef struct ProgramCacheHeader
+    {
+        unsigned magic;
+        unsigned format;
+        unsigned long long key;
+        unsigned long long length;
+    } ProgramCacheHeader;
+
+    static ProgramCache program_cache;
+    static ProgramCacheGetBinaryFunc program_cache_get_binary = NULL;
+    static ProgramCacheBinaryFunc program_cache_binary = NULL;
+    static ProgramCacheParameterFunc program_cache_parameter = NULL;
+
+    typedef void (GLAPIENTRY* ShaderCompilerThreadsFunc)(GLuint count);
+
+    static int parallel_shader_compile = 0;
+
+    /* FNV-1a over size bytes, continuing from hash */
+    static unsigned long long ProgramCacheHash(unsigned long long hash, const void* data, size_t size)
+    {
+        const unsigned char* bytes = (const unsigned char*) data;
+        size_t ii;
+
+        for (ii = 0 ; ii < size ; ++ii)
+            hash = (hash ^ bytes[ii]) * 0x100000001b3ull;
+        return hash;
+    }
+
+    /* Hash of a string including its end, so "ab" + "c" differs from "a" + "bc" */
+    static unsigned long long ProgramCacheHashString(unsigned long long hash, const char* text)
+    {
+        return ProgramCacheHash(hash, (text != NULL) ? text : "", (text != NULL) ? strlen(text) + 1 : 1);
+    }
+
+
+    /* Cache the programs of the current context in dir, created if needed,
+     * loading glGetProgramBinary() and friends with load. Returns 1 when
+     * the driver can save binaries; without calling this, or on 0, every
+     * program is compiled.
+     */
+    static int InitProgramCache(const char* dir, ShaderLoadFunc load)
+    {
+        GLint major = 0, minor = 0, num_extensions = 0, num_formats = 0, ii;
+        GLint* formats;
+        int found;
+
+        memset(&program_cache, 0, sizeof(program_cache));
+        if (load == NULL || dir == NULL || strlen(dir) + 32 > sizeof(program_cache.dir))
+            return 0;
+
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        found = (major > 4 || (major == 4 && minor >= 1));
+        glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+        for (ii = 0 ; ii < num_extensions && !found ; ++ii)
+            found = (strcmp((const char*) glGetStringi(GL_EXTENSIONS, (GLuint) ii), "GL_ARB_get_program_binary") == 0);
+        if (!found)
+            return 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+        if (num_formats <= 0)
+            return 0;
+
+        program_cache_get_binary = (ProgramCacheGetBinaryFunc) load("glGetProgramBinary");
+        program_cache_binary = (ProgramCacheBinaryFunc) load("glProgramBinary");
+        program_cache_parameter = (ProgramCacheParameterFunc) load("glProgramParameteri");
+        if (program_cache_get_binary == NULL || program_cache_binary == NULL || program_cache_parameter == NULL)
+            return 0;
+
+        formats = (GLint*) malloc(sizeof(GLint) * (size_t) num_formats);
+        if (formats == NULL)
+            return 0;
+        glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats);
+        program_cache.driver_hash = ProgramCacheHashString(0xcbf29ce484222325ull, (const char*) glGetString(GL_VENDOR));
+        program_cache.driver_hash = ProgramCacheHashString(program_cache.driver_hash, (const char*) glGetString(GL_RENDERER));
+        program_cache.driver_hash = ProgramCacheHashString(program_cache.driver_hash, (const char*) glGetString(GL_VERSION));
+        program_cache.driver_hash = ProgramCacheHash(program_cache.driver_hash, formats, sizeof(GLint) * (size_t) num_formats);
+        free(formats);
+
+        mkdir(dir, 0755);
+        strcpy(program_cache.dir, dir);
+        program_cache.enabled = 1;
+        return 1;
+    }
+
+
+    static void ProgramCachePath(char* path, unsigned long long key, const char* suffix)
+    {
+        sprintf(path, "%s/%016llx%s", program_cache.dir, key, suffix);
+    }
+
+    /* The program saved under key, 0 if there is none or the driver rejects it */
+    static GLuint LoadCachedProgram(unsigned long long key)
+    {
+        char path[sizeof(program_cache.dir) + 32];
+        ProgramCacheHeader header;
+        GLuint program = 0u;
+        GLint program_ok = GL_FALSE;
+        void* binary = NULL;
+        FILE* file;
+
+        ProgramCachePath(path, key, ".bin");
+        file = fopen(path, "rb");
+        if (file == NULL)
+            return 0u;
+        if (fread(&header, sizeof(header), 1, file) == 1 && header.magic == PROGRAM_CACHE_MAGIC &&
+            header.key == key && header.length > 0 && header.length < (1ull << 30))
+        {
+            binary = malloc((size_t) header.length);
+            if (binary != NULL && fread(binary, (size_t) header.length, 1, file) == 1)
+            {
+                program = glCreateProgram();
+                program_cache_binary(program, (GLenum) header.format, binary, (GLsizei) header.length);
+                glGetProgramiv(program, GL_LINK_STATUS, &program_ok);
+            }
+        }
+        free(binary);
+        fclose(file);
+
+        if (program != 0u && program_ok != GL_TRUE)
+        {
+            glDeleteProgram(program);
+            program = 0u;
+        }
+        /* binary errors are not the caller's */
+        while (glGetError() != GL_NO_ERROR)
+            ;
+        return program;
+    }
+
+    /* Save the linked program under key, written to a temporary file first
+     * so other processes never read half a binary
+     */
+    static void StoreCachedProgram(GLuint program, unsigned long long key)
+    {
+        char path[sizeof(program_cache.dir) + 32];
+        char temp[sizeof(program_cache.dir) + 32];
+        ProgramCacheHeader header;
+        GLint length = 0;
+        GLenum format = 0;
+        void* binary;
+        FILE* file;
+        int ok;
+
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        binary = malloc((size_t) length);
+        if (binary == NULL)
+            return;
+        program_cache_get_binary(program, length, &length, &format, binary);
+
+        ProgramCachePath(path, key, ".bin");
+        ProgramCachePath(temp, key, ".tmp");
+        file = fopen(temp, "wb");
+        if (file != NULL)
+        {
+            header.magic = PROGRAM_CACHE_MAGIC;
+            header.format = (unsigned) format;
+            header.key = key;
+            header.length = (unsigned long long) length;
+            ok = (fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(binary, (size_t) length, 1, file) == 1);
+            ok = (fclose(file) == 0) && ok;
+            if (ok && rename(temp, path) == 0)
+                ++program_cache.stores;
+            else
+                remove(temp);
+        }
+        free(binary);
+    }
+
     /**********************************************************************
      * OpenGL helper functions
      *********************************************************************/
@@ -24,6 +294,20 @@
         GLuint fragment_shader = 0u;
         GLsizei log_length;
         char info_log[8192];
+        unsigned long long key = 0u;
+
+        /* try the binary saved by an earlier run first */
+        if (program_cache.enabled)
+        {
+            key = ProgramCacheHashString(ProgramCacheHashString(program_cache.driver_hash, vs_text), fs_text);
+            program = LoadCachedProgram(key);
+            if (program != 0u)
+            {
+                ++program_cache.hits;
+                return program;
+            }
+            ++program_cache.misses;
+        }
 
         vertex_shader = CreateShader(GL_VERTEX_SHADER, vs_text);
         if (vertex_shader != 0u)
@@ -38,6 +322,8 @@
                     /* attach both shader and link */
                     glAttachShader(program, vertex_shader);
                     glAttachShader(program, fragment_shader);
+                    if (program_cache.enabled)
+                        program_cache_parameter(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
                     
                     
                     
@@ -54,6 +340,8 @@
                         glDeleteShader(vertex_shader);
                         program = 0u;
                     }
+                    else if (program_cache.enabled)
+                        StoreCachedProgram(program, key);
                 }
             }
             else
@@ -97,4 +385,170 @@
         }
         return shader;
     }
+
+
+    /**********************************************************************
+     * Asynchronous program builds
+     *********************************************************************/
+
+    /* Let the driver compile on as many threads as it likes, loading
+     * glMaxShaderCompilerThreadsKHR() with load. Returns 1 when polls of
+     * program builds do not wait.
+     */
+    static int InitParallelShaderCompile(ShaderLoadFunc load)
+    {
+        ShaderCompilerThreadsFunc compiler_threads = NULL;
+        GLint num_extensions = 0, ii;
+        const char* name;
+
+        parallel_shader_compile = 0;
+        if (load == NULL)
+            return 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+        for (ii = 0 ; ii < num_extensions && compiler_threads == NULL ; ++ii)
+        {
+            name = (const char*) glGetStringi(GL_EXTENSIONS, (GLuint) ii);
+            if (strcmp(name, "GL_KHR_parallel_shader_compile") == 0)
+                compiler_threads = (ShaderCompilerThreadsFunc) load("glMaxShaderCompilerThreadsKHR");
+            else if (strcmp(name, "GL_ARB_parallel_shader_compile") == 0)
+                compiler_threads = (ShaderCompilerThreadsFunc) load("glMaxShaderCompilerThreadsARB");
+        }
+        if (compiler_threads == NULL)
+            return 0;
+
+        /* all ones is the maximum of the implementation */
+        compiler_threads(0xFFFFFFFFu);
+        parallel_shader_compile = 1;
+        return 1;
+    }
+
+
+    /* Start building a program from vs_text and fs_text into build, the
+     * sources may be freed once this returns. Returns PROGRAM_READY for a
+     * cached program, PROGRAM_FAILED when the GL objects could not be made.
+     */
+    static ProgramStatus SubmitShaderProgram(ProgramBuild* build, const char* vs_text, const char* fs_text)
+    {
+        memset(build, 0, sizeof(*build));
+        if (program_cache.enabled)
+        {
+            build->key = ProgramCacheHashString(ProgramCacheHashString(program_cache.driver_hash, vs_text), fs_text);
+            build->program = LoadCachedProgram(build->key);
+            if (build->program != 0u)
+            {
+                ++program_cache.hits;
+                build->status = PROGRAM_READY;
+                return build->status;
+            }
+            ++program_cache.misses;
+        }
+
+        build->vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+        build->fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+        build->program = glCreateProgram();
+        if (build->vertex_shader == 0u || build->fragment_shader == 0u || build->program == 0u)
+        {
+            fprintf(stderr, "ERROR: Unable to create shader program objects\n");
+            glDeleteShader(build->vertex_shader);
+            glDeleteShader(build->fragment_shader);
+            glDeleteProgram(build->program);
+            memset(build, 0, sizeof(*build));
+            build->status = PROGRAM_FAILED;
+            return build->status;
+        }
+
+        /* queued without asking for any status, linking waits for the
+         * compiles on the driver side
+         */
+        glShaderSource(build->vertex_shader, 1, (const GLchar**)&vs_text, NULL);
+        glCompileShader(build->vertex_shader);
+        glShaderSource(build->fragment_shader, 1, (const GLchar**)&fs_text, NULL);
+        glCompileShader(build->fragment_shader);
+        glAttachShader(build->program, build->vertex_shader);
+        glAttachShader(build->program, build->fragment_shader);
+        if (program_cache.enabled)
+            program_cache_parameter(build->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(build->program);
+        build->status = PROGRAM_PENDING;
+        return build->status;
+    }
+
+
+    /* Print the log of whichever part of a failed build failed */
+    static void PrintProgramBuildLog(const ProgramBuild* build)
+    {
+        GLint shader_ok;
+        GLsizei log_length;
+        char info_log[8192];
+
+        glGetShaderiv(build->vertex_shader, GL_COMPILE_STATUS, &shader_ok);
+        if (shader_ok != GL_TRUE)
+        {
+            fprintf(stderr, "ERROR: Failed to compile vertex shader\n");
+            glGetShaderInfoLog(build->vertex_shader, 8192, &log_length, info_log);
+        }
+        else
+        {
+            glGetShaderiv(build->fragment_shader, GL_COMPILE_STATUS, &shader_ok);
+            if (shader_ok != GL_TRUE)
+            {
+                fprintf(stderr, "ERROR: Failed to compile fragment shader\n");
+                glGetShaderInfoLog(build->fragment_shader, 8192, &log_length, info_log);
+            }
+            else
+            {
+                fprintf(stderr, "ERROR, failed to link shader program\n");
+                glGetProgramInfoLog(build->program, 8192, &log_length, info_log);
+            }
+        }
+        fprintf(stderr, "ERROR: \n%s\n\n", info_log);
+    }
+
+    /* Collect a build known to be complete, or waiting for it */
+    static ProgramStatus CompleteShaderProgram(ProgramBuild* build)
+    {
+        GLint program_ok;
+
+        glGetProgramiv(build->program, GL_LINK_STATUS, &program_ok);
+        if (program_ok == GL_TRUE)
+        {
+            if (program_cache.enabled)
+                StoreCachedProgram(build->program, build->key);
+            build->status = PROGRAM_READY;
+        }
+        else
+        {
+            PrintProgramBuildLog(build);
+            glDeleteProgram(build->program);
+            build->program = 0u;
+            build->status = PROGRAM_FAILED;
+        }
+        /* the linked program keeps its code */
+        glDeleteShader(build->vertex_shader);
+        glDeleteShader(build->fragment_shader);
+        build->vertex_shader = build->fragment_shader = 0u;
+        return build->status;
+    }
+
+
+    /* Status of a build, only waits for it without parallel compilation */
+    static ProgramStatus PollShaderProgram(ProgramBuild* build)
+    {
+        GLint done = GL_TRUE;
+
+        if (build->status != PROGRAM_PENDING)
+            return build->status;
+        if (parallel_shader_compile)
+            glGetProgramiv(build->program, GL_COMPLETION_STATUS_KHR, &done);
+        return (done == GL_TRUE) ? CompleteShaderProgram(build) : PROGRAM_PENDING;
+    }
+
+
+    /* Wait for a build, returns the program or 0 if it failed */
+    static GLuint FinishShaderProgram(ProgramBuild* build)
+    {
+        if (build->status == PROGRAM_PENDING)
+            CompleteShaderProgram(build);
+        return build->program;
+    }
 #endif
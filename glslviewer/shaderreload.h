@@ -0,0 +1,296 @@
+#ifndef GL_SHADERRELOAD_H
+#define GL_SHADERRELOAD_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+/* Milliseconds the watcher waits for more changes after one, editors
+ * often write a file in several steps
+ */
+#define SHADER_RELOAD_SETTLE_MS 50
+
+/* Milliseconds between checks for StopShaderReload() */
+#define SHADER_RELOAD_POLL_MS 100
+
+/**********************************************************************
+ * Shader hot reload
+ *********************************************************************/
+
+/* Rebuilds a program whenever its vertex or fragment shader file changes,
+ * without ever making the render loop wait for the compiler.
+ *
+ * inotify watches the directories of the files, so editors replacing a
+ * file by renaming a new one over it are seen too. A thread owning a
+ * hidden context shared with the window reads both files and builds the
+ * program there; glFinish() makes it complete before it is published
+ * with an atomic exchange. The render loop takes it with
+ * TakeReloadedProgram() between two frames and swaps it in. A program
+ * that fails to build is only reported, the previous one stays in use. A
+ * shader without a file uses its default text.
+ *
+ * Linux only. Include glutil.h first and load the GL functions before
+ * starting, they are shared with the thread.
+ */
+typedef struct ShaderReload
+{
+    const char* paths[2];
+    const char* defaults[2];
+    char* texts[2];
+    GLFWwindow* context;
+    pthread_t thread;
+    int running;
+    int inotify_fd;
+    int watches[2];
+    int quit;
+    GLuint pending;
+    unsigned long reloads;
+    unsigned long failures;
+} ShaderReload;
+
+    static char*  ReadShaderFile(const char* path);
+    static int    StartShaderReload(ShaderReload* reload, GLFWwindow* window, const char* vs_path,
+                                    const char* fs_path, const char* vs_default, const char* fs_default);
+    static void   StopShaderReload(ShaderReload* reload);
+    static GLuint TakeReloadedProgram(ShaderReload* reload);
+
+
+#endif /* GL_SHADERRELOAD_H */
+
+#if defined GL_SHADERRELOAD_IMPLEMENTATION
+    /* implementation here */
+
+    /* Whole text of the file at path, free() it. NULL if it can not be read. */
+    static char* ReadShaderFile(const char* path)
+    {
+        FILE* file = fopen(path, "rb");
+        char* text;
+        long size;
+
+        if (file == NULL)
+            return NULL;
+        fseek(file, 0, SEEK_END);
+        size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        text = (size >= 0) ? (char*) malloc((size_t) size + 1) : NULL;
+        if (text != NULL)
+        {
+            size = (long) fread(text, 1, (size_t) size, file);
+            text[size] = '\0';
+        }
+        fclose(file);
+        return text;
+    }
+
+
+    /* Watch the directory of path for files written or moved there,
+     * returns the watch descriptor or -1
+     */
+    static int WatchShaderFile(int fd, const char* path)
+    {
+        const char* slash = strrchr(path, '/');
+        char dir[1024];
+        size_t length;
+
+        if (slash == NULL)
+            return inotify_add_watch(fd, ".", IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+        length = (slash == path) ? 1u : (size_t) (slash - path);
+        if (length >= sizeof(dir))
+            return -1;
+        memcpy(dir, path, length);
+        dir[length] = '\0';
+        return inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+    }
+
+    /* Read the pending events, returns 1 if one of them is about a shader file */
+    static int ReadShaderEvents(ShaderReload* reload)
+    {
+        char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        const struct inotify_event* event;
+        const char* name;
+        ssize_t size;
+        char* at;
+        int changed = 0, ii;
+
+        while ((size = read(reload->inotify_fd, buffer, sizeof(buffer))) > 0)
+            for (at = buffer ; at < buffer + size ; at += sizeof(struct inotify_event) + event->len)
+            {
+                event = (const struct inotify_event*) at;
+                for (ii = 0 ; ii < 2 && event->len > 0 ; ++ii)
+                {
+                    if (reload->paths[ii] == NULL || event->wd != reload->watches[ii])
+                        continue;
+                    name = strrchr(reload->paths[ii], '/');
+                    name = (name != NULL) ? name + 1 : reload->paths[ii];
+                    changed |= (strcmp(event->name, name) == 0);
+                }
+            }
+        return changed;
+    }
+
+
+    /* Build the program from the files as they are now, unless their text
+     * did not change since the last build
+     */
+    static void ReloadShaderProgram(ShaderReload* reload)
+    {
+        char* texts[2];
+        GLuint program, old;
+        int ii, same = 1;
+
+        for (ii = 0 ; ii < 2 ; ++ii)
+        {
+            texts[ii] = (reload->paths[ii] != NULL) ? ReadShaderFile(reload->paths[ii]) : NULL;
+            if (reload->paths[ii] != NULL && texts[ii] == NULL)
+            {
+                /* in the middle of being replaced, the next event follows */
+                free(texts[0]);
+                return;
+            }
+            same = same && (texts[ii] == NULL || (reload->texts[ii] != NULL && strcmp(texts[ii], reload->texts[ii]) == 0));
+        }
+        if (same)
+        {
+            free(texts[0]);
+            free(texts[1]);
+            return;
+        }
+        for (ii = 0 ; ii < 2 ; ++ii)
+            if (texts[ii] != NULL)
+            {
+                free(reload->texts[ii]);
+                reload->texts[ii] = texts[ii];
+            }
+
+        program = CreateShaderProgram((reload->texts[0] != NULL) ? reload->texts[0] : reload->defaults[0],
+                                      (reload->texts[1] != NULL) ? reload->texts[1] : reload->defaults[1]);
+        if (program == 0u)
+        {
+            ++reload->failures;
+            fprintf(stderr, "ERROR: Keeping the current shader program\n");
+            return;
+        }
+        /* complete before the render context can see it */
+        glFinish();
+        old = __atomic_exchange_n(&reload->pending, program, __ATOMIC_ACQ_REL);
+        if (old != 0u)
+            glDeleteProgram(old);
+        ++reload->reloads;
+    }
+
+    static void* ShaderReloadThread(void* arg)
+    {
+        ShaderReload* reload = (ShaderReload*) arg;
+        struct pollfd watch;
+
+        glfwMakeContextCurrent(reload->context);
+        watch.fd = reload->inotify_fd;
+        watch.events = POLLIN;
+        while (!__atomic_load_n(&reload->quit, __ATOMIC_ACQUIRE))
+        {
+            if (poll(&watch, 1, SHADER_RELOAD_POLL_MS) <= 0 || !ReadShaderEvents(reload))
+                continue;
+            while (poll(&watch, 1, SHADER_RELOAD_SETTLE_MS) > 0)
+                ReadShaderEvents(reload);
+            ReloadShaderProgram(reload);
+        }
+        glfwMakeContextCurrent(NULL);
+        return NULL;
+    }
+
+
+    /* Watch the shader files at vs_path and fs_path, either may be NULL to
+     * keep its default text, and rebuild the program of window when they
+     * change. Call from the thread of window with its context current.
+     * Returns 0 if there is nothing to watch or the watch could not start.
+     */
+    static int StartShaderReload(ShaderReload* reload, GLFWwindow* window, const char* vs_path,
+                                 const char* fs_path, const char* vs_default, const char* fs_default)
+    {
+        int ii;
+
+        memset(reload, 0, sizeof(*reload));
+        reload->paths[0] = vs_path;
+        reload->paths[1] = fs_path;
+        reload->defaults[0] = vs_default;
+        reload->defaults[1] = fs_default;
+        reload->watches[0] = reload->watches[1] = -1;
+        reload->inotify_fd = -1;
+        if (vs_path == NULL && fs_path == NULL)
+            return 0;
+
+        reload->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (reload->inotify_fd < 0)
+        {
+            fprintf(stderr, "ERROR: Unable to watch the shader files\n");
+            return 0;
+        }
+        for (ii = 0 ; ii < 2 ; ++ii)
+        {
+            if (reload->paths[ii] == NULL)
+                continue;
+            reload->watches[ii] = WatchShaderFile(reload->inotify_fd, reload->paths[ii]);
+            if (reload->watches[ii] < 0)
+                fprintf(stderr, "ERROR: Unable to watch %s\n", reload->paths[ii]);
+            /* what the caller built from, the first change is compared to it */
+            reload->texts[ii] = ReadShaderFile(reload->paths[ii]);
+        }
+
+        /* same hints as the window, but never shown */
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        reload->context = glfwCreateWindow(1, 1, "shader reload", NULL, window);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+        if (reload->context == NULL)
+        {
+            fprintf(stderr, "ERROR: Unable to create the shader reload context\n");
+            StopShaderReload(reload);
+            return 0;
+        }
+        if (pthread_create(&reload->thread, NULL, ShaderReloadThread, reload) != 0)
+        {
+            StopShaderReload(reload);
+            return 0;
+        }
+        reload->running = 1;
+        return 1;
+    }
+
+
+    /* Stop watching, from the thread that started. A program built but not
+     * taken yet is deleted.
+     */
+    static void StopShaderReload(ShaderReload* reload)
+    {
+        if (reload->running)
+        {
+            __atomic_store_n(&reload->quit, 1, __ATOMIC_RELEASE);
+            pthread_join(reload->thread, NULL);
+        }
+        if (reload->context != NULL)
+            glfwDestroyWindow(reload->context);
+        if (reload->inotify_fd >= 0)
+            close(reload->inotify_fd);
+        if (reload->pending != 0u)
+            glDeleteProgram(reload->pending);
+        free(reload->texts[0]);
+        free(reload->texts[1]);
+        memset(reload, 0, sizeof(*reload));
+    }
+
+
+    /* The program rebuilt since the last call or 0, never waits. Call
+     * between two frames; the caller owns the program and deletes the one
+     * it replaces.
+     */
+    static GLuint TakeReloadedProgram(ShaderReload* reload)
+    {
+        if (__atomic_load_n(&reload->pending, __ATOMIC_RELAXED) == 0u)
+            return 0u;
+        return __atomic_exchange_n(&reload->pending, 0u, __ATOMIC_ACQ_REL);
+    }
+
+#endif
@@ -0,0 +1,345 @@
+#ifndef GL_UNIFORMCACHE_H
+#define GL_UNIFORMCACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef GL_DOUBLE_VEC2
+ #define GL_DOUBLE_VEC2 0x8FFC
+#endif
+#ifndef GL_DOUBLE_VEC3
+ #define GL_DOUBLE_VEC3 0x8FFD
+#endif
+#ifndef GL_DOUBLE_VEC4
+ #define GL_DOUBLE_VEC4 0x8FFE
+#endif
+#ifndef GL_DOUBLE_MAT2
+ #define GL_DOUBLE_MAT2 0x8F46
+#endif
+#ifndef GL_DOUBLE_MAT3
+ #define GL_DOUBLE_MAT3 0x8F47
+#endif
+#ifndef GL_DOUBLE_MAT4
+ #define GL_DOUBLE_MAT4 0x8F48
+#endif
+
+/**********************************************************************
+ * Uniform reflection and upload cache
+ *********************************************************************/
+
+/* One active uniform of a program, arrays are one entry at the location
+ * of their first element with the "[0]" dropped from the name. valid is
+ * the number of leading elements whose value is known.
+ */
+typedef struct UniformInfo
+{
+    const char* name;
+    GLint location;
+    GLenum type;
+    GLint size;
+    int words;
+    int offset;
+    int valid;
+} UniformInfo;
+
+/* The active uniforms of a linked program, enumerated once with
+ * glGetActiveUniform(), and the last value uploaded to each of them.
+ *
+ * SetUniform() compares the value with the one last uploaded to the
+ * location and only calls glUniform*() when it differs, the call the type
+ * of the uniform needs is picked from the table. Every call counts as
+ * issued or skipped. The program must be current, like for glUniform*(),
+ * and its uniforms only set through the table: a value set some other way
+ * is not seen. Uniforms in blocks have no location and are left out.
+ */
+typedef struct UniformTable
+{
+    GLuint program;
+    int count;
+    UniformInfo* uniforms;
+    GLint max_location;
+    int* slots;
+    int* elements;
+    GLuint* values;
+    char* names;
+    unsigned long issued;
+    unsigned long skipped;
+} UniformTable;
+
+    static int   CreateUniformTable(UniformTable* table, GLuint program);
+    static void  DeleteUniformTable(UniformTable* table);
+    static GLint FindUniform(const UniformTable* table, const char* name);
+    static int   SetUniform(UniformTable* table, GLint location, const void* value, GLsizei count);
+    static void  ForgetUniformValues(UniformTable* table);
+
+
+#endif /* GL_UNIFORMCACHE_H */
+
+#if defined GL_UNIFORMCACHE_IMPLEMENTATION
+    /* implementation here */
+
+    /* 32 bit words of one value of type, 0 for the types not cached */
+    static int UniformTypeWords(GLenum type)
+    {
+        switch (type)
+        {
+            case GL_FLOAT_VEC2: case GL_INT_VEC2: case GL_UNSIGNED_INT_VEC2: case GL_BOOL_VEC2:
+                return 2;
+            case GL_FLOAT_VEC3: case GL_INT_VEC3: case GL_UNSIGNED_INT_VEC3: case GL_BOOL_VEC3:
+                return 3;
+            case GL_FLOAT_VEC4: case GL_INT_VEC4: case GL_UNSIGNED_INT_VEC4: case GL_BOOL_VEC4:
+            case GL_FLOAT_MAT2:
+                return 4;
+            case GL_FLOAT_MAT2x3: case GL_FLOAT_MAT3x2:
+                return 6;
+            case GL_FLOAT_MAT2x4: case GL_FLOAT_MAT4x2:
+                return 8;
+            case GL_FLOAT_MAT3:
+                return 9;
+            case GL_FLOAT_MAT3x4: case GL_FLOAT_MAT4x3:
+                return 12;
+            case GL_FLOAT_MAT4:
+                return 16;
+            case GL_DOUBLE: case GL_DOUBLE_VEC2: case GL_DOUBLE_VEC3: case GL_DOUBLE_VEC4:
+            case GL_DOUBLE_MAT2: case GL_DOUBLE_MAT3: case GL_DOUBLE_MAT4:
+                return 0;
+            default:
+                /* scalars, samplers and images */
+                return 1;
+        }
+    }
+
+    /* Enumerate the active uniforms of program, which must be linked.
+     * Every element of an array has its own location, they are looked up
+     * as "name[k]" and all lead to the entry of the array.
+     * Returns 0 if it can not be allocated.
+     */
+    static int CreateUniformTable(UniformTable* table, GLuint program)
+    {
+        GLint num_active = 0, name_length = 0, size, location;
+        GLint* locations = NULL;
+        GLenum type;
+        GLsizei length;
+        UniformInfo* info;
+        char* name;
+        char* element_name = NULL;
+        size_t names_size = 0;
+        int words = 0, elements = 0, ii, kk, ee;
+
+        memset(table, 0, sizeof(*table));
+        table->program = program;
+        table->max_location = -1;
+        glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &num_active);
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &name_length);
+        if (num_active <= 0)
+            return 1;
+
+        table->uniforms = (UniformInfo*) calloc((size_t) num_active, sizeof(UniformInfo));
+        table->names = (char*) malloc((size_t) num_active * (size_t) (name_length + 1));
+        if (table->uniforms == NULL || table->names == NULL)
+        {
+            fprintf(stderr, "ERROR: Unable to allocate the uniform table\n");
+            DeleteUniformTable(table);
+            return 0;
+        }
+
+        for (ii = 0 ; ii < num_active ; ++ii)
+        {
+            name = table->names + names_size;
+            glGetActiveUniform(program, (GLuint) ii, name_length + 1, &length, &size, &type, name);
+            location = glGetUniformLocation(program, name);
+            if (location < 0 || UniformTypeWords(type) == 0)
+                continue;
+            if (length > 3 && strcmp(name + length - 3, "[0]") == 0)
+                name[length -= 3] = '\0';
+
+            info = &table->uniforms[table->count++];
+            info->name = name;
+            info->location = location;
+            info->type = type;
+            info->size = size;
+            info->words = UniformTypeWords(type);
+            info->offset = words;
+            words += info->words * size;
+            elements += size;
+            names_size += (size_t) length + 1;
+        }
+        if (table->count == 0)
+            return 1;
+
+        /* the elements of an array need not have consecutive locations */
+        locations = (GLint*) malloc(sizeof(GLint) * (size_t) elements);
+        element_name = (char*) malloc((size_t) name_length + 16);
+        if (locations == NULL || element_name == NULL)
+        {
+            fprintf(stderr, "ERROR: Unable to allocate the uniform table\n");
+            free(locations);
+            free(element_name);
+            DeleteUniformTable(table);
+            return 0;
+        }
+        for (ii = 0, ee = 0 ; ii < table->count ; ++ii)
+        {
+            info = &table->uniforms[ii];
+            for (kk = 0 ; kk < info->size ; ++kk, ++ee)
+            {
+                if (kk == 0)
+                    locations[ee] = info->location;
+                else
+                {
+                    sprintf(element_name, "%s[%d]", info->name, kk);
+                    locations[ee] = glGetUniformLocation(program, element_name);
+                }
+                if (locations[ee] > table->max_location)
+                    table->max_location = locations[ee];
+            }
+        }
+        free(element_name);
+
+        table->slots = (int*) malloc(sizeof(int) * (size_t) (table->max_location + 1));
+        table->elements = (int*) malloc(sizeof(int) * (size_t) (table->max_location + 1));
+        table->values = (GLuint*) malloc(sizeof(GLuint) * (size_t) (words + 1));
+        if (table->slots == NULL || table->elements == NULL || table->values == NULL)
+        {
+            fprintf(stderr, "ERROR: Unable to allocate the uniform table\n");
+            free(locations);
+            DeleteUniformTable(table);
+            return 0;
+        }
+        for (ii = 0 ; ii <= table->max_location ; ++ii)
+            table->slots[ii] = -1;
+        for (ii = 0, ee = 0 ; ii < table->count ; ++ii)
+            for (kk = 0 ; kk < table->uniforms[ii].size ; ++kk, ++ee)
+                if (locations[ee] >= 0)
+                {
+                    table->slots[locations[ee]] = ii;
+                    table->elements[locations[ee]] = kk;
+                }
+        free(locations);
+        return 1;
+    }
+
+    static void DeleteUniformTable(UniformTable* table)
+    {
+        free(table->uniforms);
+        free(table->slots);
+        free(table->elements);
+        free(table->values);
+        free(table->names);
+        memset(table, 0, sizeof(*table));
+        table->max_location = -1;
+    }
+
+
+    /* Location of the uniform called name, -1 if the program has no such
+     * active uniform. A lookup by string, call it once and keep the result.
+     */
+    static GLint FindUniform(const UniformTable* table, const char* name)
+    {
+        size_t length = strlen(name);
+        int ii;
+
+        /* "array[0]" is stored as "array" */
+        if (length > 3 && strcmp(name + length - 3, "[0]") == 0)
+            length -= 3;
+        for (ii = 0 ; ii < table->count ; ++ii)
+            if (strncmp(table->uniforms[ii].name, name, length) == 0 && table->uniforms[ii].name[length] == '\0')
+                return table->uniforms[ii].location;
+        return -1;
+    }
+
+
+    static void UploadUniform(const UniformInfo* info, GLint location, const void* value, GLsizei count)
+    {
+        const GLfloat* f = (const GLfloat*) value;
+        const GLint* i = (const GLint*) value;
+        const GLuint* u = (const GLuint*) value;
+
+        switch (info->type)
+        {
+            case GL_FLOAT:          glUniform1fv(location, count, f); break;
+            case GL_FLOAT_VEC2:     glUniform2fv(location, count, f); break;
+            case GL_FLOAT_VEC3:     glUniform3fv(location, count, f); break;
+            case GL_FLOAT_VEC4:     glUniform4fv(location, count, f); break;
+            case GL_FLOAT_MAT2:     glUniformMatrix2fv(location, count, GL_FALSE, f); break;
+            case GL_FLOAT_MAT3:     glUniformMatrix3fv(location, count, GL_FALSE, f); break;
+            case GL_FLOAT_MAT4:     glUniformMatrix4fv(location, count, GL_FALSE, f); break;
+            case GL_FLOAT_MAT2x3:   glUniformMatrix2x3fv(location, count, GL_FALSE, f); break;
+            case GL_FLOAT_MAT3x2:   glUniformMatrix3x2fv(location, count, GL_FALSE, f); break;
+            case GL_FLOAT_MAT2x4:   glUniformMatrix2x4fv(location, count, GL_FALSE, f); break;
+            case GL_FLOAT_MAT4x2:   glUniformMatrix4x2fv(location, count, GL_FALSE, f); break;
+            case GL_FLOAT_MAT3x4:   glUniformMatrix3x4fv(location, count, GL_FALSE, f); break;
+            case GL_FLOAT_MAT4x3:   glUniformMatrix4x3fv(location, count, GL_FALSE, f); break;
+            case GL_INT_VEC2: case GL_BOOL_VEC2:
+                glUniform2iv(location, count, i); break;
+            case GL_INT_VEC3: case GL_BOOL_VEC3:
+                glUniform3iv(location, count, i); break;
+            case GL_INT_VEC4: case GL_BOOL_VEC4:
+                glUniform4iv(location, count, i); break;
+            case GL_UNSIGNED_INT:      glUniform1uiv(location, count, u); break;
+            case GL_UNSIGNED_INT_VEC2: glUniform2uiv(location, count, u); break;
+            case GL_UNSIGNED_INT_VEC3: glUniform3uiv(location, count, u); break;
+            case GL_UNSIGNED_INT_VEC4: glUniform4uiv(location, count, u); break;
+            default:
+                /* int, bool, samplers and images */
+                glUniform1iv(location, count, i);
+                break;
+        }
+    }
+
+    /* Upload count values to the uniform at location, unless they are the
+     * values uploaded last. Float uniforms take GLfloat values, matrices
+     * column major, integer and boolean ones GLint and unsigned ones GLuint.
+     * The location of an array element sets the array from that element
+     * on, like glUniform*() does. -1 is ignored like by glUniform*(), any
+     * other location not in the table is an error, e.g. a double uniform.
+     * Returns 1 if glUniform*() was called.
+     */
+    static int SetUniform(UniformTable* table, GLint location, const void* value, GLsizei count)
+    {
+        UniformInfo* info;
+        GLuint* cached;
+        size_t bytes;
+        int element;
+
+        if (location == -1)
+            return 0;
+        if (location < 0 || location > table->max_location || table->slots[location] < 0)
+        {
+            fprintf(stderr, "ERROR: Uniform location %d is not in the table of program %u\n", location, table->program);
+            return 0;
+        }
+        info = &table->uniforms[table->slots[location]];
+        element = table->elements[location];
+        if (count > info->size - element)
+            count = info->size - element;
+        cached = table->values + info->offset + info->words * element;
+        bytes = sizeof(GLuint) * (size_t) (info->words * count);
+        /* a shorter upload than the last one leaves the rest as it was */
+        if (info->valid >= element + count && memcmp(cached, value, bytes) == 0)
+        {
+            ++table->skipped;
+            return 0;
+        }
+        memcpy(cached, value, bytes);
+        /* elements behind a gap stay unknown, they are uploaded again */
+        if (info->valid >= element && info->valid < element + count)
+            info->valid = element + count;
+        UploadUniform(info, location, value, count);
+        ++table->issued;
+        return 1;
+    }
+
+    /* Upload the next value of every uniform again, e.g. after the program
+     * was relinked or its uniforms were set around the table
+     */
+    static void ForgetUniformValues(UniformTable* table)
+    {
+        int ii;
+
+        for (ii = 0 ; ii < table->count ; ++ii)
+            table->uniforms[ii].valid = 0;
+    }
+
+#endif
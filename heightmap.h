@@ -20,10 +20,12 @@
  * Default shader programs
  *********************************************************************/
 
+/* project, modelview, uResolution and uTime come from the FrameUniforms
+ * block, include frameuniforms.h first
+ */
 static const char* vertex_shader_text =
 "#version 150\n"
-"uniform mat4 project;\n"
-"uniform mat4 modelview;\n"
+FRAME_UNIFORMS_GLSL
 "in float x;\n"
 "in float y;\n"
 "in float z;\n"
@@ -35,8 +37,7 @@ static const char* vertex_shader_text =
 
 static const char* fragment_shader_text =
 "#version 150\n"
-"uniform vec2 uResolution;\n"
-"uniform float uTime;\n"
+FRAME_UNIFORMS_GLSL
 "out vec4 color;\n"
 "void main()\n"
 "{\n"
@@ -53,6 +54,10 @@ static const char* fragment_shader_text =
  *********************************************************************/
 
 static GLfloat map_vertices[3][MAP_NUM_TOTAL_VERTICES];
+/* Heights before the last UpdateMap() */
+static GLfloat map_prev_heights[MAP_NUM_TOTAL_VERTICES];
+/* Heights last streamed to the mesh, the surface on screen */
+static GLfloat map_surface_heights[MAP_NUM_TOTAL_VERTICES];
 static GLuint  map_line_indices[2*MAP_NUM_LINES];
 
 /* Store uniform location for the shaders
@@ -61,14 +66,19 @@ static GLuint  map_line_indices[2*MAP_NUM_LINES];
  * the program.
  */
 static GLuint mesh;
-static GLuint mesh_vbo[4];
+/* x, z and the line indices, the heights are streamed */
+static GLuint mesh_vbo[3];
+/* The heights are streamed, see streambuf.h */
+static StreamBuffer mesh_heights;
+static GLuint mesh_heights_attrloc;
 
     static void UpdateMap(int num_iter);
     static void GenerateHeightmapCircle(float* center_x, float* center_y,
             float* size, float* displacement);
     static void InitMap(void);
     static void UpdateMesh(void);
-    static void CreateMesh(GLuint program);
+    static void UpdateMeshLerp(float alpha);
+    static int  CreateMesh(GLuint program);
 
 
 #endif /* GL_HEIGHTMAP_H */
@@ -86,7 +96,10 @@ static GLuint mesh_vbo[4];
      * heightmap
      */
     static void UpdateMap(int num_iter) {
+        size_t kk;
         assert(num_iter > 0);
+        for (kk = 0u ; kk < MAP_NUM_TOTAL_VERTICES ; ++kk)
+            map_prev_heights[kk] = map_vertices[1][kk];
         while(num_iter)
         {
             /* center of the circle */
@@ -213,46 +226,89 @@ static GLuint mesh_vbo[4];
         *displacement = (sign * (MAX_DISPLACEMENT * rand())) / (float) RAND_MAX;
     }
     
+    /* Write the heights alpha of the way from prev to the current ones, or
+     * just the current ones when prev is NULL, into map_surface_heights and
+     * the stream buffer and point the y attribute at them. Leaves the mesh
+     * VAO bound.
+     */
+    static void StreamMeshHeights(const GLfloat* prev, float alpha)
+    {
+        GLfloat* heights;
+        GLintptr offset;
+        size_t ii;
+
+        if (prev == NULL)
+            memcpy(map_surface_heights, &map_vertices[1][0], sizeof(GLfloat) * MAP_NUM_TOTAL_VERTICES);
+        else
+        {
+            for (ii = 0u ; ii < MAP_NUM_TOTAL_VERTICES ; ++ii)
+                map_surface_heights[ii] = prev[ii] + (map_vertices[1][ii] - prev[ii]) * alpha;
+        }
+
+        heights = (GLfloat*) MapStreamBuffer(&mesh_heights, sizeof(GLfloat) * MAP_NUM_TOTAL_VERTICES, &offset);
+        if (heights == NULL)
+            return;
+        memcpy(heights, map_surface_heights, sizeof(GLfloat) * MAP_NUM_TOTAL_VERTICES);
+        UnmapStreamBuffer(&mesh_heights);
+
+        StateBindVertexArray(mesh);
+        StateBindBuffer(GL_ARRAY_BUFFER, mesh_heights.buffer);
+        glVertexAttribPointer(mesh_heights_attrloc, 1, GL_FLOAT, GL_FALSE, 0, (void*) offset);
+    }
+
     /* Update VBO vertices from source data
      */
     static void UpdateMesh(void)
     {
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLfloat) * MAP_NUM_TOTAL_VERTICES, &map_vertices[1][0]);
+        StreamMeshHeights(NULL, 1.0f);
+    }
+
+    /* Update VBO vertices with the heights alpha of the way from before the
+     * last UpdateMap() to now, e.g. alpha of a SimClock
+     */
+    static void UpdateMeshLerp(float alpha)
+    {
+        StreamMeshHeights(map_prev_heights, alpha);
     }
 
     
     /* Create VBO, IBO and VAO objects for the heightmap geometry and bind them to
-     * the specified program object
+     * the specified program object. Returns 0 if the height stream buffer can
+     * not be created.
      */
-    static void CreateMesh(GLuint program)
+    static int CreateMesh(GLuint program)
     {
         GLuint attrloc;
 
         glGenVertexArrays(1, &mesh);
-        glGenBuffers(4, mesh_vbo);
-        glBindVertexArray(mesh);
+        glGenBuffers(3, mesh_vbo);
+        StateBindVertexArray(mesh);
         /* Prepare the data for drawing through a buffer inidices */
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh_vbo[3]);
+        StateBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh_vbo[2]);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint)* MAP_NUM_LINES * 2, map_line_indices, GL_STATIC_DRAW);
 
         /* Prepare the attributes for rendering */
         attrloc = glGetAttribLocation(program, "x");
-        glBindBuffer(GL_ARRAY_BUFFER, mesh_vbo[0]);
+        StateBindBuffer(GL_ARRAY_BUFFER, mesh_vbo[0]);
         glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * MAP_NUM_TOTAL_VERTICES, &map_vertices[0][0], GL_STATIC_DRAW);
         glEnableVertexAttribArray(attrloc);
         glVertexAttribPointer(attrloc, 1, GL_FLOAT, GL_FALSE, 0, 0);
 
         attrloc = glGetAttribLocation(program, "z");
-        glBindBuffer(GL_ARRAY_BUFFER, mesh_vbo[2]);
+        StateBindBuffer(GL_ARRAY_BUFFER, mesh_vbo[1]);
         glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * MAP_NUM_TOTAL_VERTICES, &map_vertices[2][0], GL_STATIC_DRAW);
         glEnableVertexAttribArray(attrloc);
         glVertexAttribPointer(attrloc, 1, GL_FLOAT, GL_FALSE, 0, 0);
 
-        attrloc = glGetAttribLocation(program, "y");
-        glBindBuffer(GL_ARRAY_BUFFER, mesh_vbo[1]);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * MAP_NUM_TOTAL_VERTICES, &map_vertices[1][0], GL_DYNAMIC_DRAW);
-        glEnableVertexAttribArray(attrloc);
-        glVertexAttribPointer(attrloc, 1, GL_FLOAT, GL_FALSE, 0, 0);
+        mesh_heights_attrloc = glGetAttribLocation(program, "y");
+        if (!CreateStreamBuffer(&mesh_heights, GL_ARRAY_BUFFER, sizeof(GLfloat) * MAP_NUM_TOTAL_VERTICES))
+        {
+            fprintf(stderr, "ERROR: Unable to create the height stream buffer\n");
+            return 0;
+        }
+        glEnableVertexAttribArray(mesh_heights_attrloc);
+        UpdateMesh();
+        return 1;
     }
 
 #endif
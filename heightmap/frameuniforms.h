@@ -0,0 +1,179 @@
+#ifndef GL_FRAMEUNIFORMS_H
+#define GL_FRAMEUNIFORMS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Uniform buffer binding point of the FrameUniforms block */
+#define FRAME_UNIFORMS_BINDING 0
+
+/* The uniform block shared by all programs, std140 so the layout is the
+ * one of FrameUniformData. Without an instance name its members are used
+ * like plain uniforms. Embedded shaders paste it after their #version
+ * line, shader files say FRAME_UNIFORMS_INCLUDE instead.
+ */
+#define FRAME_UNIFORMS_GLSL \
+"layout(std140) uniform FrameUniforms\n" \
+"{\n" \
+"    mat4 project;\n" \
+"    mat4 modelview;\n" \
+"    mat4 mvp;\n" \
+"    vec2 uResolution;\n" \
+"    float uTime;\n" \
+"};\n"
+
+#define FRAME_UNIFORMS_INCLUDE "#include \"frame_uniforms.glsl\""
+
+/**********************************************************************
+ * Per frame uniform buffer
+ *********************************************************************/
+
+/* The FrameUniforms block as laid out by std140, matrices column major */
+typedef struct FrameUniformData
+{
+    GLfloat project[16];
+    GLfloat modelview[16];
+    GLfloat mvp[16];
+    GLfloat resolution[2];
+    GLfloat time;
+    GLfloat pad;
+} FrameUniformData;
+
+/* The values every program reads each frame, written once per frame into
+ * a uniform buffer bound to FRAME_UNIFORMS_BINDING instead of being sent
+ * to each program with glUniform*(). Programs opt in by declaring the
+ * block and calling BindFrameUniforms() once after linking, the cost of a
+ * frame does not grow with their number.
+ *
+ * The buffer is a stream buffer (streambuf.h), so a frame writes into a
+ * region the GPU is not reading. Set data, then WriteFrameUniforms()
+ * before the draws of the frame.
+ */
+typedef struct FrameUniforms
+{
+    FrameUniformData data;
+    StreamBuffer stream;
+    unsigned long writes;
+} FrameUniforms;
+
+    static int   CreateFrameUniforms(FrameUniforms* frame);
+    static void  DeleteFrameUniforms(FrameUniforms* frame);
+    static void  WriteFrameUniforms(FrameUniforms* frame);
+    static int   BindFrameUniforms(GLuint program);
+    static char* IncludeFrameUniforms(const char* text);
+
+
+#endif /* GL_FRAMEUNIFORMS_H */
+
+#if defined GL_FRAMEUNIFORMS_IMPLEMENTATION
+    /* implementation here */
+
+    /* Create the buffer, data starts with identity matrices. Call
+     * InitStreamBuffers() before. Returns 0 on failure.
+     */
+    static int CreateFrameUniforms(FrameUniforms* frame)
+    {
+        GLint align = 0;
+        GLsizeiptr size = (GLsizeiptr) sizeof(FrameUniformData);
+        int ii;
+
+        memset(frame, 0, sizeof(*frame));
+        for (ii = 0 ; ii < 4 ; ++ii)
+            frame->data.project[ii * 5] = frame->data.modelview[ii * 5] = frame->data.mvp[ii * 5] = 1.0f;
+
+        /* every region must start where a range can be bound */
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+        if (align > 0)
+            size = (size + align - 1) / align * align;
+        if (!CreateStreamBuffer(&frame->stream, GL_UNIFORM_BUFFER, size))
+        {
+            fprintf(stderr, "ERROR: Unable to create the frame uniform buffer\n");
+            return 0;
+        }
+        return 1;
+    }
+
+    static void DeleteFrameUniforms(FrameUniforms* frame)
+    {
+        DeleteStreamBuffer(&frame->stream);
+        memset(frame, 0, sizeof(*frame));
+    }
+
+
+    /* Compute mvp = project * modelview, copy data to the next region of
+     * the buffer and bind that to FRAME_UNIFORMS_BINDING
+     */
+    static void WriteFrameUniforms(FrameUniforms* frame)
+    {
+        FrameUniformData* data = &frame->data;
+        GLintptr offset;
+        void* mapped;
+        int row, col, kk;
+
+        for (col = 0 ; col < 4 ; ++col)
+            for (row = 0 ; row < 4 ; ++row)
+            {
+                data->mvp[col * 4 + row] = 0.0f;
+                for (kk = 0 ; kk < 4 ; ++kk)
+                    data->mvp[col * 4 + row] += data->project[kk * 4 + row] * data->modelview[col * 4 + kk];
+            }
+
+        mapped = MapStreamBuffer(&frame->stream, (GLsizeiptr) sizeof(*data), &offset);
+        if (mapped == NULL)
+            return;
+        memcpy(mapped, data, sizeof(*data));
+        UnmapStreamBuffer(&frame->stream);
+        StateBindBufferRange(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, frame->stream.buffer,
+                             offset, (GLsizeiptr) sizeof(*data));
+        ++frame->writes;
+    }
+
+
+    /* Read the FrameUniforms block of program from FRAME_UNIFORMS_BINDING,
+     * also after it was loaded from the program cache. Returns 0 if the
+     * program does not declare the block.
+     */
+    static int BindFrameUniforms(GLuint program)
+    {
+        GLuint index = glGetUniformBlockIndex(program, "FrameUniforms");
+
+        if (index == GL_INVALID_INDEX)
+            return 0;
+        glUniformBlockBinding(program, index, FRAME_UNIFORMS_BINDING);
+        return 1;
+    }
+
+
+    /* Copy of the shader text with the FRAME_UNIFORMS_INCLUDE line replaced
+     * by the block, free() it. NULL if it can not be allocated.
+     */
+    static char* IncludeFrameUniforms(const char* text)
+    {
+        const char* include = strstr(text, FRAME_UNIFORMS_INCLUDE);
+        const size_t block_length = strlen(FRAME_UNIFORMS_GLSL);
+        const size_t include_length = strlen(FRAME_UNIFORMS_INCLUDE);
+        size_t length = strlen(text), before;
+        char* expanded;
+
+        expanded = (char*) malloc(length + ((include != NULL) ? block_length : 0) + 1);
+        if (expanded == NULL)
+            return NULL;
+        if (include == NULL)
+        {
+            memcpy(expanded, text, length + 1);
+            return expanded;
+        }
+
+        /* the block ends with a newline, so does the include line */
+        before = (size_t) (include - text);
+        memcpy(expanded, text, before);
+        memcpy(expanded + before, FRAME_UNIFORMS_GLSL, block_length);
+        include += include_length;
+        if (*include == '\n')
+            ++include;
+        memcpy(expanded + before + block_length, include, length - (size_t) (include - text) + 1);
+        return expanded;
+    }
+
+#endif
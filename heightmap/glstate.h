@@ -0,0 +1,285 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <stdio.h>
+#include <string.h>
+
+/* Texture units whose bindings are tracked, binds to higher units are
+ * always issued
+ */
+#define GLSTATE_TEXTURE_UNITS 8
+
+/* Buffer and texture targets tracked, in GLStateCache order */
+#define GLSTATE_BUFFER_TARGETS 4
+#define GLSTATE_TEXTURE_TARGETS 5
+
+/* A binding or setting not known, e.g. after InvalidateGLState() */
+#define GLSTATE_UNKNOWN 0xFFFFFFFFu
+
+/**********************************************************************
+ * GL state cache
+ *********************************************************************/
+
+typedef enum GLStateKind
+{
+    GLSTATE_PROGRAM = 0,
+    GLSTATE_VERTEX_ARRAY,
+    GLSTATE_BUFFER,
+    GLSTATE_TEXTURE,
+    GLSTATE_BLEND,
+    GLSTATE_DEPTH,
+    GLSTATE_KINDS
+} GLStateKind;
+
+/* The program, vertex array, buffer and texture bindings and the blend
+ * and depth settings last set through the State*() functions, which only
+ * call GL when the value changes. calls counts the GL calls issued and
+ * redundant the ones dropped, per GLStateKind. gl_state can be read
+ * instead of querying GL, GLSTATE_UNKNOWN where the value is not known.
+ *
+ * Every change of these bindings and settings in the context has to go
+ * through the cache, so the helpers of this repository (streambuf.h,
+ * particlegl.h, ...) use it and need glstate.h included first. Code that
+ * changes them behind its back, e.g. rlgl drawing its batch in
+ * rlDrawRenderBatchActive(), must be followed by InvalidateGLState().
+ * Objects bound in the cache are deleted with StateDelete*(), their
+ * names may be reused. Call InvalidateGLState() once the context is
+ * current, before the first State*() call. One context only.
+ */
+typedef struct GLStateCache
+{
+    GLuint program;
+    GLuint vertex_array;
+    GLuint buffers[GLSTATE_BUFFER_TARGETS];
+    GLuint active_unit;
+    GLuint textures[GLSTATE_TEXTURE_UNITS][GLSTATE_TEXTURE_TARGETS];
+    GLuint blend;
+    GLuint depth_test;
+    GLuint depth_mask;
+    GLuint blend_func[4];
+    unsigned long calls[GLSTATE_KINDS];
+    unsigned long redundant[GLSTATE_KINDS];
+} GLStateCache;
+
+    static void InvalidateGLState(void);
+    static void StateUseProgram(GLuint program);
+    static void StateBindVertexArray(GLuint vertex_array);
+    static void StateBindBuffer(GLenum target, GLuint buffer);
+    static void StateBindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+    static void StateBindTexture(GLuint unit, GLenum target, GLuint texture);
+    static void StateEnable(GLenum cap, GLboolean enable);
+    static void StateBlendFunc(GLenum src, GLenum dst);
+    static void StateBlendFuncSeparate(GLenum src_rgb, GLenum dst_rgb, GLenum src_alpha, GLenum dst_alpha);
+    static void StateDepthMask(GLboolean flag);
+    static void StateDeleteBuffers(GLsizei count, const GLuint* buffers);
+    static void StateDeleteVertexArrays(GLsizei count, const GLuint* vertex_arrays);
+    static void StateDeleteTextures(GLsizei count, const GLuint* textures);
+    static void PrintGLStateStats(void);
+
+
+#endif /* GL_STATE_H */
+
+#if defined GL_STATE_IMPLEMENTATION
+    /* implementation here */
+
+    static GLStateCache gl_state;
+
+    static const char* gl_state_kinds[GLSTATE_KINDS] = {
+        "program", "vertex array", "buffer", "texture", "blend", "depth"
+    };
+
+    /* Forget every binding and setting, the next State*() call of each
+     * is issued. The counters are kept.
+     */
+    static void InvalidateGLState(void)
+    {
+        unsigned long calls[GLSTATE_KINDS], redundant[GLSTATE_KINDS];
+
+        memcpy(calls, gl_state.calls, sizeof(calls));
+        memcpy(redundant, gl_state.redundant, sizeof(redundant));
+        memset(&gl_state, 0xFF, sizeof(gl_state));
+        memcpy(gl_state.calls, calls, sizeof(calls));
+        memcpy(gl_state.redundant, redundant, sizeof(redundant));
+    }
+
+    /* Count a call of kind, returns 1 if it must be issued because value
+     * is not the one cached, which is then replaced
+     */
+    static int StateChange(GLStateKind kind, GLuint* cached, GLuint value)
+    {
+        if (*cached == value)
+        {
+            ++gl_state.redundant[kind];
+            return 0;
+        }
+        *cached = value;
+        ++gl_state.calls[kind];
+        return 1;
+    }
+
+    static int StateBufferSlot(GLenum target)
+    {
+        switch (target)
+        {
+            case GL_ARRAY_BUFFER:         return 0;
+            case GL_ELEMENT_ARRAY_BUFFER: return 1;
+            case GL_UNIFORM_BUFFER:       return 2;
+            case GL_TEXTURE_BUFFER:       return 3;
+            default:                      return -1;
+        }
+    }
+
+    static int StateTextureSlot(GLenum target)
+    {
+        switch (target)
+        {
+            case GL_TEXTURE_2D:       return 0;
+            case GL_TEXTURE_BUFFER:   return 1;
+            case GL_TEXTURE_3D:       return 2;
+            case GL_TEXTURE_CUBE_MAP: return 3;
+            case GL_TEXTURE_2D_ARRAY: return 4;
+            default:                  return -1;
+        }
+    }
+
+
+    static void StateUseProgram(GLuint program)
+    {
+        if (StateChange(GLSTATE_PROGRAM, &gl_state.program, program))
+            glUseProgram(program);
+    }
+
+    static void StateBindVertexArray(GLuint vertex_array)
+    {
+        if (!StateChange(GLSTATE_VERTEX_ARRAY, &gl_state.vertex_array, vertex_array))
+            return;
+        glBindVertexArray(vertex_array);
+        /* the element array binding belongs to the vertex array */
+        gl_state.buffers[StateBufferSlot(GL_ELEMENT_ARRAY_BUFFER)] = GLSTATE_UNKNOWN;
+    }
+
+    static void StateBindBuffer(GLenum target, GLuint buffer)
+    {
+        const int slot = StateBufferSlot(target);
+
+        if (slot < 0)
+            ++gl_state.calls[GLSTATE_BUFFER];
+        if (slot < 0 || StateChange(GLSTATE_BUFFER, &gl_state.buffers[slot], buffer))
+            glBindBuffer(target, buffer);
+    }
+
+    /* Always issued, a range differs most of the time. Also binds buffer
+     * to target, like glBindBufferRange().
+     */
+    static void StateBindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+    {
+        const int slot = StateBufferSlot(target);
+
+        if (slot >= 0)
+            gl_state.buffers[slot] = buffer;
+        ++gl_state.calls[GLSTATE_BUFFER];
+        glBindBufferRange(target, index, buffer, offset, size);
+    }
+
+    /* Bind texture to target of texture unit, which becomes the active one */
+    static void StateBindTexture(GLuint unit, GLenum target, GLuint texture)
+    {
+        const int slot = StateTextureSlot(target);
+
+        if (StateChange(GLSTATE_TEXTURE, &gl_state.active_unit, unit))
+            glActiveTexture(GL_TEXTURE0 + unit);
+        if (unit >= GLSTATE_TEXTURE_UNITS || slot < 0)
+            ++gl_state.calls[GLSTATE_TEXTURE];
+        if (unit >= GLSTATE_TEXTURE_UNITS || slot < 0 ||
+            StateChange(GLSTATE_TEXTURE, &gl_state.textures[unit][slot], texture))
+            glBindTexture(target, texture);
+    }
+
+    /* GL_BLEND and GL_DEPTH_TEST are cached, other caps always issued */
+    static void StateEnable(GLenum cap, GLboolean enable)
+    {
+        GLuint* cached = (cap == GL_BLEND) ? &gl_state.blend : (cap == GL_DEPTH_TEST) ? &gl_state.depth_test : NULL;
+        const GLStateKind kind = (cap == GL_BLEND) ? GLSTATE_BLEND : GLSTATE_DEPTH;
+
+        if (cached != NULL && !StateChange(kind, cached, enable ? 1u : 0u))
+            return;
+        if (enable)
+            glEnable(cap);
+        else
+            glDisable(cap);
+    }
+
+    static void StateBlendFunc(GLenum src, GLenum dst)
+    {
+        StateBlendFuncSeparate(src, dst, src, dst);
+    }
+
+    static void StateBlendFuncSeparate(GLenum src_rgb, GLenum dst_rgb, GLenum src_alpha, GLenum dst_alpha)
+    {
+        if (gl_state.blend_func[0] == src_rgb && gl_state.blend_func[1] == dst_rgb &&
+            gl_state.blend_func[2] == src_alpha && gl_state.blend_func[3] == dst_alpha)
+        {
+            ++gl_state.redundant[GLSTATE_BLEND];
+            return;
+        }
+        gl_state.blend_func[0] = src_rgb;
+        gl_state.blend_func[1] = dst_rgb;
+        gl_state.blend_func[2] = src_alpha;
+        gl_state.blend_func[3] = dst_alpha;
+        ++gl_state.calls[GLSTATE_BLEND];
+        glBlendFuncSeparate(src_rgb, dst_rgb, src_alpha, dst_alpha);
+    }
+
+    static void StateDepthMask(GLboolean flag)
+    {
+        if (StateChange(GLSTATE_DEPTH, &gl_state.depth_mask, flag ? 1u : 0u))
+            glDepthMask(flag);
+    }
+
+
+    /* Deleting a bound object binds 0 in its place */
+    static void StateForget(GLuint* cached, int count, const GLuint* names, GLsizei num_names)
+    {
+        int ii;
+        GLsizei jj;
+
+        for (ii = 0 ; ii < count ; ++ii)
+            for (jj = 0 ; jj < num_names ; ++jj)
+                if (names[jj] != 0u && cached[ii] == names[jj])
+                    cached[ii] = 0u;
+    }
+
+    static void StateDeleteBuffers(GLsizei count, const GLuint* buffers)
+    {
+        StateForget(gl_state.buffers, GLSTATE_BUFFER_TARGETS, buffers, count);
+        glDeleteBuffers(count, buffers);
+    }
+
+    static void StateDeleteVertexArrays(GLsizei count, const GLuint* vertex_arrays)
+    {
+        const GLuint bound = gl_state.vertex_array;
+
+        StateForget(&gl_state.vertex_array, 1, vertex_arrays, count);
+        /* vertex array 0 is bound instead, with its own element array binding */
+        if (gl_state.vertex_array != bound)
+            gl_state.buffers[StateBufferSlot(GL_ELEMENT_ARRAY_BUFFER)] = GLSTATE_UNKNOWN;
+        glDeleteVertexArrays(count, vertex_arrays);
+    }
+
+    static void StateDeleteTextures(GLsizei count, const GLuint* textures)
+    {
+        StateForget(&gl_state.textures[0][0], GLSTATE_TEXTURE_UNITS * GLSTATE_TEXTURE_TARGETS, textures, count);
+        glDeleteTextures(count, textures);
+    }
+
+
+    static void PrintGLStateStats(void)
+    {
+        int ii;
+
+        for (ii = 0 ; ii < GLSTATE_KINDS ; ++ii)
+            printf("%-12s %8lu calls, %8lu redundant dropped\n", gl_state_kinds[ii],
+                   gl_state.calls[ii], gl_state.redundant[ii]);
+    }
+
+#endif
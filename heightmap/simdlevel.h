@@ -0,0 +1,51 @@
+#ifndef GL_SIMDLEVEL_H
+#define GL_SIMDLEVEL_H
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+ #include <immintrin.h>
+ #define SIMD_X86 1
+#else
+ #define SIMD_X86 0
+#endif
+
+/**********************************************************************
+ * Run time instruction set selection
+ *********************************************************************/
+
+/* Instruction set of the CPU kernels. The modules with vector kernels
+ * (wave.h, particles.h, nbody.h, mapparticles.h, particlecull.h) build a
+ * scalar, an SSE2 and an AVX2 one with target attributes, so the binary
+ * runs on any x86 CPU, and Set*Simd() picks one of them at run time.
+ * SIMD_AUTO is the widest one the CPU supports, a level the CPU does not
+ * support falls back to the next narrower one.
+ */
+typedef enum SimdLevel
+{
+    SIMD_AUTO = 0,
+    SIMD_SCALAR,
+    SIMD_SSE2,
+    SIMD_AVX2
+} SimdLevel;
+
+    static SimdLevel GetSimdLevel(SimdLevel simd);
+
+
+#endif /* GL_SIMDLEVEL_H */
+
+#if defined GL_SIMDLEVEL_IMPLEMENTATION
+    /* implementation here */
+
+    /* The level the CPU runs for a request of simd */
+    static SimdLevel GetSimdLevel(SimdLevel simd)
+    {
+#if SIMD_X86
+        __builtin_cpu_init();
+        if ((simd == SIMD_AUTO || simd == SIMD_AVX2) && __builtin_cpu_supports("avx2"))
+            return SIMD_AVX2;
+        if (simd != SIMD_SCALAR && __builtin_cpu_supports("sse2"))
+            return SIMD_SSE2;
+#endif
+        return SIMD_SCALAR;
+    }
+
+#endif
@@ -0,0 +1,458 @@
+#ifndef GL_MAPPARTICLES_H
+#define GL_MAPPARTICLES_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* The vector kernels are picked at run time, include simdlevel.h first */
+
+/* Particles start falling from this height and are dropped again once
+ * they fell off the map below MAP_PARTICLE_FLOOR
+ */
+#define MAP_PARTICLE_DROP_HEIGHT (6.0f)
+#define MAP_PARTICLE_FLOOR (-10.0f)
+#define MAP_PARTICLE_GRAVITY (-9.81f)
+
+/**********************************************************************
+ * Particles colliding with the heightmap
+ *********************************************************************/
+
+/* Particles falling on the terrain of heightmap.h, bouncing off it and
+ * sliding down its slopes. Positions are in map units: x and z on the
+ * grid, y up.
+ *
+ * The terrain is map_surface_heights, the heights last streamed to the
+ * mesh, so the particles collide with the surface on screen even while
+ * UpdateMap() keeps editing it and the mesh moves between two
+ * iterations. A particle found below the surface is put back on it; the
+ * velocity loses (1 + restitution) of its part into the surface and
+ * friction of the part along it.
+ *
+ * Each particle samples the 4 heights around it, bilinear height and
+ * slope in one go, 4 or 8 particles per instruction: the vector kernels
+ * fetch the heights with gathers (AVX2) or lane by lane (SSE2). Counts
+ * of a few 100k particles cost a few milliseconds per frame.
+ *
+ * The particles are drawn as points with the mesh program, its x, y and
+ * z attributes read from a stream buffer. Include streambuf.h and
+ * heightmap.h first.
+ */
+typedef struct MapParticles
+{
+    int count;
+    float* x;
+    float* y;
+    float* z;
+    float* vx;
+    float* vy;
+    float* vz;
+    float restitution;
+    float friction;
+    unsigned seed;
+    /* Particles that touched the terrain in the last update */
+    int contacts;
+    GLuint vao;
+    GLint attrloc[3];
+    StreamBuffer stream;
+} MapParticles;
+
+    static int  CreateMapParticles(MapParticles* mp, GLuint program, int count);
+    static void DeleteMapParticles(MapParticles* mp);
+    static void UpdateMapParticles(MapParticles* mp, float dt);
+    static void DrawMapParticles(MapParticles* mp);
+    static SimdLevel SetMapParticleSimd(SimdLevel simd);
+
+
+#endif /* GL_MAPPARTICLES_H */
+
+#if defined GL_MAPPARTICLES_IMPLEMENTATION
+    /* implementation here */
+
+    /* xorshift32, uniform in [lo, hi] */
+    static float MapParticleRandom(unsigned* seed, float lo, float hi)
+    {
+        unsigned s = *seed;
+
+        s ^= s << 13;
+        s ^= s >> 17;
+        s ^= s << 5;
+        *seed = s;
+        return lo + (hi - lo) * (float) (s >> 8) * (1.0f / 16777216.0f);
+    }
+
+    static void DropMapParticle(MapParticles* mp, int ii)
+    {
+        mp->x[ii] = MapParticleRandom(&mp->seed, 0.0f, MAP_SIZE);
+        mp->y[ii] = MapParticleRandom(&mp->seed, 0.5f, 1.0f) * MAP_PARTICLE_DROP_HEIGHT;
+        mp->z[ii] = MapParticleRandom(&mp->seed, 0.0f, MAP_SIZE);
+        mp->vx[ii] = mp->vy[ii] = mp->vz[ii] = 0.0f;
+    }
+
+
+    /* count particles spread over the map, drawn with the attributes x, y
+     * and z of program. Returns 0 on failure.
+     */
+    static int CreateMapParticles(MapParticles* mp, GLuint program, int count)
+    {
+        static const char* names[3] = { "x", "y", "z" };
+        int ii;
+
+        memset(mp, 0, sizeof(*mp));
+        mp->count = count;
+        mp->restitution = 0.3f;
+        mp->friction = 0.05f;
+        mp->seed = 2463534242u;
+        mp->x = (float*) malloc(sizeof(float) * 6 * (size_t) count);
+        if (mp->x == NULL)
+            return 0;
+        mp->y = mp->x + count;
+        mp->z = mp->y + count;
+        mp->vx = mp->z + count;
+        mp->vy = mp->vx + count;
+        mp->vz = mp->vy + count;
+        for (ii = 0 ; ii < count ; ++ii)
+            DropMapParticle(mp, ii);
+
+        if (!CreateStreamBuffer(&mp->stream, GL_ARRAY_BUFFER, sizeof(float) * 3 * (GLsizeiptr) count))
+        {
+            free(mp->x);
+            memset(mp, 0, sizeof(*mp));
+            return 0;
+        }
+        glGenVertexArrays(1, &mp->vao);
+        StateBindVertexArray(mp->vao);
+        for (ii = 0 ; ii < 3 ; ++ii)
+        {
+            mp->attrloc[ii] = glGetAttribLocation(program, names[ii]);
+            glEnableVertexAttribArray((GLuint) mp->attrloc[ii]);
+        }
+        return 1;
+    }
+
+
+    static void DeleteMapParticles(MapParticles* mp)
+    {
+        StateDeleteVertexArrays(1, &mp->vao);
+        DeleteStreamBuffer(&mp->stream);
+        free(mp->x);
+        memset(mp, 0, sizeof(*mp));
+    }
+
+
+    /**********************************************************************
+     * Collision kernels
+     *********************************************************************/
+
+    /* Integrate particles [i0, i1) over dt, then collide them with heights.
+     * params holds dt, gravity * dt, restitution and friction. Returns the
+     * number of particles touching the terrain.
+     */
+    typedef int (*MapParticleKernel)(MapParticles* mp, int i0, int i1,
+                                     const float* heights, const float* params);
+
+    static MapParticleKernel map_particle_kernel = NULL;
+
+    static int MapParticleKernelScalar(MapParticles* mp, int i0, int i1,
+                                       const float* heights, const float* params)
+    {
+        const float dt = params[0], gdt = params[1], bounce = 1.0f + params[2], keep = 1.0f - params[3];
+        const float inv_step = (MAP_NUM_VERTICES - 1) / MAP_SIZE;
+        int contacts = 0;
+        int ii;
+
+        for (ii = i0 ; ii < i1 ; ++ii)
+        {
+            float u, v, fu, fv, h00, h10, h01, h11, cross, h, nx, nz, inv_len, vn;
+            int k;
+
+            mp->vy[ii] += gdt;
+            mp->x[ii] += mp->vx[ii] * dt;
+            mp->y[ii] += mp->vy[ii] * dt;
+            mp->z[ii] += mp->vz[ii] * dt;
+
+            u = mp->x[ii] * inv_step;
+            v = mp->z[ii] * inv_step;
+            if (!(u >= 0.0f && u < MAP_NUM_VERTICES - 1 && v >= 0.0f && v < MAP_NUM_VERTICES - 1))
+                continue;
+            k = (int) u * MAP_NUM_VERTICES + (int) v;
+            fu = u - (float) (int) u;
+            fv = v - (float) (int) v;
+            h00 = heights[k];
+            h10 = heights[k + MAP_NUM_VERTICES];
+            h01 = heights[k + 1];
+            h11 = heights[k + MAP_NUM_VERTICES + 1];
+            cross = h00 - h10 - h01 + h11;
+            h = h00 + (h10 - h00) * fu + (h01 - h00) * fv + cross * fu * fv;
+            if (mp->y[ii] >= h)
+                continue;
+
+            /* normal (-dh/dx, 1, -dh/dz) */
+            nx = -((h10 - h00) + cross * fv) * inv_step;
+            nz = -((h01 - h00) + cross * fu) * inv_step;
+            inv_len = 1.0f / sqrtf(nx * nx + 1.0f + nz * nz);
+            nx *= inv_len;
+            nz *= inv_len;
+
+            mp->y[ii] = h;
+            vn = mp->vx[ii] * nx + mp->vy[ii] * inv_len + mp->vz[ii] * nz;
+            vn = (vn < 0.0f) ? vn : 0.0f;
+            mp->vx[ii] -= bounce * vn * nx;
+            mp->vy[ii] -= bounce * vn * inv_len;
+            mp->vz[ii] -= bounce * vn * nz;
+            /* friction slows the part along the surface only */
+            vn = mp->vx[ii] * nx + mp->vy[ii] * inv_len + mp->vz[ii] * nz;
+            mp->vx[ii] = mp->vx[ii] * keep + (1.0f - keep) * vn * nx;
+            mp->vy[ii] = mp->vy[ii] * keep + (1.0f - keep) * vn * inv_len;
+            mp->vz[ii] = mp->vz[ii] * keep + (1.0f - keep) * vn * nz;
+            ++contacts;
+        }
+        return contacts;
+    }
+
+#if SIMD_X86
+    /* Same as the scalar kernel. Particles off the map sample the clamped
+     * border cell and are masked out, the collision response is blended in
+     * for the particles below the surface only.
+     */
+    __attribute__((target("sse2")))
+    static int MapParticleKernelSSE2(MapParticles* mp, int i0, int i1,
+                                     const float* heights, const float* params)
+    {
+        const __m128 dt = _mm_set1_ps(params[0]), gdt = _mm_set1_ps(params[1]);
+        const __m128 bounce = _mm_set1_ps(1.0f + params[2]), keep = _mm_set1_ps(1.0f - params[3]);
+        const __m128 inv_step = _mm_set1_ps((MAP_NUM_VERTICES - 1) / MAP_SIZE);
+        const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+        const __m128 last = _mm_set1_ps((float) (MAP_NUM_VERTICES - 1));
+        const __m128 last_in = _mm_set1_ps((float) (MAP_NUM_VERTICES - 1) - 1e-3f);
+        __m128 x, y, z, vx, vy, vz, u, v, fu, fv, h00, h10, h01, h11, cross, h, nx, ny, nz, vn, hit, inv_len;
+        __m128i cell;
+        int k[4], ll, mask, contacts = 0;
+        int ii;
+
+        for (ii = i0 ; ii + 4 <= i1 ; ii += 4)
+        {
+            vx = _mm_loadu_ps(mp->vx + ii);
+            vy = _mm_add_ps(_mm_loadu_ps(mp->vy + ii), gdt);
+            vz = _mm_loadu_ps(mp->vz + ii);
+            x = _mm_add_ps(_mm_loadu_ps(mp->x + ii), _mm_mul_ps(vx, dt));
+            y = _mm_add_ps(_mm_loadu_ps(mp->y + ii), _mm_mul_ps(vy, dt));
+            z = _mm_add_ps(_mm_loadu_ps(mp->z + ii), _mm_mul_ps(vz, dt));
+
+            u = _mm_mul_ps(x, inv_step);
+            v = _mm_mul_ps(z, inv_step);
+            hit = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmplt_ps(u, last)),
+                             _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmplt_ps(v, last)));
+            u = _mm_min_ps(_mm_max_ps(u, zero), last_in);
+            v = _mm_min_ps(_mm_max_ps(v, zero), last_in);
+            cell = _mm_add_epi32(_mm_mullo_epi16(_mm_cvttps_epi32(u), _mm_set1_epi32(MAP_NUM_VERTICES)),
+                                 _mm_cvttps_epi32(v));
+            fu = _mm_sub_ps(u, _mm_cvtepi32_ps(_mm_cvttps_epi32(u)));
+            fv = _mm_sub_ps(v, _mm_cvtepi32_ps(_mm_cvttps_epi32(v)));
+            _mm_storeu_si128((__m128i*) k, cell);
+            h00 = _mm_set_ps(heights[k[3]], heights[k[2]], heights[k[1]], heights[k[0]]);
+            h10 = _mm_set_ps(heights[k[3] + MAP_NUM_VERTICES], heights[k[2] + MAP_NUM_VERTICES],
+                             heights[k[1] + MAP_NUM_VERTICES], heights[k[0] + MAP_NUM_VERTICES]);
+            h01 = _mm_set_ps(heights[k[3] + 1], heights[k[2] + 1], heights[k[1] + 1], heights[k[0] + 1]);
+            h11 = _mm_set_ps(heights[k[3] + MAP_NUM_VERTICES + 1], heights[k[2] + MAP_NUM_VERTICES + 1],
+                             heights[k[1] + MAP_NUM_VERTICES + 1], heights[k[0] + MAP_NUM_VERTICES + 1]);
+            cross = _mm_add_ps(_mm_sub_ps(_mm_sub_ps(h00, h10), h01), h11);
+            h = _mm_add_ps(_mm_add_ps(h00, _mm_mul_ps(_mm_sub_ps(h10, h00), fu)),
+                           _mm_add_ps(_mm_mul_ps(_mm_sub_ps(h01, h00), fv), _mm_mul_ps(cross, _mm_mul_ps(fu, fv))));
+            hit = _mm_and_ps(hit, _mm_cmplt_ps(y, h));
+            mask = _mm_movemask_ps(hit);
+
+            if (mask != 0)
+            {
+                nx = _mm_mul_ps(_mm_add_ps(_mm_sub_ps(h10, h00), _mm_mul_ps(cross, fv)), inv_step);
+                nz = _mm_mul_ps(_mm_add_ps(_mm_sub_ps(h01, h00), _mm_mul_ps(cross, fu)), inv_step);
+                inv_len = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), one), _mm_mul_ps(nz, nz))));
+                nx = _mm_sub_ps(zero, _mm_mul_ps(nx, inv_len));
+                nz = _mm_sub_ps(zero, _mm_mul_ps(nz, inv_len));
+                ny = inv_len;
+
+                y = _mm_or_ps(_mm_and_ps(hit, h), _mm_andnot_ps(hit, y));
+                vn = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, nx), _mm_mul_ps(vy, ny)), _mm_mul_ps(vz, nz));
+                vn = _mm_and_ps(hit, _mm_min_ps(vn, zero));
+                vn = _mm_mul_ps(vn, bounce);
+                vx = _mm_sub_ps(vx, _mm_mul_ps(vn, nx));
+                vy = _mm_sub_ps(vy, _mm_mul_ps(vn, ny));
+                vz = _mm_sub_ps(vz, _mm_mul_ps(vn, nz));
+                vn = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, nx), _mm_mul_ps(vy, ny)), _mm_mul_ps(vz, nz));
+                vn = _mm_mul_ps(vn, _mm_sub_ps(one, keep));
+                vx = _mm_or_ps(_mm_and_ps(hit, _mm_add_ps(_mm_mul_ps(vx, keep), _mm_mul_ps(vn, nx))), _mm_andnot_ps(hit, vx));
+                vy = _mm_or_ps(_mm_and_ps(hit, _mm_add_ps(_mm_mul_ps(vy, keep), _mm_mul_ps(vn, ny))), _mm_andnot_ps(hit, vy));
+                vz = _mm_or_ps(_mm_and_ps(hit, _mm_add_ps(_mm_mul_ps(vz, keep), _mm_mul_ps(vn, nz))), _mm_andnot_ps(hit, vz));
+                for (ll = 0 ; ll < 4 ; ++ll)
+                    contacts += (mask >> ll) & 1;
+            }
+            _mm_storeu_ps(mp->x + ii, x);
+            _mm_storeu_ps(mp->y + ii, y);
+            _mm_storeu_ps(mp->z + ii, z);
+            _mm_storeu_ps(mp->vx + ii, vx);
+            _mm_storeu_ps(mp->vy + ii, vy);
+            _mm_storeu_ps(mp->vz + ii, vz);
+        }
+        return contacts + MapParticleKernelScalar(mp, ii, i1, heights, params);
+    }
+
+    __attribute__((target("avx2")))
+    static int MapParticleKernelAVX2(MapParticles* mp, int i0, int i1,
+                                     const float* heights, const float* params)
+    {
+        const __m256 dt = _mm256_set1_ps(params[0]), gdt = _mm256_set1_ps(params[1]);
+        const __m256 bounce = _mm256_set1_ps(1.0f + params[2]), keep = _mm256_set1_ps(1.0f - params[3]);
+        const __m256 inv_step = _mm256_set1_ps((MAP_NUM_VERTICES - 1) / MAP_SIZE);
+        const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+        const __m256 last = _mm256_set1_ps((float) (MAP_NUM_VERTICES - 1));
+        const __m256 last_in = _mm256_set1_ps((float) (MAP_NUM_VERTICES - 1) - 1e-3f);
+        const __m256i row = _mm256_set1_epi32(MAP_NUM_VERTICES);
+        const __m256i next = _mm256_set1_epi32(1);
+        __m256 x, y, z, vx, vy, vz, u, v, fu, fv, h00, h10, h01, h11, cross, h, nx, ny, nz, vn, hit, inv_len;
+        __m256i iu, iv, cell;
+        int mask, contacts = 0;
+        int ii;
+
+        for (ii = i0 ; ii + 8 <= i1 ; ii += 8)
+        {
+            vx = _mm256_loadu_ps(mp->vx + ii);
+            vy = _mm256_add_ps(_mm256_loadu_ps(mp->vy + ii), gdt);
+            vz = _mm256_loadu_ps(mp->vz + ii);
+            x = _mm256_add_ps(_mm256_loadu_ps(mp->x + ii), _mm256_mul_ps(vx, dt));
+            y = _mm256_add_ps(_mm256_loadu_ps(mp->y + ii), _mm256_mul_ps(vy, dt));
+            z = _mm256_add_ps(_mm256_loadu_ps(mp->z + ii), _mm256_mul_ps(vz, dt));
+
+            u = _mm256_mul_ps(x, inv_step);
+            v = _mm256_mul_ps(z, inv_step);
+            hit = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_GE_OQ), _mm256_cmp_ps(u, last, _CMP_LT_OQ)),
+                                _mm256_and_ps(_mm256_cmp_ps(v, zero, _CMP_GE_OQ), _mm256_cmp_ps(v, last, _CMP_LT_OQ)));
+            u = _mm256_min_ps(_mm256_max_ps(u, zero), last_in);
+            v = _mm256_min_ps(_mm256_max_ps(v, zero), last_in);
+            iu = _mm256_cvttps_epi32(u);
+            iv = _mm256_cvttps_epi32(v);
+            fu = _mm256_sub_ps(u, _mm256_cvtepi32_ps(iu));
+            fv = _mm256_sub_ps(v, _mm256_cvtepi32_ps(iv));
+            cell = _mm256_add_epi32(_mm256_mullo_epi32(iu, row), iv);
+            h00 = _mm256_i32gather_ps(heights, cell, 4);
+            h01 = _mm256_i32gather_ps(heights, _mm256_add_epi32(cell, next), 4);
+            cell = _mm256_add_epi32(cell, row);
+            h10 = _mm256_i32gather_ps(heights, cell, 4);
+            h11 = _mm256_i32gather_ps(heights, _mm256_add_epi32(cell, next), 4);
+            cross = _mm256_add_ps(_mm256_sub_ps(_mm256_sub_ps(h00, h10), h01), h11);
+            h = _mm256_add_ps(_mm256_add_ps(h00, _mm256_mul_ps(_mm256_sub_ps(h10, h00), fu)),
+                              _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(h01, h00), fv),
+                                            _mm256_mul_ps(cross, _mm256_mul_ps(fu, fv))));
+            hit = _mm256_and_ps(hit, _mm256_cmp_ps(y, h, _CMP_LT_OQ));
+            mask = _mm256_movemask_ps(hit);
+
+            if (mask != 0)
+            {
+                nx = _mm256_mul_ps(_mm256_add_ps(_mm256_sub_ps(h10, h00), _mm256_mul_ps(cross, fv)), inv_step);
+                nz = _mm256_mul_ps(_mm256_add_ps(_mm256_sub_ps(h01, h00), _mm256_mul_ps(cross, fu)), inv_step);
+                inv_len = _mm256_div_ps(one, _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, nx), one),
+                                                                          _mm256_mul_ps(nz, nz))));
+                nx = _mm256_sub_ps(zero, _mm256_mul_ps(nx, inv_len));
+                nz = _mm256_sub_ps(zero, _mm256_mul_ps(nz, inv_len));
+                ny = inv_len;
+
+                y = _mm256_blendv_ps(y, h, hit);
+                vn = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, nx), _mm256_mul_ps(vy, ny)), _mm256_mul_ps(vz, nz));
+                vn = _mm256_and_ps(hit, _mm256_min_ps(vn, zero));
+                vn = _mm256_mul_ps(vn, bounce);
+                vx = _mm256_sub_ps(vx, _mm256_mul_ps(vn, nx));
+                vy = _mm256_sub_ps(vy, _mm256_mul_ps(vn, ny));
+                vz = _mm256_sub_ps(vz, _mm256_mul_ps(vn, nz));
+                vn = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, nx), _mm256_mul_ps(vy, ny)), _mm256_mul_ps(vz, nz));
+                vn = _mm256_mul_ps(vn, _mm256_sub_ps(one, keep));
+                vx = _mm256_blendv_ps(vx, _mm256_add_ps(_mm256_mul_ps(vx, keep), _mm256_mul_ps(vn, nx)), hit);
+                vy = _mm256_blendv_ps(vy, _mm256_add_ps(_mm256_mul_ps(vy, keep), _mm256_mul_ps(vn, ny)), hit);
+                vz = _mm256_blendv_ps(vz, _mm256_add_ps(_mm256_mul_ps(vz, keep), _mm256_mul_ps(vn, nz)), hit);
+                contacts += __builtin_popcount((unsigned) mask);
+            }
+            _mm256_storeu_ps(mp->x + ii, x);
+            _mm256_storeu_ps(mp->y + ii, y);
+            _mm256_storeu_ps(mp->z + ii, z);
+            _mm256_storeu_ps(mp->vx + ii, vx);
+            _mm256_storeu_ps(mp->vy + ii, vy);
+            _mm256_storeu_ps(mp->vz + ii, vz);
+        }
+        return contacts + MapParticleKernelScalar(mp, ii, i1, heights, params);
+    }
+#endif
+
+
+    /* Select the collision kernel at the level GetSimdLevel() gives simd,
+     * returns the level in use
+     */
+    static SimdLevel SetMapParticleSimd(SimdLevel simd)
+    {
+        SimdLevel level = GetSimdLevel(simd);
+
+        switch (level)
+        {
+#if SIMD_X86
+            case SIMD_AVX2: map_particle_kernel = MapParticleKernelAVX2; break;
+            case SIMD_SSE2: map_particle_kernel = MapParticleKernelSSE2; break;
+#endif
+            default: map_particle_kernel = MapParticleKernelScalar; break;
+        }
+        return level;
+    }
+
+
+    /**********************************************************************
+     * Simulation and drawing
+     *********************************************************************/
+
+    /* Advance the particles by dt seconds against the surface as last
+     * streamed, call after UpdateMesh() or UpdateMeshLerp(). Particles that
+     * fell off the map are dropped on it again.
+     */
+    static void UpdateMapParticles(MapParticles* mp, float dt)
+    {
+        float params[4];
+        int ii;
+
+        if (map_particle_kernel == NULL)
+            SetMapParticleSimd(SIMD_AUTO);
+
+        params[0] = dt;
+        params[1] = MAP_PARTICLE_GRAVITY * dt;
+        params[2] = mp->restitution;
+        params[3] = mp->friction;
+        mp->contacts = map_particle_kernel(mp, 0, mp->count, map_surface_heights, params);
+
+        for (ii = 0 ; ii < mp->count ; ++ii)
+            if (mp->y[ii] < MAP_PARTICLE_FLOOR)
+                DropMapParticle(mp, ii);
+    }
+
+
+    /* Draw the particles as points with the program passed to
+     * CreateMapParticles(), which must be in use. Leaves the particle VAO
+     * bound.
+     */
+    static void DrawMapParticles(MapParticles* mp)
+    {
+        const size_t size = sizeof(float) * (size_t) mp->count;
+        unsigned char* data;
+        GLintptr offset;
+        int ii;
+
+        data = (unsigned char*) MapStreamBuffer(&mp->stream, (GLsizeiptr) size * 3, &offset);
+        if (data == NULL)
+            return;
+        memcpy(data, mp->x, size);
+        memcpy(data + size, mp->y, size);
+        memcpy(data + 2 * size, mp->z, size);
+        UnmapStreamBuffer(&mp->stream);
+
+        StateBindVertexArray(mp->vao);
+        StateBindBuffer(GL_ARRAY_BUFFER, mp->stream.buffer);
+        for (ii = 0 ; ii < 3 ; ++ii)
+            glVertexAttribPointer((GLuint) mp->attrloc[ii], 1, GL_FLOAT, GL_FALSE, 0,
+                                  (void*) (offset + (GLintptr) (size * (size_t) ii)));
+        glDrawArrays(GL_POINTS, 0, mp->count);
+    }
+
+#endif
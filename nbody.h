@@ -0,0 +1,819 @@
+#ifndef GL_NBODY_H
+#define GL_NBODY_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* The vector kernels are picked at run time, include simdlevel.h first */
+
+/* Bodies handled per worker pool task by the tree build and the forces */
+#define NBODY_CHUNK 16384
+
+/* Bodies per task of the direct sum, each is summed over all bodies */
+#define NBODY_DIRECT_CHUNK 256
+
+/* Most bodies in a tree leaf, unless they share a position */
+#define NBODY_LEAF_SIZE 8
+
+/* Bodies in tree order sharing one walk of the tree */
+#define NBODY_GROUP_SIZE 32
+
+/* The quadtree is split into 4^NBODY_TOP_LEVELS subtrees built in parallel */
+#define NBODY_TOP_LEVELS 3
+#define NBODY_TOP_CELLS (1 << (2 * NBODY_TOP_LEVELS))
+
+/* Levels of a body position key, the tree is at most this deep */
+#define NBODY_KEY_LEVELS 16
+
+/**********************************************************************
+ * Barnes-Hut N-body forces
+ *********************************************************************/
+
+/* Mutual attraction of bodies in the plane, e.g. the particles of
+ * particles.h: body i is accelerated by
+ *
+ *   gravity * sum over j of mass[j] * d / (|d|^2 + softening^2)^(3/2)
+ *
+ * with d the position of j minus the position of i. The direct sum is
+ * O(n^2); ComputeNBodyForces() approximates it with a quadtree over the
+ * bodies (Barnes-Hut): a cell whose width is below theta times its
+ * distance pulls as one body at its center of mass. theta 0 opens every
+ * cell and matches the direct sum, 0.5 to 1 is the usual trade.
+ *
+ * BuildNBodyTree() runs on the worker pool. Each body gets a Morton key
+ * of 16 bits per axis in the square around all bodies, a stable counting
+ * sort puts the bodies in order of the 64 cells of the 4th level, then
+ * the 64 subtrees are built in parallel by splitting on the next 2 key
+ * bits at every level, and the 3 levels on top are joined last.
+ *
+ * The forces are summed in parallel over groups of NBODY_GROUP_SIZE
+ * bodies in tree order, which are close to each other: the group walks
+ * the tree once, opening cells by their distance to the box around the
+ * group, and collects the cells and bodies pulling on it into a list.
+ * Each body of the group then sums the list with the same SSE2 or AVX2
+ * kernel as ComputeNBodyDirect(), the O(n^2) reference. Include
+ * workpool.h first.
+ */
+typedef struct NBodyNode
+{
+    float x;
+    float y;
+    float mass;
+    float size;
+    int child[4];
+    int first;
+    int count;
+    int leaf;
+} NBodyNode;
+
+/* Nodes of one subtree, kept between builds */
+typedef struct NBodyNodes
+{
+    NBodyNode* nodes;
+    int count;
+    int capacity;
+} NBodyNodes;
+
+typedef struct NBody
+{
+    float theta;
+    float gravity;
+    float softening;
+    int capacity;
+    int count;
+    /* Bodies of the last build, keys and indices in tree order and the
+     * positions and masses copied in that order
+     */
+    const float* x;
+    const float* y;
+    const float* mass;
+    unsigned* keys;
+    unsigned* sorted_keys;
+    unsigned* tmp_keys;
+    int* order;
+    int* tmp_order;
+    float* sx;
+    float* sy;
+    float* sm;
+    /* Square around the bodies */
+    float x0;
+    float y0;
+    float size;
+    /* Per task bounds and cell counts of the build */
+    float* chunk_bounds;
+    int* chunk_counts;
+    int cell_start[NBODY_TOP_CELLS + 1];
+    NBodyNodes subtrees[NBODY_TOP_CELLS];
+    int subtree_base[NBODY_TOP_CELLS];
+    /* The tree, the root is node 0 */
+    NBodyNode* nodes;
+    int num_nodes;
+    int max_nodes;
+    /* Output of the force passes */
+    float* ax;
+    float* ay;
+} NBody;
+
+    static int  InitNBody(NBody* nb, int capacity);
+    static void FreeNBody(NBody* nb);
+    static int  BuildNBodyTree(NBody* nb, WorkPool* pool, const float* x, const float* y,
+                               const float* mass, int count);
+    static void ComputeNBodyForces(NBody* nb, WorkPool* pool, float* ax, float* ay);
+    static void ComputeNBodyDirect(NBody* nb, WorkPool* pool, const float* x, const float* y,
+                                   const float* mass, int count, float* ax, float* ay);
+    static SimdLevel SetNBodySimd(SimdLevel simd);
+
+
+#endif /* GL_NBODY_H */
+
+#if defined GL_NBODY_IMPLEMENTATION
+    /* implementation here */
+
+    /* Room for capacity bodies, theta 0.5, gravity 1 and softening 1.
+     * Returns 0 when the allocation failed.
+     */
+    static int InitNBody(NBody* nb, int capacity)
+    {
+        const int num_chunks = (capacity + NBODY_CHUNK - 1) / NBODY_CHUNK + 1;
+        const size_t n = (size_t) capacity;
+
+        memset(nb, 0, sizeof(*nb));
+        nb->theta = 0.5f;
+        nb->gravity = 1.0f;
+        nb->softening = 1.0f;
+        nb->capacity = capacity;
+
+        nb->keys = (unsigned*) malloc(sizeof(unsigned) * n * 3);
+        nb->order = (int*) malloc(sizeof(int) * n * 2);
+        nb->sx = (float*) malloc(sizeof(float) * n * 3);
+        nb->chunk_bounds = (float*) malloc(sizeof(float) * 4 * (size_t) num_chunks);
+        nb->chunk_counts = (int*) malloc(sizeof(int) * NBODY_TOP_CELLS * (size_t) num_chunks);
+        if (nb->keys == NULL || nb->order == NULL || nb->sx == NULL ||
+            nb->chunk_bounds == NULL || nb->chunk_counts == NULL)
+        {
+            FreeNBody(nb);
+            return 0;
+        }
+        nb->sorted_keys = nb->keys + n;
+        nb->tmp_keys = nb->keys + 2 * n;
+        nb->tmp_order = nb->order + n;
+        nb->sy = nb->sx + n;
+        nb->sm = nb->sx + 2 * n;
+        return 1;
+    }
+
+
+    static void FreeNBody(NBody* nb)
+    {
+        int ii;
+
+        for (ii = 0 ; ii < NBODY_TOP_CELLS ; ++ii)
+            free(nb->subtrees[ii].nodes);
+        free(nb->keys);
+        free(nb->order);
+        free(nb->sx);
+        free(nb->chunk_bounds);
+        free(nb->chunk_counts);
+        free(nb->nodes);
+        memset(nb, 0, sizeof(*nb));
+    }
+
+
+    /**********************************************************************
+     * Tree build
+     *********************************************************************/
+
+    static void NBodyBoundsTask(void* ctx, int task, int worker)
+    {
+        NBody* nb = (NBody*) ctx;
+        const int i0 = task * NBODY_CHUNK;
+        const int i1 = (i0 + NBODY_CHUNK < nb->count) ? i0 + NBODY_CHUNK : nb->count;
+        float* bounds = nb->chunk_bounds + 4 * task;
+        int ii;
+
+        (void) worker;
+        bounds[0] = bounds[2] = nb->x[i0];
+        bounds[1] = bounds[3] = nb->y[i0];
+        for (ii = i0 + 1 ; ii < i1 ; ++ii)
+        {
+            bounds[0] = fminf(bounds[0], nb->x[ii]);
+            bounds[1] = fminf(bounds[1], nb->y[ii]);
+            bounds[2] = fmaxf(bounds[2], nb->x[ii]);
+            bounds[3] = fmaxf(bounds[3], nb->y[ii]);
+        }
+    }
+
+    /* Spread the 16 bits of v to the even bits */
+    static unsigned NBodySpread(unsigned v)
+    {
+        v = (v | (v << 8)) & 0x00FF00FFu;
+        v = (v | (v << 4)) & 0x0F0F0F0Fu;
+        v = (v | (v << 2)) & 0x33333333u;
+        v = (v | (v << 1)) & 0x55555555u;
+        return v;
+    }
+
+    static void NBodyKeyTask(void* ctx, int task, int worker)
+    {
+        NBody* nb = (NBody*) ctx;
+        const int i0 = task * NBODY_CHUNK;
+        const int i1 = (i0 + NBODY_CHUNK < nb->count) ? i0 + NBODY_CHUNK : nb->count;
+        const float scale = 65536.0f / nb->size;
+        int* counts = nb->chunk_counts + NBODY_TOP_CELLS * task;
+        int ii, qx, qy;
+
+        (void) worker;
+        memset(counts, 0, sizeof(int) * NBODY_TOP_CELLS);
+        for (ii = i0 ; ii < i1 ; ++ii)
+        {
+            qx = (int) ((nb->x[ii] - nb->x0) * scale);
+            qy = (int) ((nb->y[ii] - nb->y0) * scale);
+            qx = (qx < 0) ? 0 : (qx > 65535) ? 65535 : qx;
+            qy = (qy < 0) ? 0 : (qy > 65535) ? 65535 : qy;
+            nb->keys[ii] = NBodySpread((unsigned) qx) | (NBodySpread((unsigned) qy) << 1);
+            ++counts[nb->keys[ii] >> (2 * (NBODY_KEY_LEVELS - NBODY_TOP_LEVELS))];
+        }
+    }
+
+    /* chunk_counts hold where the task writes each of its cells by now */
+    static void NBodyScatterTask(void* ctx, int task, int worker)
+    {
+        NBody* nb = (NBody*) ctx;
+        const int i0 = task * NBODY_CHUNK;
+        const int i1 = (i0 + NBODY_CHUNK < nb->count) ? i0 + NBODY_CHUNK : nb->count;
+        int* cursor = nb->chunk_counts + NBODY_TOP_CELLS * task;
+        int ii, pos;
+
+        (void) worker;
+        for (ii = i0 ; ii < i1 ; ++ii)
+        {
+            pos = cursor[nb->keys[ii] >> (2 * (NBODY_KEY_LEVELS - NBODY_TOP_LEVELS))]++;
+            nb->order[pos] = ii;
+            nb->sorted_keys[pos] = nb->keys[ii];
+        }
+    }
+
+    /* Add a node to the subtree, returns its index or -1 when out of memory */
+    static int NBodyNewNode(NBodyNodes* tree)
+    {
+        if (tree->count == tree->capacity)
+        {
+            const int capacity = (tree->capacity > 0) ? tree->capacity * 2 : 256;
+            NBodyNode* nodes = (NBodyNode*) realloc(tree->nodes, sizeof(NBodyNode) * (size_t) capacity);
+
+            if (nodes == NULL)
+                return -1;
+            tree->nodes = nodes;
+            tree->capacity = capacity;
+        }
+        return tree->count++;
+    }
+
+    /* Build the node of bodies [first, first + count) in tree order at
+     * level, sorting them by the key bits of the levels below. Child
+     * indices are local to the subtree. Returns the node index, -1 when out
+     * of memory.
+     */
+    static int NBodyBuildNode(NBody* nb, NBodyNodes* tree, int first, int count, int level)
+    {
+        const int index = NBodyNewNode(tree);
+        NBodyNode node;
+        int cc, ii, quadrant[5];
+
+        if (index < 0)
+            return -1;
+        node.size = nb->size / (float) (1 << level);
+        node.first = first;
+        node.count = count;
+        node.leaf = (count <= NBODY_LEAF_SIZE || level == NBODY_KEY_LEVELS);
+        node.x = node.y = node.mass = 0.0f;
+        node.child[0] = node.child[1] = node.child[2] = node.child[3] = -1;
+
+        if (node.leaf)
+        {
+            for (ii = first ; ii < first + count ; ++ii)
+            {
+                const int body = nb->order[ii];
+
+                nb->sx[ii] = nb->x[body];
+                nb->sy[ii] = nb->y[body];
+                nb->sm[ii] = (nb->mass != NULL) ? nb->mass[body] : 1.0f;
+                node.x += nb->sx[ii] * nb->sm[ii];
+                node.y += nb->sy[ii] * nb->sm[ii];
+                node.mass += nb->sm[ii];
+            }
+        }
+        else
+        {
+            const int shift = 2 * (NBODY_KEY_LEVELS - 1 - level);
+            int cursor[4];
+
+            /* stable counting sort on the 2 key bits of this level */
+            memset(quadrant, 0, sizeof(quadrant));
+            for (ii = first ; ii < first + count ; ++ii)
+                ++quadrant[1 + ((nb->sorted_keys[ii] >> shift) & 3u)];
+            quadrant[0] = first;
+            for (cc = 1 ; cc < 5 ; ++cc)
+                quadrant[cc] += quadrant[cc - 1];
+            memcpy(cursor, quadrant, sizeof(cursor));
+            for (ii = first ; ii < first + count ; ++ii)
+            {
+                const int pos = cursor[(nb->sorted_keys[ii] >> shift) & 3u]++;
+
+                nb->tmp_keys[pos] = nb->sorted_keys[ii];
+                nb->tmp_order[pos] = nb->order[ii];
+            }
+            memcpy(nb->sorted_keys + first, nb->tmp_keys + first, sizeof(unsigned) * (size_t) count);
+            memcpy(nb->order + first, nb->tmp_order + first, sizeof(int) * (size_t) count);
+
+            for (cc = 0 ; cc < 4 ; ++cc)
+            {
+                int child;
+
+                if (quadrant[cc + 1] == quadrant[cc])
+                    continue;
+                child = NBodyBuildNode(nb, tree, quadrant[cc], quadrant[cc + 1] - quadrant[cc], level + 1);
+                if (child < 0)
+                    return -1;
+                node.child[cc] = child;
+                node.x += tree->nodes[child].x * tree->nodes[child].mass;
+                node.y += tree->nodes[child].y * tree->nodes[child].mass;
+                node.mass += tree->nodes[child].mass;
+            }
+        }
+        if (node.mass > 0.0f)
+        {
+            node.x /= node.mass;
+            node.y /= node.mass;
+        }
+        tree->nodes[index] = node;
+        return index;
+    }
+
+    static void NBodySubtreeTask(void* ctx, int task, int worker)
+    {
+        NBody* nb = (NBody*) ctx;
+        NBodyNodes* tree = &nb->subtrees[task];
+        const int first = nb->cell_start[task];
+        const int count = nb->cell_start[task + 1] - first;
+
+        (void) worker;
+        tree->count = 0;
+        if (count > 0 && NBodyBuildNode(nb, tree, first, count, NBODY_TOP_LEVELS) < 0)
+            tree->count = -1;
+    }
+
+    /* Copy the subtree into the tree, its node 0 goes to subtree_base */
+    static void NBodyCopyTask(void* ctx, int task, int worker)
+    {
+        NBody* nb = (NBody*) ctx;
+        const NBodyNodes* tree = &nb->subtrees[task];
+        const int base = nb->subtree_base[task];
+        NBodyNode* dst = nb->nodes + base;
+        int ii, cc;
+
+        (void) worker;
+        for (ii = 0 ; ii < tree->count ; ++ii)
+        {
+            dst[ii] = tree->nodes[ii];
+            for (cc = 0 ; cc < 4 ; ++cc)
+                if (dst[ii].child[cc] >= 0)
+                    dst[ii].child[cc] += base;
+        }
+    }
+
+    /* Build the top node of the cells [cell, cell + 4^(NBODY_TOP_LEVELS -
+     * level)) at index, its descendants above the subtrees go after next.
+     * The subtree roots are read before they are copied.
+     */
+    static void NBodyBuildTop(NBody* nb, int index, int* next, int level, int cell)
+    {
+        const int span = 1 << (2 * (NBODY_TOP_LEVELS - 1 - level));
+        NBodyNode* node = &nb->nodes[index];
+        const NBodyNode* child;
+        int cc;
+
+        memset(node, 0, sizeof(*node));
+        node->size = nb->size / (float) (1 << level);
+        node->first = nb->cell_start[cell];
+        node->count = nb->cell_start[cell + 4 * span] - node->first;
+        for (cc = 0 ; cc < 4 ; ++cc)
+        {
+            const int sub = cell + cc * span;
+
+            node->child[cc] = -1;
+            if (nb->cell_start[sub + span] == nb->cell_start[sub])
+                continue;
+            if (level + 1 == NBODY_TOP_LEVELS)
+            {
+                node->child[cc] = nb->subtree_base[sub];
+                child = &nb->subtrees[sub].nodes[0];
+            }
+            else
+            {
+                node->child[cc] = (*next)++;
+                NBodyBuildTop(nb, node->child[cc], next, level + 1, sub);
+                child = &nb->nodes[node->child[cc]];
+            }
+            node->x += child->x * child->mass;
+            node->y += child->y * child->mass;
+            node->mass += child->mass;
+        }
+        if (node->mass > 0.0f)
+        {
+            node->x /= node->mass;
+            node->y /= node->mass;
+        }
+    }
+
+
+    /* Build the tree over bodies [0, count) at (x[i], y[i]), count is
+     * clamped to the capacity. mass may be NULL, all bodies then weigh 1.
+     * The arrays must stay unchanged until the forces are computed.
+     * Returns 0 when out of memory.
+     */
+    static int BuildNBodyTree(NBody* nb, WorkPool* pool, const float* x, const float* y,
+                              const float* mass, int count)
+    {
+        int num_chunks, num_top, cell, task, pos, ii;
+        float x1, y1;
+
+        nb->x = x;
+        nb->y = y;
+        nb->mass = mass;
+        nb->count = (count < nb->capacity) ? count : nb->capacity;
+        num_chunks = (nb->count + NBODY_CHUNK - 1) / NBODY_CHUNK;
+
+        /* square around the bodies, a bit larger so no key overflows */
+        nb->x0 = nb->y0 = 0.0f;
+        x1 = y1 = 1.0f;
+        if (num_chunks > 0)
+        {
+            RunWorkPool(pool, num_chunks, NBodyBoundsTask, nb);
+            nb->x0 = nb->chunk_bounds[0];
+            nb->y0 = nb->chunk_bounds[1];
+            x1 = nb->chunk_bounds[2];
+            y1 = nb->chunk_bounds[3];
+            for (task = 1 ; task < num_chunks ; ++task)
+            {
+                nb->x0 = fminf(nb->x0, nb->chunk_bounds[4 * task]);
+                nb->y0 = fminf(nb->y0, nb->chunk_bounds[4 * task + 1]);
+                x1 = fmaxf(x1, nb->chunk_bounds[4 * task + 2]);
+                y1 = fmaxf(y1, nb->chunk_bounds[4 * task + 3]);
+            }
+        }
+        nb->size = fmaxf(fmaxf(x1 - nb->x0, y1 - nb->y0) * 1.0001f, 1e-3f);
+
+        /* stable counting sort into the cells of the subtrees, task by
+         * task within a cell
+         */
+        RunWorkPool(pool, num_chunks, NBodyKeyTask, nb);
+        for (cell = 0, pos = 0 ; cell < NBODY_TOP_CELLS ; ++cell)
+        {
+            nb->cell_start[cell] = pos;
+            for (task = 0 ; task < num_chunks ; ++task)
+            {
+                const int num = nb->chunk_counts[NBODY_TOP_CELLS * task + cell];
+
+                nb->chunk_counts[NBODY_TOP_CELLS * task + cell] = pos;
+                pos += num;
+            }
+        }
+        nb->cell_start[NBODY_TOP_CELLS] = pos;
+        RunWorkPool(pool, num_chunks, NBodyScatterTask, nb);
+
+        RunWorkPool(pool, NBODY_TOP_CELLS, NBodySubtreeTask, nb);
+
+        /* top levels first, then the subtrees one after the other */
+        num_top = 0;
+        for (ii = 0 ; ii < NBODY_TOP_LEVELS ; ++ii)
+            num_top += 1 << (2 * ii);
+        nb->num_nodes = num_top;
+        for (cell = 0 ; cell < NBODY_TOP_CELLS ; ++cell)
+        {
+            if (nb->subtrees[cell].count < 0)
+                return 0;
+            nb->subtree_base[cell] = nb->num_nodes;
+            nb->num_nodes += nb->subtrees[cell].count;
+        }
+        if (nb->num_nodes > nb->max_nodes)
+        {
+            NBodyNode* nodes = (NBodyNode*) realloc(nb->nodes, sizeof(NBodyNode) * (size_t) nb->num_nodes);
+
+            if (nodes == NULL)
+                return 0;
+            nb->nodes = nodes;
+            nb->max_nodes = nb->num_nodes;
+        }
+        ii = 1;
+        NBodyBuildTop(nb, 0, &ii, 0, 0);
+        RunWorkPool(pool, NBODY_TOP_CELLS, NBodyCopyTask, nb);
+        return 1;
+    }
+
+
+    /**********************************************************************
+     * Summation kernels
+     *********************************************************************/
+
+    /* Pull of the n bodies at (x[j], y[j]) weighing m[j] (1 when m is NULL)
+     * on a body at (px, py), without gravity. Writes x and y to a.
+     */
+    typedef void (*NBodyKernel)(const float* x, const float* y, const float* m, int n,
+                                float px, float py, float eps2, float* a);
+
+    static NBodyKernel nbody_kernel = NULL;
+
+    static void NBodyKernelScalar(const float* x, const float* y, const float* m, int n,
+                                  float px, float py, float eps2, float* a)
+    {
+        float ax = 0.0f, ay = 0.0f;
+        int jj;
+
+        for (jj = 0 ; jj < n ; ++jj)
+        {
+            const float dx = x[jj] - px, dy = y[jj] - py;
+            const float d2 = dx * dx + dy * dy + eps2;
+            const float s = ((m != NULL) ? m[jj] : 1.0f) / (d2 * sqrtf(d2));
+
+            ax += dx * s;
+            ay += dy * s;
+        }
+        a[0] = ax;
+        a[1] = ay;
+    }
+
+#if SIMD_X86
+    /* 4 or 8 bodies at once, the bodies past the last full vector are
+     * summed one by one
+     */
+    __attribute__((target("sse2")))
+    static void NBodyKernelSSE2(const float* x, const float* y, const float* m, int n,
+                                float px, float py, float eps2, float* a)
+    {
+        const __m128 vpx = _mm_set1_ps(px), vpy = _mm_set1_ps(py);
+        const __m128 veps2 = _mm_set1_ps(eps2);
+        const __m128 one = _mm_set1_ps(1.0f);
+        __m128 vax = _mm_setzero_ps(), vay = _mm_setzero_ps();
+        float sum[4], tail[2];
+        int jj;
+
+        for (jj = 0 ; jj + 4 <= n ; jj += 4)
+        {
+            const __m128 dx = _mm_sub_ps(_mm_loadu_ps(x + jj), vpx);
+            const __m128 dy = _mm_sub_ps(_mm_loadu_ps(y + jj), vpy);
+            const __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), veps2);
+            const __m128 s = _mm_div_ps((m != NULL) ? _mm_loadu_ps(m + jj) : one,
+                                        _mm_mul_ps(d2, _mm_sqrt_ps(d2)));
+
+            vax = _mm_add_ps(vax, _mm_mul_ps(dx, s));
+            vay = _mm_add_ps(vay, _mm_mul_ps(dy, s));
+        }
+        NBodyKernelScalar(x + jj, y + jj, (m != NULL) ? m + jj : NULL, n - jj, px, py, eps2, tail);
+        _mm_storeu_ps(sum, vax);
+        a[0] = tail[0] + sum[0] + sum[1] + sum[2] + sum[3];
+        _mm_storeu_ps(sum, vay);
+        a[1] = tail[1] + sum[0] + sum[1] + sum[2] + sum[3];
+    }
+
+    __attribute__((target("avx2")))
+    static void NBodyKernelAVX2(const float* x, const float* y, const float* m, int n,
+                                float px, float py, float eps2, float* a)
+    {
+        const __m256 vpx = _mm256_set1_ps(px), vpy = _mm256_set1_ps(py);
+        const __m256 veps2 = _mm256_set1_ps(eps2);
+        const __m256 one = _mm256_set1_ps(1.0f);
+        __m256 vax = _mm256_setzero_ps(), vay = _mm256_setzero_ps();
+        __m128 hx, hy;
+        float sum[4], tail[2];
+        int jj;
+
+        for (jj = 0 ; jj + 8 <= n ; jj += 8)
+        {
+            const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + jj), vpx);
+            const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + jj), vpy);
+            const __m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), veps2);
+            const __m256 s = _mm256_div_ps((m != NULL) ? _mm256_loadu_ps(m + jj) : one,
+                                           _mm256_mul_ps(d2, _mm256_sqrt_ps(d2)));
+
+            vax = _mm256_add_ps(vax, _mm256_mul_ps(dx, s));
+            vay = _mm256_add_ps(vay, _mm256_mul_ps(dy, s));
+        }
+        NBodyKernelScalar(x + jj, y + jj, (m != NULL) ? m + jj : NULL, n - jj, px, py, eps2, tail);
+        hx = _mm_add_ps(_mm256_castps256_ps128(vax), _mm256_extractf128_ps(vax, 1));
+        hy = _mm_add_ps(_mm256_castps256_ps128(vay), _mm256_extractf128_ps(vay, 1));
+        _mm_storeu_ps(sum, hx);
+        a[0] = tail[0] + sum[0] + sum[1] + sum[2] + sum[3];
+        _mm_storeu_ps(sum, hy);
+        a[1] = tail[1] + sum[0] + sum[1] + sum[2] + sum[3];
+    }
+#endif
+
+
+    /* Select the summation kernel, used by the tree and the direct sum, at
+     * the level GetSimdLevel() gives simd, returns the level in use
+     */
+    static SimdLevel SetNBodySimd(SimdLevel simd)
+    {
+        SimdLevel level = GetSimdLevel(simd);
+
+        switch (level)
+        {
+#if SIMD_X86
+            case SIMD_AVX2: nbody_kernel = NBodyKernelAVX2; break;
+            case SIMD_SSE2: nbody_kernel = NBodyKernelSSE2; break;
+#endif
+            default: nbody_kernel = NBodyKernelScalar; break;
+        }
+        return level;
+    }
+
+
+    /**********************************************************************
+     * Forces
+     *********************************************************************/
+
+    /* Interaction list of a group, cells and bodies alike as point masses */
+    typedef struct NBodyList
+    {
+        float* x;
+        float* y;
+        float* m;
+        int count;
+        int capacity;
+    } NBodyList;
+
+    static int NBodyListAdd(NBodyList* list, float x, float y, float m)
+    {
+        if (list->count == list->capacity)
+        {
+            const int capacity = (list->capacity > 0) ? list->capacity * 2 : 1024;
+            float* data = (float*) malloc(sizeof(float) * 3 * (size_t) capacity);
+
+            if (data == NULL)
+                return 0;
+            if (list->count > 0)
+            {
+                memcpy(data, list->x, sizeof(float) * (size_t) list->count);
+                memcpy(data + capacity, list->y, sizeof(float) * (size_t) list->count);
+                memcpy(data + 2 * capacity, list->m, sizeof(float) * (size_t) list->count);
+            }
+            free(list->x);
+            list->x = data;
+            list->y = data + capacity;
+            list->m = data + 2 * capacity;
+            list->capacity = capacity;
+        }
+        list->x[list->count] = x;
+        list->y[list->count] = y;
+        list->m[list->count] = m;
+        ++list->count;
+        return 1;
+    }
+
+    /* Walk the tree once for the bodies [k0, k1) in tree order, which lie
+     * in the box (bx0, by0) - (bx1, by1). A cell is taken as a whole when
+     * it passes the opening test at its distance to the box, so it passes
+     * for every body in the group too.
+     */
+    static int NBodyGroupList(const NBody* nb, NBodyList* list, int k0, int k1)
+    {
+        const float theta2 = nb->theta * nb->theta;
+        float bx0 = nb->sx[k0], by0 = nb->sy[k0], bx1 = bx0, by1 = by0;
+        int stack[4 * NBODY_KEY_LEVELS + 4];
+        int kk, jj, top, cc;
+
+        for (kk = k0 + 1 ; kk < k1 ; ++kk)
+        {
+            bx0 = fminf(bx0, nb->sx[kk]);
+            by0 = fminf(by0, nb->sy[kk]);
+            bx1 = fmaxf(bx1, nb->sx[kk]);
+            by1 = fmaxf(by1, nb->sy[kk]);
+        }
+
+        list->count = 0;
+        top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const NBodyNode* node = &nb->nodes[stack[--top]];
+            const float dx = fmaxf(fmaxf(bx0 - node->x, node->x - bx1), 0.0f);
+            const float dy = fmaxf(fmaxf(by0 - node->y, node->y - by1), 0.0f);
+
+            if (node->mass == 0.0f)
+                continue;
+            if (node->size * node->size < theta2 * (dx * dx + dy * dy))
+            {
+                if (!NBodyListAdd(list, node->x, node->y, node->mass))
+                    return 0;
+            }
+            else if (node->leaf)
+            {
+                for (jj = node->first ; jj < node->first + node->count ; ++jj)
+                    if (!NBodyListAdd(list, nb->sx[jj], nb->sy[jj], nb->sm[jj]))
+                        return 0;
+            }
+            else
+            {
+                for (cc = 0 ; cc < 4 ; ++cc)
+                    if (node->child[cc] >= 0)
+                        stack[top++] = node->child[cc];
+            }
+        }
+        return 1;
+    }
+
+    static void NBodyForceTask(void* ctx, int task, int worker)
+    {
+        NBody* nb = (NBody*) ctx;
+        const int k0 = task * NBODY_CHUNK;
+        const int k1 = (k0 + NBODY_CHUNK < nb->count) ? k0 + NBODY_CHUNK : nb->count;
+        const float eps2 = nb->softening * nb->softening;
+        NBodyList list;
+        float a[2];
+        int g0, g1, kk;
+
+        (void) worker;
+        memset(&list, 0, sizeof(list));
+        for (g0 = k0 ; g0 < k1 ; g0 = g1)
+        {
+            g1 = (g0 + NBODY_GROUP_SIZE < k1) ? g0 + NBODY_GROUP_SIZE : k1;
+            if (!NBodyGroupList(nb, &list, g0, g1))
+            {
+                /* out of memory, the bodies get no pull */
+                for (kk = g0 ; kk < g1 ; ++kk)
+                    nb->ax[nb->order[kk]] = nb->ay[nb->order[kk]] = 0.0f;
+                continue;
+            }
+            for (kk = g0 ; kk < g1 ; ++kk)
+            {
+                nbody_kernel(list.x, list.y, list.m, list.count, nb->sx[kk], nb->sy[kk], eps2, a);
+                nb->ax[nb->order[kk]] = a[0] * nb->gravity;
+                nb->ay[nb->order[kk]] = a[1] * nb->gravity;
+            }
+        }
+        free(list.x);
+    }
+
+
+    /* Acceleration of every body of the last BuildNBodyTree(), ax and ay
+     * hold count floats each. Does nothing without a tree.
+     */
+    static void ComputeNBodyForces(NBody* nb, WorkPool* pool, float* ax, float* ay)
+    {
+        if (nb->num_nodes == 0)
+            return;
+        if (nbody_kernel == NULL)
+            SetNBodySimd(SIMD_AUTO);
+        nb->ax = ax;
+        nb->ay = ay;
+        RunWorkPool(pool, (nb->count + NBODY_CHUNK - 1) / NBODY_CHUNK, NBodyForceTask, nb);
+    }
+
+
+    /**********************************************************************
+     * Direct sum
+     *********************************************************************/
+
+    static void NBodyDirectTask(void* ctx, int task, int worker)
+    {
+        NBody* nb = (NBody*) ctx;
+        const int i0 = task * NBODY_DIRECT_CHUNK;
+        const int i1 = (i0 + NBODY_DIRECT_CHUNK < nb->count) ? i0 + NBODY_DIRECT_CHUNK : nb->count;
+        const float eps2 = nb->softening * nb->softening;
+        float a[2];
+        int ii;
+
+        (void) worker;
+        for (ii = i0 ; ii < i1 ; ++ii)
+        {
+            nbody_kernel(nb->x, nb->y, nb->mass, nb->count, nb->x[ii], nb->y[ii], eps2, a);
+            nb->ax[ii] = a[0] * nb->gravity;
+            nb->ay[ii] = a[1] * nb->gravity;
+        }
+    }
+
+
+    /* Exact acceleration of bodies [0, count) by the O(n^2) sum, the
+     * reference for ComputeNBodyForces(). mass may be NULL. Uses gravity and
+     * softening of nb, count is clamped to its capacity. The tree is
+     * dropped, build it again before ComputeNBodyForces().
+     */
+    static void ComputeNBodyDirect(NBody* nb, WorkPool* pool, const float* x, const float* y,
+                                   const float* mass, int count, float* ax, float* ay)
+    {
+        if (nbody_kernel == NULL)
+            SetNBodySimd(SIMD_AUTO);
+
+        nb->x = x;
+        nb->y = y;
+        nb->mass = mass;
+        nb->count = (count < nb->capacity) ? count : nb->capacity;
+        nb->num_nodes = 0;
+        nb->ax = ax;
+        nb->ay = ay;
+        RunWorkPool(pool, (nb->count + NBODY_DIRECT_CHUNK - 1) / NBODY_DIRECT_CHUNK, NBodyDirectTask, nb);
+    }
+
+#endif
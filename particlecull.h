@@ -0,0 +1,466 @@
+#ifndef GL_PARTICLECULL_H
+#define GL_PARTICLECULL_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* The vector kernels are picked at run time, include simdlevel.h first */
+
+/* Particles culled per worker pool task */
+#define PARTICLE_CULL_CHUNK 16384
+
+/**********************************************************************
+ * Screen-space particle culling
+ *********************************************************************/
+
+/* What happens to the particles smaller than min_size pixels on screen:
+ * drawn as they are, left out, or one drawn for all of those falling in
+ * the same min_size by min_size pixel cell
+ */
+typedef enum ParticleLod
+{
+    PARTICLE_LOD_KEEP = 0,
+    PARTICLE_LOD_DROP,
+    PARTICLE_LOD_MERGE
+} ParticleLod;
+
+/* Keeps the particles that end up on screen, packed for the renderer, so
+ * the vertex and fill cost follow what is visible instead of the total.
+ *
+ * A particle at (x, y) is a disc of radius world units, drawn by the
+ * vertex shader anywhere within margin of (x, y), e.g. the jiggle of the
+ * point_particle shaders. It is kept when that area overlaps the viewport
+ * under mvp, then its size on screen decides the level of detail. Both
+ * tests run in clip space without a division, 4 or 8 particles per
+ * instruction. The size in pixels assumes mvp scales x and y alike, as
+ * orthographic and perspective cameras do.
+ *
+ * CullParticles() compacts every PARTICLE_CULL_CHUNK particles on the
+ * worker pool into a staging array, in order, with per chunk counts. The
+ * caller maps that many particles and CopyCulledParticles() writes them
+ * out, so the mapped buffer is written once and never read. With worker
+ * threads merged particles claim their cell atomically, which one stands
+ * for a cell then depends on the thread timing.
+ *
+ * Include workpool.h first.
+ */
+typedef struct ParticleCull
+{
+    /* Set by the caller before culling: column major as for
+     * glUniformMatrix4fv() and the viewport size in pixels
+     */
+    float mvp[16];
+    float width;
+    float height;
+    float radius;
+    float margin;
+    float min_size;
+    ParticleLod lod;
+    /* Results of the last CullParticles() */
+    int visible;
+    int offscreen;
+    int subpixel;
+    int merged;
+    /* Staging and per chunk counts: kept, off screen, sub-pixel, merged */
+    int capacity;
+    float* compact;
+    int* chunk_counts;
+    int* chunk_offsets;
+    unsigned char* cells;
+    int cells_x;
+    int cells_y;
+    int num_cells;
+    int atomic;
+    /* Current job */
+    const float* x;
+    const float* y;
+    const float* period;
+    int count;
+    float* dst;
+    float bound_x;
+    float bound_y;
+    float size;
+    float cell_scale_x;
+    float cell_scale_y;
+} ParticleCull;
+
+    static int  InitParticleCull(ParticleCull* cull, int capacity);
+    static void FreeParticleCull(ParticleCull* cull);
+    static void SetParticleCullView(ParticleCull* cull, const float* mvp, float width, float height);
+    static int  CullParticles(ParticleCull* cull, WorkPool* pool, const float* x, const float* y,
+                              const float* period, int count);
+    static void CopyCulledParticles(ParticleCull* cull, WorkPool* pool, float* dst);
+    static SimdLevel SetParticleCullSimd(SimdLevel simd);
+
+
+#endif /* GL_PARTICLECULL_H */
+
+#if defined GL_PARTICLECULL_IMPLEMENTATION
+    /* implementation here */
+
+    /* Room for capacity particles, by default 5 units wide particles with
+     * sub-pixel ones dropped. Set the view before culling. Returns 0 when
+     * the allocation failed.
+     */
+    static int InitParticleCull(ParticleCull* cull, int capacity)
+    {
+        const int num_chunks = (capacity + PARTICLE_CULL_CHUNK - 1) / PARTICLE_CULL_CHUNK;
+
+        memset(cull, 0, sizeof(*cull));
+        cull->radius = 5.0f;
+        cull->min_size = 1.0f;
+        cull->lod = PARTICLE_LOD_DROP;
+        cull->capacity = capacity;
+        cull->compact = (float*) malloc(sizeof(float) * 3 * (size_t) capacity);
+        cull->chunk_counts = (int*) malloc(sizeof(int) * 4 * (size_t) num_chunks);
+        cull->chunk_offsets = (int*) malloc(sizeof(int) * (size_t) num_chunks);
+        if (cull->compact == NULL || cull->chunk_counts == NULL || cull->chunk_offsets == NULL)
+        {
+            FreeParticleCull(cull);
+            return 0;
+        }
+        return 1;
+    }
+
+
+    static void FreeParticleCull(ParticleCull* cull)
+    {
+        free(cull->compact);
+        free(cull->chunk_counts);
+        free(cull->chunk_offsets);
+        free(cull->cells);
+        memset(cull, 0, sizeof(*cull));
+    }
+
+
+    /* Cull against the transform and viewport the particles are drawn with */
+    static void SetParticleCullView(ParticleCull* cull, const float* mvp, float width, float height)
+    {
+        memcpy(cull->mvp, mvp, sizeof(cull->mvp));
+        cull->width = width;
+        cull->height = height;
+    }
+
+
+    /* Claim the cell of the sub-pixel particle at clip position (cx, cy, w),
+     * returns 1 if it is the first one there
+     */
+    static int ParticleCullClaimCell(ParticleCull* cull, float cx, float cy, float w)
+    {
+        int col = (int) ((cx / w + 1.0f) * cull->cell_scale_x);
+        int row = (int) ((cy / w + 1.0f) * cull->cell_scale_y);
+        unsigned char* cell;
+
+        col = (col < 0) ? 0 : (col < cull->cells_x) ? col : cull->cells_x - 1;
+        row = (row < 0) ? 0 : (row < cull->cells_y) ? row : cull->cells_y - 1;
+        cell = cull->cells + (size_t) row * (size_t) cull->cells_x + (size_t) col;
+        if (cull->atomic)
+            return __atomic_exchange_n(cell, (unsigned char) 1, __ATOMIC_RELAXED) == 0;
+        if (*cell != 0)
+            return 0;
+        *cell = 1;
+        return 1;
+    }
+
+
+    /**********************************************************************
+     * Cull kernels
+     *********************************************************************/
+
+    /* Cull particles [i0, i1) into out, counts receives kept, off screen,
+     * sub-pixel and merged particles
+     */
+    typedef void (*ParticleCullKernel)(ParticleCull* cull, int i0, int i1, float* out, int* counts);
+
+    static ParticleCullKernel particle_cull_kernel = NULL;
+
+    /* Decide about particle ii at clip position (cx, cy, w) known to be on
+     * screen, append it to out if it is drawn
+     */
+    static float* ParticleCullKeep(ParticleCull* cull, int ii, float cx, float cy, float w,
+                                   float* out, int* counts)
+    {
+        if (cull->size < cull->min_size * w)
+        {
+            ++counts[2];
+            if (cull->lod == PARTICLE_LOD_DROP)
+                return out;
+            if (cull->lod == PARTICLE_LOD_MERGE && !ParticleCullClaimCell(cull, cx, cy, w))
+            {
+                ++counts[3];
+                return out;
+            }
+        }
+        out[0] = cull->x[ii];
+        out[1] = cull->y[ii];
+        out[2] = cull->period[ii];
+        ++counts[0];
+        return out + 3;
+    }
+
+    static void ParticleCullKernelScalar(ParticleCull* cull, int i0, int i1, float* out, int* counts)
+    {
+        const float* m = cull->mvp;
+        int ii;
+
+        for (ii = i0 ; ii < i1 ; ++ii)
+        {
+            const float cx = m[0] * cull->x[ii] + m[4] * cull->y[ii] + m[12];
+            const float cy = m[1] * cull->x[ii] + m[5] * cull->y[ii] + m[13];
+            const float w = m[3] * cull->x[ii] + m[7] * cull->y[ii] + m[15];
+
+            if (w > 0.0f && fabsf(cx) <= w + cull->bound_x && fabsf(cy) <= w + cull->bound_y)
+                out = ParticleCullKeep(cull, ii, cx, cy, w, out, counts);
+            else
+                ++counts[1];
+        }
+    }
+
+#if SIMD_X86
+    /* Same as the scalar kernel. The on screen particles of full size are
+     * appended straight from the lane mask, only the sub-pixel ones go
+     * through ParticleCullKeep() unless they are all kept.
+     */
+    __attribute__((target("sse2")))
+    static void ParticleCullKernelSSE2(ParticleCull* cull, int i0, int i1, float* out, int* counts)
+    {
+        const float* m = cull->mvp;
+        const __m128 m0 = _mm_set1_ps(m[0]), m4 = _mm_set1_ps(m[4]), m12 = _mm_set1_ps(m[12]);
+        const __m128 m1 = _mm_set1_ps(m[1]), m5 = _mm_set1_ps(m[5]), m13 = _mm_set1_ps(m[13]);
+        const __m128 m3 = _mm_set1_ps(m[3]), m7 = _mm_set1_ps(m[7]), m15 = _mm_set1_ps(m[15]);
+        const __m128 bound_x = _mm_set1_ps(cull->bound_x), bound_y = _mm_set1_ps(cull->bound_y);
+        const __m128 size = _mm_set1_ps(cull->size), min_size = _mm_set1_ps(cull->min_size);
+        const __m128 sign = _mm_set1_ps(-0.0f), zero = _mm_setzero_ps();
+        const int keep_all = (cull->lod == PARTICLE_LOD_KEEP);
+        float cxs[4], cys[4], ws[4];
+        __m128 x, y, cx, cy, w, on, small;
+        int ii, on_mask, small_mask, lane;
+
+        for (ii = i0 ; ii + 4 <= i1 ; ii += 4)
+        {
+            x = _mm_loadu_ps(cull->x + ii);
+            y = _mm_loadu_ps(cull->y + ii);
+            cx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, x), _mm_mul_ps(m4, y)), m12);
+            cy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m1, x), _mm_mul_ps(m5, y)), m13);
+            w = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m3, x), _mm_mul_ps(m7, y)), m15);
+            on = _mm_and_ps(_mm_cmpgt_ps(w, zero),
+                            _mm_and_ps(_mm_cmple_ps(_mm_andnot_ps(sign, cx), _mm_add_ps(w, bound_x)),
+                                       _mm_cmple_ps(_mm_andnot_ps(sign, cy), _mm_add_ps(w, bound_y))));
+            small = _mm_and_ps(on, _mm_cmplt_ps(size, _mm_mul_ps(min_size, w)));
+            on_mask = _mm_movemask_ps(on);
+            small_mask = keep_all ? 0 : _mm_movemask_ps(small);
+            counts[1] += 4 - __builtin_popcount((unsigned) on_mask);
+            if (on_mask == 0)
+                continue;
+            if (small_mask != 0)
+            {
+                _mm_storeu_ps(cxs, cx);
+                _mm_storeu_ps(cys, cy);
+                _mm_storeu_ps(ws, w);
+            }
+            for ( ; on_mask != 0 ; on_mask &= on_mask - 1)
+            {
+                lane = __builtin_ctz((unsigned) on_mask);
+                if ((small_mask >> lane) & 1)
+                    out = ParticleCullKeep(cull, ii + lane, cxs[lane], cys[lane], ws[lane], out, counts);
+                else
+                {
+                    out[0] = cull->x[ii + lane];
+                    out[1] = cull->y[ii + lane];
+                    out[2] = cull->period[ii + lane];
+                    out += 3;
+                    ++counts[0];
+                }
+            }
+            if (keep_all)
+                counts[2] += __builtin_popcount((unsigned) _mm_movemask_ps(small));
+        }
+        ParticleCullKernelScalar(cull, ii, i1, out, counts);
+    }
+
+    __attribute__((target("avx2")))
+    static void ParticleCullKernelAVX2(ParticleCull* cull, int i0, int i1, float* out, int* counts)
+    {
+        const float* m = cull->mvp;
+        const __m256 m0 = _mm256_set1_ps(m[0]), m4 = _mm256_set1_ps(m[4]), m12 = _mm256_set1_ps(m[12]);
+        const __m256 m1 = _mm256_set1_ps(m[1]), m5 = _mm256_set1_ps(m[5]), m13 = _mm256_set1_ps(m[13]);
+        const __m256 m3 = _mm256_set1_ps(m[3]), m7 = _mm256_set1_ps(m[7]), m15 = _mm256_set1_ps(m[15]);
+        const __m256 bound_x = _mm256_set1_ps(cull->bound_x), bound_y = _mm256_set1_ps(cull->bound_y);
+        const __m256 size = _mm256_set1_ps(cull->size), min_size = _mm256_set1_ps(cull->min_size);
+        const __m256 sign = _mm256_set1_ps(-0.0f), zero = _mm256_setzero_ps();
+        const int keep_all = (cull->lod == PARTICLE_LOD_KEEP);
+        float cxs[8], cys[8], ws[8];
+        __m256 x, y, cx, cy, w, on, small;
+        int ii, on_mask, small_mask, lane;
+
+        for (ii = i0 ; ii + 8 <= i1 ; ii += 8)
+        {
+            x = _mm256_loadu_ps(cull->x + ii);
+            y = _mm256_loadu_ps(cull->y + ii);
+            cx = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m0, x), _mm256_mul_ps(m4, y)), m12);
+            cy = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m1, x), _mm256_mul_ps(m5, y)), m13);
+            w = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m3, x), _mm256_mul_ps(m7, y)), m15);
+            on = _mm256_and_ps(_mm256_cmp_ps(w, zero, _CMP_GT_OQ),
+                               _mm256_and_ps(_mm256_cmp_ps(_mm256_andnot_ps(sign, cx), _mm256_add_ps(w, bound_x), _CMP_LE_OQ),
+                                             _mm256_cmp_ps(_mm256_andnot_ps(sign, cy), _mm256_add_ps(w, bound_y), _CMP_LE_OQ)));
+            small = _mm256_and_ps(on, _mm256_cmp_ps(size, _mm256_mul_ps(min_size, w), _CMP_LT_OQ));
+            on_mask = _mm256_movemask_ps(on);
+            small_mask = keep_all ? 0 : _mm256_movemask_ps(small);
+            counts[1] += 8 - __builtin_popcount((unsigned) on_mask);
+            if (on_mask == 0)
+                continue;
+            if (small_mask != 0)
+            {
+                _mm256_storeu_ps(cxs, cx);
+                _mm256_storeu_ps(cys, cy);
+                _mm256_storeu_ps(ws, w);
+            }
+            for ( ; on_mask != 0 ; on_mask &= on_mask - 1)
+            {
+                lane = __builtin_ctz((unsigned) on_mask);
+                if ((small_mask >> lane) & 1)
+                    out = ParticleCullKeep(cull, ii + lane, cxs[lane], cys[lane], ws[lane], out, counts);
+                else
+                {
+                    out[0] = cull->x[ii + lane];
+                    out[1] = cull->y[ii + lane];
+                    out[2] = cull->period[ii + lane];
+                    out += 3;
+                    ++counts[0];
+                }
+            }
+            if (keep_all)
+                counts[2] += __builtin_popcount((unsigned) _mm256_movemask_ps(small));
+        }
+        ParticleCullKernelScalar(cull, ii, i1, out, counts);
+    }
+#endif
+
+
+    /* Select the cull kernel at the level GetSimdLevel() gives simd,
+     * returns the level in use
+     */
+    static SimdLevel SetParticleCullSimd(SimdLevel simd)
+    {
+        SimdLevel level = GetSimdLevel(simd);
+
+        switch (level)
+        {
+#if SIMD_X86
+            case SIMD_AVX2: particle_cull_kernel = ParticleCullKernelAVX2; break;
+            case SIMD_SSE2: particle_cull_kernel = ParticleCullKernelSSE2; break;
+#endif
+            default: particle_cull_kernel = ParticleCullKernelScalar; break;
+        }
+        return level;
+    }
+
+
+    /**********************************************************************
+     * Compaction
+     *********************************************************************/
+
+    static void ParticleCullTask(void* ctx, int task, int worker)
+    {
+        ParticleCull* cull = (ParticleCull*) ctx;
+        const int i0 = task * PARTICLE_CULL_CHUNK;
+        const int i1 = (i0 + PARTICLE_CULL_CHUNK < cull->count) ? i0 + PARTICLE_CULL_CHUNK : cull->count;
+        int* counts = cull->chunk_counts + 4 * task;
+
+        (void) worker;
+        counts[0] = counts[1] = counts[2] = counts[3] = 0;
+        particle_cull_kernel(cull, i0, i1, cull->compact + (size_t) 3 * i0, counts);
+    }
+
+    static void ParticleCullCopyTask(void* ctx, int task, int worker)
+    {
+        ParticleCull* cull = (ParticleCull*) ctx;
+
+        (void) worker;
+        memcpy(cull->dst + (size_t) 3 * cull->chunk_offsets[task],
+               cull->compact + (size_t) 3 * task * PARTICLE_CULL_CHUNK,
+               sizeof(float) * 3 * (size_t) cull->chunk_counts[4 * task]);
+    }
+
+
+    /* Cull particles [0, count) at (x[i], y[i]), count is clamped to the
+     * capacity. Returns how many are drawn, write them out with
+     * CopyCulledParticles() before culling again.
+     */
+    static int CullParticles(ParticleCull* cull, WorkPool* pool, const float* x, const float* y,
+                             const float* period, int count)
+    {
+        const float* m = cull->mvp;
+        float scale, cell;
+        int num_chunks, task;
+
+        if (particle_cull_kernel == NULL)
+            SetParticleCullSimd(SIMD_AUTO);
+
+        /* pixels per world unit at w = 1, the disc and motion bounds in clip
+         * units at w = 1 and the diameter test: 2 r scale < min_size w
+         */
+        scale = 0.5f * sqrtf(cull->width * m[0] * cull->width * m[0] + cull->height * m[1] * cull->height * m[1]);
+        cull->bound_x = 2.0f * scale / cull->width * (cull->radius + cull->margin);
+        cull->bound_y = 2.0f * scale / cull->height * (cull->radius + cull->margin);
+        cull->size = 2.0f * cull->radius * scale;
+
+        if (cull->lod == PARTICLE_LOD_MERGE)
+        {
+            cell = (cull->min_size > 1.0f) ? cull->min_size : 1.0f;
+            cull->cells_x = (int) ceilf(cull->width / cell);
+            cull->cells_y = (int) ceilf(cull->height / cell);
+            cull->cell_scale_x = 0.5f * cull->width / cell;
+            cull->cell_scale_y = 0.5f * cull->height / cell;
+            if (cull->cells_x * cull->cells_y > cull->num_cells)
+            {
+                free(cull->cells);
+                cull->num_cells = cull->cells_x * cull->cells_y;
+                cull->cells = (unsigned char*) malloc((size_t) cull->num_cells);
+                if (cull->cells == NULL)
+                {
+                    cull->num_cells = 0;
+                    cull->lod = PARTICLE_LOD_DROP;
+                }
+            }
+            if (cull->cells != NULL)
+                memset(cull->cells, 0, (size_t) cull->cells_x * (size_t) cull->cells_y);
+        }
+
+        cull->x = x;
+        cull->y = y;
+        cull->period = period;
+        cull->count = (count < cull->capacity) ? count : cull->capacity;
+        cull->atomic = (GetWorkPoolSize(pool) > 1);
+        num_chunks = (cull->count + PARTICLE_CULL_CHUNK - 1) / PARTICLE_CULL_CHUNK;
+        RunWorkPool(pool, num_chunks, ParticleCullTask, cull);
+
+        cull->visible = cull->offscreen = cull->subpixel = cull->merged = 0;
+        for (task = 0 ; task < num_chunks ; ++task)
+        {
+            const int* counts = cull->chunk_counts + 4 * task;
+
+            cull->chunk_offsets[task] = cull->visible;
+            cull->visible += counts[0];
+            cull->offscreen += counts[1];
+            cull->subpixel += counts[2];
+            cull->merged += counts[3];
+        }
+        return cull->visible;
+    }
+
+
+    /* Write the particles kept by the last CullParticles() to dst as x, y,
+     * period triplets, the layout of Particle in particlegl.h. dst holds 3 *
+     * visible floats, e.g. mapped with MapParticles().
+     */
+    static void CopyCulledParticles(ParticleCull* cull, WorkPool* pool, float* dst)
+    {
+        const int num_chunks = (cull->count + PARTICLE_CULL_CHUNK - 1) / PARTICLE_CULL_CHUNK;
+
+        cull->dst = dst;
+        RunWorkPool(pool, num_chunks, ParticleCullCopyTask, cull);
+    }
+
+#endif
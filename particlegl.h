@@ -0,0 +1,160 @@
+#ifndef GL_PARTICLEGL_H
+#define GL_PARTICLEGL_H
+
+#include <stdio.h>
+#include <string.h>
+
+/**********************************************************************
+ * Instanced particle renderer
+ *********************************************************************/
+
+/* Particle type, the layout of the vertexPosition attribute of the
+ * point_particle shaders
+ */
+typedef struct Particle {
+    float x;
+    float y;
+    float period;
+} Particle;
+
+/* Draws any number of particles as camera facing quads with one instanced
+ * draw call. The particles sit in a single GPU buffer read once per
+ * instance, the four corners of each quad come from gl_VertexID, so no
+ * per-vertex data is stored at all. The buffer is a stream buffer (see
+ * streambuf.h) that grows on demand, the count is only bound by GPU memory.
+ *
+ * Works with any program taking the particle as a per instance
+ * "vertexPosition" attribute, e.g. point_particle_instanced.vs/.fs, whose
+ * uniforms are set by the caller. Needs an OpenGL 3.3 context, include
+ * glstate.h and streambuf.h first.
+ */
+typedef struct ParticleRenderer
+{
+    GLuint vao;
+    GLuint attrloc;
+    StreamBuffer stream;
+    int capacity;
+    int count;
+    int mapped;
+} ParticleRenderer;
+
+    static int  CreateParticleRenderer(ParticleRenderer* renderer, GLuint program, int capacity);
+    static void DeleteParticleRenderer(ParticleRenderer* renderer);
+    static Particle* MapParticles(ParticleRenderer* renderer, int count);
+    static void UnmapParticles(ParticleRenderer* renderer);
+    static int  UploadParticles(ParticleRenderer* renderer, const Particle* particles, int count);
+    static void DrawParticles(const ParticleRenderer* renderer);
+
+
+#endif /* GL_PARTICLEGL_H */
+
+#if defined GL_PARTICLEGL_IMPLEMENTATION
+    /* implementation here */
+
+    /* Create the vertex array and a buffer for capacity particles, fed to the
+     * vertexPosition attribute of program. Returns 0 on failure.
+     */
+    static int CreateParticleRenderer(ParticleRenderer* renderer, GLuint program, int capacity)
+    {
+        GLint attrloc;
+
+        memset(renderer, 0, sizeof(*renderer));
+        attrloc = glGetAttribLocation(program, "vertexPosition");
+        if (attrloc < 0)
+        {
+            fprintf(stderr, "ERROR: Particle program has no vertexPosition attribute\n");
+            return 0;
+        }
+
+        if (!CreateStreamBuffer(&renderer->stream, GL_ARRAY_BUFFER, sizeof(Particle) * (size_t) capacity))
+            return 0;
+        renderer->attrloc = (GLuint) attrloc;
+        renderer->capacity = capacity;
+
+        glGenVertexArrays(1, &renderer->vao);
+        StateBindVertexArray(renderer->vao);
+        glEnableVertexAttribArray(renderer->attrloc);
+        glVertexAttribDivisor(renderer->attrloc, 1);
+        return 1;
+    }
+
+
+    static void DeleteParticleRenderer(ParticleRenderer* renderer)
+    {
+        DeleteStreamBuffer(&renderer->stream);
+        StateDeleteVertexArrays(1, &renderer->vao);
+        memset(renderer, 0, sizeof(*renderer));
+    }
+
+
+    /* Start replacing the particles drawn by DrawParticles() with count
+     * new ones, returns where to write them or NULL if the GPU is out of
+     * memory. The stream buffer is reallocated larger when count exceeds
+     * the capacity. Call UnmapParticles() once written.
+     */
+    static Particle* MapParticles(ParticleRenderer* renderer, int count)
+    {
+        Particle* particles;
+        GLintptr offset;
+
+        renderer->count = 0;
+        renderer->mapped = 0;
+        if (count > renderer->capacity)
+        {
+            DeleteStreamBuffer(&renderer->stream);
+            renderer->capacity = count + count / 2;
+            if (!CreateStreamBuffer(&renderer->stream, GL_ARRAY_BUFFER,
+                                    sizeof(Particle) * (size_t) renderer->capacity))
+                return NULL;
+        }
+
+        particles = (Particle*) MapStreamBuffer(&renderer->stream, sizeof(Particle) * (size_t) count, &offset);
+        if (particles == NULL)
+            return NULL;
+
+        StateBindVertexArray(renderer->vao);
+        StateBindBuffer(GL_ARRAY_BUFFER, renderer->stream.buffer);
+        glVertexAttribPointer(renderer->attrloc, 3, GL_FLOAT, GL_FALSE, sizeof(Particle), (void*) offset);
+
+        renderer->mapped = count;
+        return particles;
+    }
+
+
+    static void UnmapParticles(ParticleRenderer* renderer)
+    {
+        UnmapStreamBuffer(&renderer->stream);
+        renderer->count = renderer->mapped;
+        renderer->mapped = 0;
+    }
+
+
+    /* Replace the particles drawn by DrawParticles() with a copy of count
+     * particles. Returns 0 if the GPU is out of memory, nothing is drawn
+     * then.
+     */
+    static int UploadParticles(ParticleRenderer* renderer, const Particle* particles, int count)
+    {
+        Particle* dst = MapParticles(renderer, count);
+
+        if (dst == NULL)
+            return 0;
+        memcpy(dst, particles, sizeof(Particle) * (size_t) count);
+        UnmapParticles(renderer);
+        return 1;
+    }
+
+
+    /* Draw the uploaded particles, one 4 vertex triangle strip per particle,
+     * with the program currently in use
+     */
+    static void DrawParticles(const ParticleRenderer* renderer)
+    {
+        if (renderer->count <= 0)
+            return;
+
+        StateBindVertexArray(renderer->vao);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, renderer->count);
+    }
+
+#endif
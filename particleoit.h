@@ -0,0 +1,197 @@
+#ifndef GL_PARTICLEOIT_H
+#define GL_PARTICLEOIT_H
+
+/**********************************************************************
+ * Weighted blended order independent transparency
+ *********************************************************************/
+
+/* Transparent particles drawn in any order blend to the same picture, so
+ * millions of them need no depth sort (McGuire and Bavoil, weighted
+ * blended OIT). Between BeginParticleOIT() and EndParticleOIT() the
+ * particles go to two offscreen targets:
+ *
+ *   accum   RGBA16F  rgb: sum of color * alpha * weight
+ *                    a:   product of (1 - alpha), the revealage
+ *   weight  R16F     r:   sum of alpha * weight
+ *
+ * Both use the same blend function, additive for color and multiplicative
+ * for alpha, which an OpenGL 3.3 context can set for all draw buffers at
+ * once. EndParticleOIT() composites the weighted average color over the
+ * framebuffer given to BeginParticleOIT(), with coverage 1 - revealage, so
+ * whatever was drawn there before (e.g. the rlgl batch) shows through.
+ *
+ * The particle fragment shader writes the two targets, see
+ * point_particle_oit.fs. Half floats overflow past 65504, so the weight of
+ * a fragment has to stay small enough for the depth complexity expected
+ * (an overflow makes the composite inf / inf). There is no depth buffer,
+ * the particles are not hidden by opaque geometry. Needs an OpenGL 3.3
+ * context, include glstate.h and glutil.h first.
+ */
+typedef struct ParticleOIT
+{
+    int width;
+    int height;
+    GLuint fbo;
+    GLuint accum;
+    GLuint weight;
+    GLuint composite_program;
+    GLuint vao;
+    /* State saved by BeginParticleOIT(), as the state cache knew it */
+    GLuint saved_fbo;
+    GLuint saved_blend;
+    GLuint saved_depth_test;
+    GLuint saved_blend_func[4];
+} ParticleOIT;
+
+    static int  CreateParticleOIT(ParticleOIT* oit, int width, int height);
+    static void DeleteParticleOIT(ParticleOIT* oit);
+    static void BeginParticleOIT(ParticleOIT* oit, GLuint framebuffer);
+    static void EndParticleOIT(ParticleOIT* oit);
+
+
+#endif /* GL_PARTICLEOIT_H */
+
+#if defined GL_PARTICLEOIT_IMPLEMENTATION
+    /* implementation here */
+
+    /* Full screen triangle */
+    static const char* particleoit_composite_vs_text =
+    "#version 330\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);\n"
+    "    gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);\n"
+    "}\n";
+
+    /* Weighted average color and its revealage, blended with
+     * (1 - src alpha, src alpha)
+     */
+    static const char* particleoit_composite_fs_text =
+    "#version 330\n"
+    "uniform sampler2D accum;\n"
+    "uniform sampler2D weight;\n"
+    "out vec4 finalColor;\n"
+    "void main()\n"
+    "{\n"
+    "    ivec2 c = ivec2(gl_FragCoord.xy);\n"
+    "    vec4 a = texelFetch(accum, c, 0);\n"
+    "    if (a.a >= 1.0)\n"
+    "        discard;\n"
+    "    float w = texelFetch(weight, c, 0).r;\n"
+    "    finalColor = vec4(a.rgb / max(w, 1e-5), a.a);\n"
+    "}\n";
+
+
+    static GLuint ParticleOITTarget(GLenum internal_format, GLenum format, int width, int height)
+    {
+        GLuint texture;
+
+        glGenTextures(1, &texture);
+        StateBindTexture(0, GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, (GLint) internal_format, width, height, 0, format, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        return texture;
+    }
+
+
+    /* Create the targets for a width x height framebuffer and the
+     * composite program. Returns 0 on failure.
+     */
+    static int CreateParticleOIT(ParticleOIT* oit, int width, int height)
+    {
+        static const GLenum draw_buffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        GLenum status;
+
+        memset(oit, 0, sizeof(*oit));
+        oit->width = width;
+        oit->height = height;
+
+        oit->composite_program = CreateShaderProgram(particleoit_composite_vs_text, particleoit_composite_fs_text);
+        if (oit->composite_program == 0u)
+            return 0;
+        StateUseProgram(oit->composite_program);
+        glUniform1i(glGetUniformLocation(oit->composite_program, "accum"), 0);
+        glUniform1i(glGetUniformLocation(oit->composite_program, "weight"), 1);
+        glGenVertexArrays(1, &oit->vao);
+
+        oit->accum = ParticleOITTarget(GL_RGBA16F, GL_RGBA, width, height);
+        oit->weight = ParticleOITTarget(GL_R16F, GL_RED, width, height);
+        glGenFramebuffers(1, &oit->fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, oit->fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, oit->accum, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, oit->weight, 0);
+        glDrawBuffers(2, draw_buffers);
+        status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (status != GL_FRAMEBUFFER_COMPLETE)
+        {
+            fprintf(stderr, "ERROR: Particle OIT framebuffer incomplete (0x%x)\n", status);
+            DeleteParticleOIT(oit);
+            return 0;
+        }
+        return 1;
+    }
+
+
+    static void DeleteParticleOIT(ParticleOIT* oit)
+    {
+        glDeleteFramebuffers(1, &oit->fbo);
+        StateDeleteTextures(1, &oit->accum);
+        StateDeleteTextures(1, &oit->weight);
+        StateDeleteVertexArrays(1, &oit->vao);
+        glDeleteProgram(oit->composite_program);
+        memset(oit, 0, sizeof(*oit));
+    }
+
+
+    /* Clear the targets and send the following draws to them, framebuffer
+     * is the one bound now and composited into. The blend and depth test
+     * state EndParticleOIT() restores is taken from the state cache without
+     * asking GL, set it through the cache before (e.g. again after
+     * InvalidateGLState()). What the cache does not know is not restored.
+     */
+    static void BeginParticleOIT(ParticleOIT* oit, GLuint framebuffer)
+    {
+        static const GLfloat clear_accum[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+        static const GLfloat clear_weight[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+        oit->saved_fbo = framebuffer;
+        oit->saved_blend = gl_state.blend;
+        oit->saved_depth_test = gl_state.depth_test;
+        memcpy(oit->saved_blend_func, gl_state.blend_func, sizeof(oit->saved_blend_func));
+
+        glBindFramebuffer(GL_FRAMEBUFFER, oit->fbo);
+        glClearBufferfv(GL_COLOR, 0, clear_accum);
+        glClearBufferfv(GL_COLOR, 1, clear_weight);
+        StateEnable(GL_DEPTH_TEST, GL_FALSE);
+        StateEnable(GL_BLEND, GL_TRUE);
+        StateBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+    }
+
+
+    /* Composite the particles drawn since BeginParticleOIT() over the saved
+     * framebuffer and restore the saved state. Leaves the composite program,
+     * its vertex array and the targets on units 0 and 1 bound.
+     */
+    static void EndParticleOIT(ParticleOIT* oit)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, oit->saved_fbo);
+        StateBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
+
+        StateUseProgram(oit->composite_program);
+        StateBindTexture(1, GL_TEXTURE_2D, oit->weight);
+        StateBindTexture(0, GL_TEXTURE_2D, oit->accum);
+        StateBindVertexArray(oit->vao);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        if (oit->saved_blend_func[0] != GLSTATE_UNKNOWN)
+            StateBlendFuncSeparate(oit->saved_blend_func[0], oit->saved_blend_func[1],
+                                   oit->saved_blend_func[2], oit->saved_blend_func[3]);
+        if (oit->saved_blend != GLSTATE_UNKNOWN)
+            StateEnable(GL_BLEND, (GLboolean) oit->saved_blend);
+        if (oit->saved_depth_test != GLSTATE_UNKNOWN)
+            StateEnable(GL_DEPTH_TEST, (GLboolean) oit->saved_depth_test);
+    }
+
+#endif
@@ -0,0 +1,568 @@
+#ifndef GL_PARTICLES_H
+#define GL_PARTICLES_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef M_PI
+ #define M_PI 3.14159265358979323846
+#endif
+
+/* The vector kernels are picked at run time, include simdlevel.h first */
+
+/* Particles updated per worker pool task */
+#define PARTICLE_CHUNK 16384
+
+/* Most emitters per particle system */
+#define PARTICLE_MAX_EMITTERS 16
+
+/**********************************************************************
+ * CPU particle engine
+ *********************************************************************/
+
+/* Spawns rate particles per second at (x, y), moving at speed_min to
+ * speed_max units per second in a direction within spread radians around
+ * angle. Each lives life_min to life_max seconds; period is passed on to
+ * the renderer (the animation period of the point_particle shaders).
+ */
+typedef struct ParticleEmitter
+{
+    float x;
+    float y;
+    float rate;
+    float angle;
+    float spread;
+    float speed_min;
+    float speed_max;
+    float life_min;
+    float life_max;
+    float period_min;
+    float period_max;
+    float accumulator;
+    unsigned seed;
+} ParticleEmitter;
+
+/* Refers to one particle for its whole life, whatever index it moves to.
+ * A handle of a particle that died is stale and never matches a particle
+ * again; 0 is never a valid handle.
+ */
+typedef unsigned long long ParticleHandle;
+
+/* Particles stored as one array per attribute so the update kernels run
+ * over plain float streams, 4 or 8 particles per instruction. The live
+ * particles are always packed in [0, count): a particle older than its
+ * life is removed by moving the last one into its slot, so the order
+ * changes but nothing is ever scanned for free slots.
+ *
+ * Each particle also owns a handle slot, popped from a free-list when it
+ * spawns and pushed back with its generation bumped when it dies. The
+ * slot knows the particle index and follows it when it moves. Nothing is
+ * allocated after InitParticleSystem().
+ *
+ * Every live particle is accelerated by (gravity_x, gravity_y) and its
+ * velocity decays by drag per second.
+ */
+typedef struct ParticleSystem
+{
+    int capacity;
+    int count;
+    float* x;
+    float* y;
+    float* vx;
+    float* vy;
+    float* age;
+    float* life;
+    float* period;
+    float gravity_x;
+    float gravity_y;
+    float drag;
+    ParticleEmitter emitters[PARTICLE_MAX_EMITTERS];
+    int num_emitters;
+    /* Dead particles found by the update, PARTICLE_CHUNK entries per task */
+    int* dead;
+    int* chunk_dead;
+    /* Handle slot of every particle, particle index and generation of
+     * every slot and the stack of free slots
+     */
+    int* slot_of;
+    int* index_of;
+    unsigned* generation;
+    int* free_slots;
+    int num_free;
+    unsigned long spawned;
+    unsigned long expired;
+} ParticleSystem;
+
+    static int  InitParticleSystem(ParticleSystem* ps, int capacity);
+    static void FreeParticleSystem(ParticleSystem* ps);
+    static int  AddParticleEmitter(ParticleSystem* ps, const ParticleEmitter* emitter);
+    static void UpdateParticleSystem(ParticleSystem* ps, WorkPool* pool, float dt);
+    static ParticleHandle SpawnParticle(ParticleSystem* ps, float x, float y, float vx, float vy,
+                                        float life, float period);
+    static int  DespawnParticle(ParticleSystem* ps, ParticleHandle handle);
+    static int  GetParticleIndex(const ParticleSystem* ps, ParticleHandle handle);
+    static void PackParticles(const ParticleSystem* ps, WorkPool* pool, float* dst);
+    static SimdLevel SetParticleSimd(SimdLevel simd);
+
+
+#endif /* GL_PARTICLES_H */
+
+#if defined GL_PARTICLES_IMPLEMENTATION
+    /* implementation here */
+
+    /**********************************************************************
+     * Particle system life cycle
+     *********************************************************************/
+
+    /* Allocate room for capacity particles, the system starts empty with
+     * no forces and no emitters. Returns 0 when the allocation failed.
+     */
+    static int InitParticleSystem(ParticleSystem* ps, int capacity)
+    {
+        const int num_chunks = (capacity + PARTICLE_CHUNK - 1) / PARTICLE_CHUNK;
+        const size_t n = (size_t) capacity;
+        int ii;
+
+        memset(ps, 0, sizeof(*ps));
+        if (capacity <= 0)
+            return 0;
+
+        /* all attributes share one block */
+        ps->x = (float*) malloc(sizeof(float) * 7 * n);
+        ps->dead = (int*) malloc(sizeof(int) * (size_t) num_chunks * PARTICLE_CHUNK);
+        ps->chunk_dead = (int*) calloc((size_t) num_chunks, sizeof(int));
+        ps->slot_of = (int*) malloc(sizeof(int) * 3 * n);
+        ps->generation = (unsigned*) malloc(sizeof(unsigned) * n);
+        if (ps->x == NULL || ps->dead == NULL || ps->chunk_dead == NULL ||
+            ps->slot_of == NULL || ps->generation == NULL)
+        {
+            FreeParticleSystem(ps);
+            return 0;
+        }
+        ps->y = ps->x + n;
+        ps->vx = ps->y + n;
+        ps->vy = ps->vx + n;
+        ps->age = ps->vy + n;
+        ps->life = ps->age + n;
+        ps->period = ps->life + n;
+        ps->index_of = ps->slot_of + n;
+        ps->free_slots = ps->index_of + n;
+
+        /* pushed backwards so the first spawns take the first slots */
+        for (ii = 0 ; ii < capacity ; ++ii)
+        {
+            ps->index_of[ii] = -1;
+            ps->generation[ii] = 1u;
+            ps->free_slots[ii] = capacity - 1 - ii;
+        }
+        ps->num_free = capacity;
+        ps->capacity = capacity;
+        return 1;
+    }
+
+
+    static void FreeParticleSystem(ParticleSystem* ps)
+    {
+        free(ps->x);
+        free(ps->dead);
+        free(ps->chunk_dead);
+        free(ps->slot_of);
+        free(ps->generation);
+        memset(ps, 0, sizeof(*ps));
+    }
+
+
+    /* Copy emitter into the system, a zero seed is replaced by one derived
+     * from the emitter index. Returns the emitter index, -1 when full.
+     */
+    static int AddParticleEmitter(ParticleSystem* ps, const ParticleEmitter* emitter)
+    {
+        ParticleEmitter* e;
+
+        if (ps->num_emitters >= PARTICLE_MAX_EMITTERS)
+            return -1;
+        e = &ps->emitters[ps->num_emitters];
+        *e = *emitter;
+        if (e->seed == 0u)
+            e->seed = 2463534242u + 7919u * (unsigned) ps->num_emitters;
+        return ps->num_emitters++;
+    }
+
+
+    /**********************************************************************
+     * Update kernels
+     *********************************************************************/
+
+    /* Integrate particles [i0, i1) over dt and write the indices of the
+     * ones past their life to dead, returns how many. params holds
+     * gravity_x * dt, gravity_y * dt, the velocity decay over dt and dt.
+     */
+    typedef int (*ParticleKernel)(ParticleSystem* ps, int i0, int i1,
+                                  const float* params, int* dead);
+
+    static ParticleKernel particle_kernel = NULL;
+
+    static int ParticleKernelScalar(ParticleSystem* ps, int i0, int i1,
+                                    const float* params, int* dead)
+    {
+        const float gx = params[0], gy = params[1], decay = params[2], dt = params[3];
+        int num_dead = 0;
+        int ii;
+
+        for (ii = i0 ; ii < i1 ; ++ii)
+        {
+            ps->vx[ii] = ps->vx[ii] * decay + gx;
+            ps->vy[ii] = ps->vy[ii] * decay + gy;
+            ps->x[ii] += ps->vx[ii] * dt;
+            ps->y[ii] += ps->vy[ii] * dt;
+            ps->age[ii] += dt;
+            if (ps->age[ii] >= ps->life[ii])
+                dead[num_dead++] = ii;
+        }
+        return num_dead;
+    }
+
+#if SIMD_X86
+    /* The vector kernels compare age and life for a whole vector and only
+     * look at single particles when the movemask says one of them died.
+     */
+    __attribute__((target("sse2")))
+    static int ParticleKernelSSE2(ParticleSystem* ps, int i0, int i1,
+                                  const float* params, int* dead)
+    {
+        const __m128 vgx = _mm_set1_ps(params[0]);
+        const __m128 vgy = _mm_set1_ps(params[1]);
+        const __m128 vdecay = _mm_set1_ps(params[2]);
+        const __m128 vdt = _mm_set1_ps(params[3]);
+        __m128 vx, vy, age;
+        int num_dead = 0;
+        int ii, mask;
+
+        for (ii = i0 ; ii + 4 <= i1 ; ii += 4)
+        {
+            vx = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(ps->vx + ii), vdecay), vgx);
+            vy = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(ps->vy + ii), vdecay), vgy);
+            _mm_storeu_ps(ps->vx + ii, vx);
+            _mm_storeu_ps(ps->vy + ii, vy);
+            _mm_storeu_ps(ps->x + ii, _mm_add_ps(_mm_loadu_ps(ps->x + ii), _mm_mul_ps(vx, vdt)));
+            _mm_storeu_ps(ps->y + ii, _mm_add_ps(_mm_loadu_ps(ps->y + ii), _mm_mul_ps(vy, vdt)));
+            age = _mm_add_ps(_mm_loadu_ps(ps->age + ii), vdt);
+            _mm_storeu_ps(ps->age + ii, age);
+
+            mask = _mm_movemask_ps(_mm_cmpge_ps(age, _mm_loadu_ps(ps->life + ii)));
+            while (mask != 0)
+            {
+                dead[num_dead++] = ii + __builtin_ctz((unsigned) mask);
+                mask &= mask - 1;
+            }
+        }
+        return num_dead + ParticleKernelScalar(ps, ii, i1, params, dead + num_dead);
+    }
+
+    __attribute__((target("avx2")))
+    static int ParticleKernelAVX2(ParticleSystem* ps, int i0, int i1,
+                                  const float* params, int* dead)
+    {
+        const __m256 vgx = _mm256_set1_ps(params[0]);
+        const __m256 vgy = _mm256_set1_ps(params[1]);
+        const __m256 vdecay = _mm256_set1_ps(params[2]);
+        const __m256 vdt = _mm256_set1_ps(params[3]);
+        __m256 vx, vy, age;
+        int num_dead = 0;
+        int ii, mask;
+
+        for (ii = i0 ; ii + 8 <= i1 ; ii += 8)
+        {
+            vx = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(ps->vx + ii), vdecay), vgx);
+            vy = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(ps->vy + ii), vdecay), vgy);
+            _mm256_storeu_ps(ps->vx + ii, vx);
+            _mm256_storeu_ps(ps->vy + ii, vy);
+            _mm256_storeu_ps(ps->x + ii, _mm256_add_ps(_mm256_loadu_ps(ps->x + ii), _mm256_mul_ps(vx, vdt)));
+            _mm256_storeu_ps(ps->y + ii, _mm256_add_ps(_mm256_loadu_ps(ps->y + ii), _mm256_mul_ps(vy, vdt)));
+            age = _mm256_add_ps(_mm256_loadu_ps(ps->age + ii), vdt);
+            _mm256_storeu_ps(ps->age + ii, age);
+
+            mask = _mm256_movemask_ps(_mm256_cmp_ps(age, _mm256_loadu_ps(ps->life + ii), _CMP_GE_OQ));
+            while (mask != 0)
+            {
+                dead[num_dead++] = ii + __builtin_ctz((unsigned) mask);
+                mask &= mask - 1;
+            }
+        }
+        return num_dead + ParticleKernelScalar(ps, ii, i1, params, dead + num_dead);
+    }
+#endif
+
+
+    /* Select the update kernel at the level GetSimdLevel() gives simd,
+     * returns the level in use
+     */
+    static SimdLevel SetParticleSimd(SimdLevel simd)
+    {
+        SimdLevel level = GetSimdLevel(simd);
+
+        switch (level)
+        {
+#if SIMD_X86
+            case SIMD_AVX2: particle_kernel = ParticleKernelAVX2; break;
+            case SIMD_SSE2: particle_kernel = ParticleKernelSSE2; break;
+#endif
+            default: particle_kernel = ParticleKernelScalar; break;
+        }
+        return level;
+    }
+
+
+    /**********************************************************************
+     * Simulation
+     *********************************************************************/
+
+    typedef struct ParticleJob
+    {
+        ParticleSystem* ps;
+        float* dst;
+        float params[4];
+    } ParticleJob;
+
+    static void ParticleUpdateTask(void* ctx, int task, int worker)
+    {
+        ParticleJob* job = (ParticleJob*) ctx;
+        ParticleSystem* ps = job->ps;
+        const int i0 = task * PARTICLE_CHUNK;
+        const int i1 = (i0 + PARTICLE_CHUNK < ps->count) ? i0 + PARTICLE_CHUNK : ps->count;
+
+        (void) worker;
+        ps->chunk_dead[task] = particle_kernel(ps, i0, i1, job->params,
+                                               ps->dead + (size_t) task * PARTICLE_CHUNK);
+    }
+
+    static void ParticleMove(ParticleSystem* ps, int dst, int src)
+    {
+        ps->x[dst] = ps->x[src];
+        ps->y[dst] = ps->y[src];
+        ps->vx[dst] = ps->vx[src];
+        ps->vy[dst] = ps->vy[src];
+        ps->age[dst] = ps->age[src];
+        ps->life[dst] = ps->life[src];
+        ps->period[dst] = ps->period[src];
+        ps->slot_of[dst] = ps->slot_of[src];
+        ps->index_of[ps->slot_of[dst]] = dst;
+    }
+
+    /* Give the handle slot of particle ii back, its handle goes stale */
+    static void ParticleFreeSlot(ParticleSystem* ps, int ii)
+    {
+        const int slot = ps->slot_of[ii];
+
+        ps->index_of[slot] = -1;
+        ++ps->generation[slot];
+        if (ps->generation[slot] == 0u)
+            ps->generation[slot] = 1u;
+        ps->free_slots[ps->num_free++] = slot;
+    }
+
+    /* Particle ii is new, give it a handle slot */
+    static void ParticleTakeSlot(ParticleSystem* ps, int ii)
+    {
+        const int slot = ps->free_slots[--ps->num_free];
+
+        ps->slot_of[ii] = slot;
+        ps->index_of[slot] = ii;
+    }
+
+    /* Remove the num_dead particles listed in ascending order in dead. Each
+     * dead slot takes the last live particle, dead particles at the end are
+     * just dropped, so the cost is in the number of dead particles only.
+     */
+    static void CompactParticles(ParticleSystem* ps, const int* dead, int num_dead)
+    {
+        int lo = 0, hi = num_dead - 1;
+        int last = ps->count;
+
+        while (lo <= hi)
+        {
+            --last;
+            if (last == dead[hi])
+            {
+                ParticleFreeSlot(ps, last);
+                --hi;
+            }
+            else
+            {
+                ParticleFreeSlot(ps, dead[lo]);
+                ParticleMove(ps, dead[lo++], last);
+            }
+        }
+        ps->count = last;
+        ps->expired += (unsigned long) num_dead;
+    }
+
+    /* xorshift32, uniform in [lo, hi] */
+    static float ParticleRandom(unsigned* seed, float lo, float hi)
+    {
+        unsigned s = *seed;
+
+        s ^= s << 13;
+        s ^= s >> 17;
+        s ^= s << 5;
+        *seed = s;
+        return lo + (hi - lo) * (float) (s >> 8) * (1.0f / 16777216.0f);
+    }
+
+    /* Spawn the particles every emitter owes for dt, as many as fit */
+    static void EmitParticles(ParticleSystem* ps, float dt)
+    {
+        int ee, num, ii;
+
+        for (ee = 0 ; ee < ps->num_emitters ; ++ee)
+        {
+            ParticleEmitter* e = &ps->emitters[ee];
+
+            e->accumulator += e->rate * dt;
+            num = (int) e->accumulator;
+            e->accumulator -= (float) num;
+            if (num > ps->capacity - ps->count)
+                num = ps->capacity - ps->count;
+
+            for (ii = ps->count ; ii < ps->count + num ; ++ii)
+            {
+                const float a = e->angle + ParticleRandom(&e->seed, -0.5f, 0.5f) * e->spread;
+                const float speed = ParticleRandom(&e->seed, e->speed_min, e->speed_max);
+
+                ps->x[ii] = e->x;
+                ps->y[ii] = e->y;
+                ps->vx[ii] = cosf(a) * speed;
+                ps->vy[ii] = sinf(a) * speed;
+                ps->age[ii] = 0.0f;
+                ps->life[ii] = ParticleRandom(&e->seed, e->life_min, e->life_max);
+                ps->period[ii] = ParticleRandom(&e->seed, e->period_min, e->period_max);
+                ParticleTakeSlot(ps, ii);
+            }
+            ps->count += num;
+            ps->spawned += (unsigned long) num;
+        }
+    }
+
+
+    /* Advance every particle by dt seconds on the worker pool, remove the
+     * expired ones, then let the emitters spawn new ones.
+     */
+    static void UpdateParticleSystem(ParticleSystem* ps, WorkPool* pool, float dt)
+    {
+        const int num_chunks = (ps->count + PARTICLE_CHUNK - 1) / PARTICLE_CHUNK;
+        ParticleJob job;
+        int task, num_dead;
+
+        if (particle_kernel == NULL)
+            SetParticleSimd(SIMD_AUTO);
+
+        job.ps = ps;
+        job.dst = NULL;
+        job.params[0] = ps->gravity_x * dt;
+        job.params[1] = ps->gravity_y * dt;
+        job.params[2] = expf(-ps->drag * dt);
+        job.params[3] = dt;
+        if (num_chunks > 0)
+            RunWorkPool(pool, num_chunks, ParticleUpdateTask, &job);
+
+        /* gather the per task lists, they are ascending and in task order */
+        num_dead = 0;
+        for (task = 0 ; task < num_chunks ; ++task)
+        {
+            memmove(ps->dead + num_dead, ps->dead + (size_t) task * PARTICLE_CHUNK,
+                    sizeof(int) * (size_t) ps->chunk_dead[task]);
+            num_dead += ps->chunk_dead[task];
+        }
+        CompactParticles(ps, ps->dead, num_dead);
+
+        EmitParticles(ps, dt);
+    }
+
+
+    /* Spawn one particle, for effects that keep track of single particles.
+     * Returns its handle, 0 when the system is full.
+     */
+    static ParticleHandle SpawnParticle(ParticleSystem* ps, float x, float y, float vx, float vy,
+                                        float life, float period)
+    {
+        const int ii = ps->count;
+
+        if (ii >= ps->capacity)
+            return 0u;
+        ps->x[ii] = x;
+        ps->y[ii] = y;
+        ps->vx[ii] = vx;
+        ps->vy[ii] = vy;
+        ps->age[ii] = 0.0f;
+        ps->life[ii] = life;
+        ps->period[ii] = period;
+        ParticleTakeSlot(ps, ii);
+        ++ps->count;
+        ++ps->spawned;
+        return ((ParticleHandle) ps->generation[ps->slot_of[ii]] << 32) | (ParticleHandle) ps->slot_of[ii];
+    }
+
+
+    /* Kill the particle of handle right away, the last particle takes its
+     * index. Returns 0 when the handle is stale.
+     */
+    static int DespawnParticle(ParticleSystem* ps, ParticleHandle handle)
+    {
+        const int ii = GetParticleIndex(ps, handle);
+
+        if (ii < 0)
+            return 0;
+        ParticleFreeSlot(ps, ii);
+        if (ii != --ps->count)
+            ParticleMove(ps, ii, ps->count);
+        ++ps->expired;
+        return 1;
+    }
+
+
+    /* Current index of the particle of handle in the attribute arrays, -1
+     * when the handle is stale. The index changes when particles die.
+     */
+    static int GetParticleIndex(const ParticleSystem* ps, ParticleHandle handle)
+    {
+        const unsigned long long slot = handle & 0xFFFFFFFFull;
+
+        if (slot >= (unsigned long long) ps->capacity || ps->generation[slot] != (unsigned) (handle >> 32))
+            return -1;
+        return ps->index_of[slot];
+    }
+
+
+    static void ParticlePackTask(void* ctx, int task, int worker)
+    {
+        ParticleJob* job = (ParticleJob*) ctx;
+        const ParticleSystem* ps = job->ps;
+        const int i0 = task * PARTICLE_CHUNK;
+        const int i1 = (i0 + PARTICLE_CHUNK < ps->count) ? i0 + PARTICLE_CHUNK : ps->count;
+        float* dst = job->dst + (size_t) 3 * i0;
+        int ii;
+
+        (void) worker;
+        for (ii = i0 ; ii < i1 ; ++ii, dst += 3)
+        {
+            dst[0] = ps->x[ii];
+            dst[1] = ps->y[ii];
+            dst[2] = ps->period[ii];
+        }
+    }
+
+    /* Write the live particles to dst as x, y, period triplets, the layout
+     * of Particle in particlegl.h. dst holds 3 * count floats.
+     */
+    static void PackParticles(const ParticleSystem* ps, WorkPool* pool, float* dst)
+    {
+        ParticleJob job;
+
+        job.ps = (ParticleSystem*) ps;
+        job.dst = dst;
+        if (ps->count > 0)
+            RunWorkPool(pool, (ps->count + PARTICLE_CHUNK - 1) / PARTICLE_CHUNK, ParticlePackTask, &job);
+    }
+
+#endif
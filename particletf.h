@@ -0,0 +1,342 @@
+#ifndef GL_PARTICLETF_H
+#define GL_PARTICLETF_H
+
+/* Most particles spawned per UpdateParticleTF() call */
+#ifndef PARTICLETF_MAX_SPAWN
+ #define PARTICLETF_MAX_SPAWN 65536
+#endif
+
+/* Position of a dead particle, far outside any view so it is clipped.
+ * Written by the update shader as well.
+ */
+#define PARTICLETF_DEAD_POSITION (-1.0e7f)
+
+/**********************************************************************
+ * GPU transform feedback particle simulation
+ *********************************************************************/
+
+/* A new particle, queued with SpawnParticleTF(). period is the animation
+ * period of the point_particle shaders.
+ */
+typedef struct ParticleSpawn
+{
+    float x;
+    float y;
+    float vx;
+    float vy;
+    float life;
+    float period;
+} ParticleSpawn;
+
+/* The particle state lives in two buffers of capacity particles, each one
+ * x, y, period, vx, vy, age, life. Every update runs the particles of one
+ * buffer through a vertex shader into the other one with transform
+ * feedback and rasterization off, so the state never goes through the CPU.
+ * The first three floats are the vertexPosition of the point_particle
+ * shaders and DrawParticleTF() feeds them straight from the buffer.
+ *
+ * Slots are not compacted: a dead particle moves to
+ * PARTICLETF_DEAD_POSITION and is clipped. Spawned particles take the
+ * slots after the last spawned ones, round the buffer, so the capacity
+ * has to cover spawn rate times the longest life. The only upload per
+ * frame is the spawn buffer, a texture buffer the update reads the new
+ * particles from.
+ *
+ * Needs an OpenGL 3.3 context, include glstate.h and glutil.h first.
+ */
+typedef struct ParticleTF
+{
+    int capacity;
+    int current;
+    int cursor;
+    int num_spawn;
+    float* spawn;
+    GLuint state[2];
+    GLuint update_vao[2];
+    GLuint draw_vao[2];
+    GLuint spawn_buffer;
+    GLuint spawn_texture;
+    GLuint update_program;
+    GLint uloc_gravity;
+    GLint uloc_decay;
+    GLint uloc_dt;
+    GLint uloc_spawn_first;
+    GLint uloc_spawn_count;
+    float gravity_x;
+    float gravity_y;
+    float drag;
+} ParticleTF;
+
+    static int  CreateParticleTF(ParticleTF* tf, GLuint draw_program, int capacity);
+    static void DeleteParticleTF(ParticleTF* tf);
+    static int  SpawnParticleTF(ParticleTF* tf, const ParticleSpawn* spawn);
+    static void UpdateParticleTF(ParticleTF* tf, float dt);
+    static void DrawParticleTF(const ParticleTF* tf);
+
+
+#endif /* GL_PARTICLETF_H */
+
+#if defined GL_PARTICLETF_IMPLEMENTATION
+    /* implementation here */
+
+    /**********************************************************************
+     * Shader programs
+     *********************************************************************/
+
+    /* One step for every slot. Slot i takes spawn (i - spawn_first) modulo
+     * the capacity when that is below spawn_count, two texels per spawn.
+     * Dead slots are copied as they are.
+     */
+    static const char* particletf_update_vs_text =
+    "#version 330\n"
+    "layout(location = 0) in vec3 inPosition;\n"
+    "layout(location = 1) in vec4 inState;\n"
+    "uniform vec2 gravity;\n"
+    "uniform float decay;\n"
+    "uniform float dt;\n"
+    "uniform int capacity;\n"
+    "uniform int spawn_first;\n"
+    "uniform int spawn_count;\n"
+    "uniform samplerBuffer spawn;\n"
+    "out vec3 outPosition;\n"
+    "out vec4 outState;\n"
+    "void main()\n"
+    "{\n"
+    "    int k = gl_VertexID - spawn_first;\n"
+    "    if (k < 0)\n"
+    "        k += capacity;\n"
+    "    if (k < spawn_count)\n"
+    "    {\n"
+    "        vec4 a = texelFetch(spawn, 2 * k);\n"
+    "        vec4 b = texelFetch(spawn, 2 * k + 1);\n"
+    "        outPosition = vec3(a.xy, b.y);\n"
+    "        outState = vec4(a.zw, 0.0, b.x);\n"
+    "        return;\n"
+    "    }\n"
+    "    outPosition = inPosition;\n"
+    "    outState = inState;\n"
+    "    if (inState.z >= inState.w)\n"
+    "        return;\n"
+    "    vec2 v = inState.xy * decay + gravity * dt;\n"
+    "    float age = inState.z + dt;\n"
+    "    outPosition = vec3(inPosition.xy + v * dt, inPosition.z);\n"
+    "    outState = vec4(v, age, inState.w);\n"
+    "    if (age >= inState.w)\n"
+    "        outPosition.xy = vec2(-1.0e7);\n"
+    "}\n";
+
+    static const char* particletf_update_fs_text =
+    "#version 330\n"
+    "out vec4 color;\n"
+    "void main()\n"
+    "{\n"
+    "    color = vec4(0.0);\n"
+    "}\n";
+
+
+    /**********************************************************************
+     * Particle simulation life cycle
+     *********************************************************************/
+
+    /* Create both state buffers with every slot dead, the spawn buffer and
+     * the update program. draw_program is the program DrawParticleTF() is
+     * used with, its vertexPosition attribute gets the particles. Returns 0
+     * on failure.
+     */
+    static int CreateParticleTF(ParticleTF* tf, GLuint draw_program, int capacity)
+    {
+        static const char* varyings[] = { "outPosition", "outState" };
+        const size_t stride = 7 * sizeof(float);
+        GLint attrloc, program_ok;
+        GLuint vertex_shader, fragment_shader;
+        float* init;
+        int ii;
+
+        memset(tf, 0, sizeof(*tf));
+        attrloc = glGetAttribLocation(draw_program, "vertexPosition");
+        if (capacity <= 0 || attrloc < 0)
+        {
+            fprintf(stderr, "ERROR: Particle program has no vertexPosition attribute\n");
+            return 0;
+        }
+
+        vertex_shader = CreateShader(GL_VERTEX_SHADER, particletf_update_vs_text);
+        fragment_shader = CreateShader(GL_FRAGMENT_SHADER, particletf_update_fs_text);
+        if (vertex_shader == 0u || fragment_shader == 0u)
+        {
+            glDeleteShader(vertex_shader);
+            glDeleteShader(fragment_shader);
+            return 0;
+        }
+
+        /* the varyings are captured in the order of the state layout, they
+         * have to be known before linking
+         */
+        tf->update_program = glCreateProgram();
+        glAttachShader(tf->update_program, vertex_shader);
+        glAttachShader(tf->update_program, fragment_shader);
+        glTransformFeedbackVaryings(tf->update_program, 2, varyings, GL_INTERLEAVED_ATTRIBS);
+        glLinkProgram(tf->update_program);
+        glDeleteShader(vertex_shader);
+        glDeleteShader(fragment_shader);
+        glGetProgramiv(tf->update_program, GL_LINK_STATUS, &program_ok);
+        if (program_ok != GL_TRUE)
+        {
+            char info_log[8192];
+
+            glGetProgramInfoLog(tf->update_program, 8192, NULL, info_log);
+            fprintf(stderr, "ERROR, failed to link particle update program\n%s\n", info_log);
+            DeleteParticleTF(tf);
+            return 0;
+        }
+        tf->uloc_gravity = glGetUniformLocation(tf->update_program, "gravity");
+        tf->uloc_decay = glGetUniformLocation(tf->update_program, "decay");
+        tf->uloc_dt = glGetUniformLocation(tf->update_program, "dt");
+        tf->uloc_spawn_first = glGetUniformLocation(tf->update_program, "spawn_first");
+        tf->uloc_spawn_count = glGetUniformLocation(tf->update_program, "spawn_count");
+        StateUseProgram(tf->update_program);
+        glUniform1i(glGetUniformLocation(tf->update_program, "spawn"), 0);
+        glUniform1i(glGetUniformLocation(tf->update_program, "capacity"), capacity);
+
+        init = (float*) malloc(stride * (size_t) capacity);
+        tf->spawn = (float*) malloc(8 * sizeof(float) * PARTICLETF_MAX_SPAWN);
+        if (init == NULL || tf->spawn == NULL)
+        {
+            free(init);
+            DeleteParticleTF(tf);
+            return 0;
+        }
+        for (ii = 0 ; ii < capacity ; ++ii)
+        {
+            float* p = init + 7 * (size_t) ii;
+            p[0] = p[1] = PARTICLETF_DEAD_POSITION;
+            p[2] = p[3] = p[4] = p[6] = 0.0f;
+            p[5] = 1.0f;
+        }
+
+        glGenBuffers(2, tf->state);
+        glGenVertexArrays(2, tf->update_vao);
+        glGenVertexArrays(2, tf->draw_vao);
+        for (ii = 0 ; ii < 2 ; ++ii)
+        {
+            StateBindBuffer(GL_ARRAY_BUFFER, tf->state[ii]);
+            glBufferData(GL_ARRAY_BUFFER, stride * (size_t) capacity, init, GL_DYNAMIC_COPY);
+
+            StateBindVertexArray(tf->update_vao[ii]);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, (GLsizei) stride, (void*) 0);
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, (GLsizei) stride, (void*) (3 * sizeof(float)));
+
+            StateBindVertexArray(tf->draw_vao[ii]);
+            glEnableVertexAttribArray((GLuint) attrloc);
+            glVertexAttribPointer((GLuint) attrloc, 3, GL_FLOAT, GL_FALSE, (GLsizei) stride, (void*) 0);
+            glVertexAttribDivisor((GLuint) attrloc, 1);
+        }
+        free(init);
+
+        /* a spawn is two RGBA32F texels: (x, y, vx, vy) and (life, period) */
+        glGenBuffers(1, &tf->spawn_buffer);
+        StateBindBuffer(GL_TEXTURE_BUFFER, tf->spawn_buffer);
+        glBufferData(GL_TEXTURE_BUFFER, 8 * sizeof(float) * PARTICLETF_MAX_SPAWN, NULL, GL_STREAM_DRAW);
+        glGenTextures(1, &tf->spawn_texture);
+        StateBindTexture(0, GL_TEXTURE_BUFFER, tf->spawn_texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, tf->spawn_buffer);
+
+        tf->capacity = capacity;
+        if (glGetError() == GL_OUT_OF_MEMORY)
+        {
+            DeleteParticleTF(tf);
+            return 0;
+        }
+        return 1;
+    }
+
+
+    static void DeleteParticleTF(ParticleTF* tf)
+    {
+        glDeleteProgram(tf->update_program);
+        StateDeleteVertexArrays(2, tf->update_vao);
+        StateDeleteVertexArrays(2, tf->draw_vao);
+        StateDeleteBuffers(2, tf->state);
+        StateDeleteTextures(1, &tf->spawn_texture);
+        StateDeleteBuffers(1, &tf->spawn_buffer);
+        free(tf->spawn);
+        memset(tf, 0, sizeof(*tf));
+    }
+
+
+    /**********************************************************************
+     * Simulation
+     *********************************************************************/
+
+    /* Queue a particle for the next update. Returns 0 when
+     * PARTICLETF_MAX_SPAWN particles are queued already.
+     */
+    static int SpawnParticleTF(ParticleTF* tf, const ParticleSpawn* spawn)
+    {
+        float* texels = tf->spawn + 8 * (size_t) tf->num_spawn;
+
+        if (tf->num_spawn >= PARTICLETF_MAX_SPAWN || tf->num_spawn >= tf->capacity)
+            return 0;
+        texels[0] = spawn->x;
+        texels[1] = spawn->y;
+        texels[2] = spawn->vx;
+        texels[3] = spawn->vy;
+        texels[4] = spawn->life;
+        texels[5] = spawn->period;
+        texels[6] = texels[7] = 0.0f;
+        ++tf->num_spawn;
+        return 1;
+    }
+
+
+    /* Advance every particle by dt seconds into the other state buffer and
+     * place the queued spawns. Leaves the update program, its vertex array
+     * and the spawn texture on unit 0 bound.
+     */
+    static void UpdateParticleTF(ParticleTF* tf, float dt)
+    {
+        const int next = tf->current ^ 1;
+
+        if (tf->num_spawn > 0)
+        {
+            /* orphan, the previous update may still read the spawn buffer */
+            StateBindBuffer(GL_TEXTURE_BUFFER, tf->spawn_buffer);
+            glBufferData(GL_TEXTURE_BUFFER, 8 * sizeof(float) * PARTICLETF_MAX_SPAWN, NULL, GL_STREAM_DRAW);
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, 8 * sizeof(float) * (size_t) tf->num_spawn, tf->spawn);
+        }
+
+        StateUseProgram(tf->update_program);
+        glUniform2f(tf->uloc_gravity, tf->gravity_x, tf->gravity_y);
+        glUniform1f(tf->uloc_decay, expf(-tf->drag * dt));
+        glUniform1f(tf->uloc_dt, dt);
+        glUniform1i(tf->uloc_spawn_first, tf->cursor);
+        glUniform1i(tf->uloc_spawn_count, tf->num_spawn);
+        StateBindTexture(0, GL_TEXTURE_BUFFER, tf->spawn_texture);
+
+        glEnable(GL_RASTERIZER_DISCARD);
+        StateBindVertexArray(tf->update_vao[tf->current]);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, tf->state[next]);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, tf->capacity);
+        glEndTransformFeedback();
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+        glDisable(GL_RASTERIZER_DISCARD);
+
+        tf->cursor = (tf->cursor + tf->num_spawn) % tf->capacity;
+        tf->num_spawn = 0;
+        tf->current = next;
+    }
+
+
+    /* Draw every slot of the current state as an instanced quad, with the
+     * program currently in use
+     */
+    static void DrawParticleTF(const ParticleTF* tf)
+    {
+        StateBindVertexArray(tf->draw_vao[tf->current]);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, tf->capacity);
+    }
+
+#endif
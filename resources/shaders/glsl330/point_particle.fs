@@ -2,10 +2,11 @@
 
 // Input uniform values
 uniform vec4 color;
+// Per frame uniforms shared by all programs: mvp, uTime, uResolution (frameuniforms.h)
+#include "frame_uniforms.glsl"
 
 // Output fragment color
 out vec4 finalColor;
-uniform float currentTime;
 
 // NOTE: Add here your custom variables
 
@@ -16,7 +17,7 @@ void main()
     // Draw each point as a colored circle with alpha 1.0 in the center and 0.0 at the outer edges.
     
     vec3 ctmp = vec3(0.);
-    ctmp = vec3(1.0, 0.5, abs(sin(currentTime)));
+    ctmp = vec3(1.0, 0.5, abs(sin(uTime)));
 
     //gl_FragColor = vec4(color.rgb,1.0);
     finalColor = vec4(ctmp.rgb, length(gl_PointCoord.xy - vec2(0.5)) );
@@ -5,8 +5,8 @@ in vec3 vertexPosition;
 
 // Input uniform values
 //uniform vec3 vertex_position;
-uniform mat4 mvp;
-uniform float currentTime;
+// Per frame uniforms shared by all programs: mvp, uTime, uResolution (frameuniforms.h)
+#include "frame_uniforms.glsl"
 
 // NOTE: Add here your custom variables
 
@@ -17,9 +17,9 @@ void main()
     float period = vertexPosition.z;
 
     // Calculate final vertex position (jiggle it around a bit horizontally)
-    pos += vec2(100, 0) * sin(period * currentTime);
+    pos += vec2(100, 0) * sin(period * uTime);
     gl_Position = mvp * vec4(pos, 0.0, 1.0);
 
     // Calculate the screen space size of this particle (also vary it over time)
-    gl_PointSize = 10 - 5 * abs(sin(period * currentTime));
+    gl_PointSize = 10 - 5 * abs(sin(period * uTime));
 }
@@ -0,0 +1,25 @@
+#version 330
+
+// Input vertex attributes (from vertex shader)
+in vec2 pointCoord;
+
+// Input uniform values
+uniform vec4 color;
+// Per frame uniforms shared by all programs: mvp, uTime, uResolution (frameuniforms.h)
+#include "frame_uniforms.glsl"
+
+// Output fragment color
+out vec4 finalColor;
+
+// NOTE: Add here your custom variables
+
+void main()
+{
+    // Each particle is drawn as a screen space square quad. pointCoord contains where we are inside of
+    // it, like gl_PointCoord does for points. (0, 0) is the top left, (1, 1) the bottom right corner.
+
+    vec3 ctmp = vec3(0.);
+    ctmp = vec3(1.0, 0.5, abs(sin(uTime)));
+
+    finalColor = vec4(ctmp.rgb, length(pointCoord.xy - vec2(0.5)) );
+}
@@ -0,0 +1,34 @@
+#version 330
+
+// Input vertex attributes, one per particle (instance)
+in vec3 vertexPosition;
+
+// Per frame uniforms shared by all programs: mvp, uTime, uResolution (frameuniforms.h)
+#include "frame_uniforms.glsl"
+
+// Output vertex attributes (to fragment shader)
+out vec2 pointCoord;
+
+// NOTE: Add here your custom variables
+
+void main()
+{
+    // Unpack data from vertexPosition
+    vec2  pos    = vertexPosition.xy;
+    float period = vertexPosition.z;
+
+    // Calculate final vertex position (jiggle it around a bit horizontally)
+    pos += vec2(100, 0) * sin(period * uTime);
+    gl_Position = mvp * vec4(pos, 0.0, 1.0);
+
+    // Calculate the screen space size of this particle (also vary it over time)
+    float pointSize = 10 - 5 * abs(sin(period * uTime));
+
+    // Corner of the quad of this vertex, the 4 vertices of an instance form a triangle strip.
+    // Offset it in pixels like a point sprite of pointSize pixels would be.
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    gl_Position.xy += (corner - 0.5) * pointSize * 2.0 / uResolution * gl_Position.w;
+
+    // Same convention as gl_PointCoord: (0, 0) is the top left, (1, 1) the bottom right corner
+    pointCoord = vec2(corner.x, 1.0 - corner.y);
+}
@@ -0,0 +1,30 @@
+#version 330
+
+// Input vertex attributes (from vertex shader)
+in vec2 pointCoord;
+
+// Input uniform values
+uniform vec4 color;
+// Per frame uniforms shared by all programs: mvp, uTime, uResolution (frameuniforms.h)
+#include "frame_uniforms.glsl"
+
+// Output to the weighted blended OIT targets (see particleoit.h)
+layout(location = 0) out vec4 accum;
+layout(location = 1) out float weight;
+
+// NOTE: Add here your custom variables
+
+void main()
+{
+    // Same color and alpha as point_particle_instanced.fs
+    vec3 ctmp = vec3(1.0, 0.5, abs(sin(uTime)));
+    float alpha = length(pointCoord.xy - vec2(0.5));
+
+    // Nearer particles weigh more, the depth weight function of McGuire and Bavoil
+    // scaled down by 100: a layer adds at most ~21 to the half float targets, so
+    // ~3000 layers fit before they overflow (every layer is nearest under ortho)
+    float w = alpha * clamp(30.0 * pow(1.0 - gl_FragCoord.z, 3.0), 1e-2, 30.0);
+
+    accum = vec4(ctmp * alpha * w, alpha);
+    weight = alpha * w;
+}
@@ -13,18 +13,41 @@
 *
 ********************************************************************************************
 *
-*   Mixes raylib and plain OpenGL code to draw a GL_POINTS based particle system. The
+*   Mixes raylib and plain OpenGL code to draw an instanced quad based particle system. The
 *   primary point is to demonstrate raylib and OpenGL interop.
 *
+*   The number of particles is the first command line argument (default 100000), they are
+*   drawn with one instanced draw call from a single buffer (see particlegl.h). With --cpu
+*   as second argument the particles are simulated by the CPU particle engine (particles.h)
+*   instead: fountains emit them, gravity pulls them down, they expire and are replaced.
+*   With --gpu the same fountains are simulated on the GPU with transform feedback
+*   (particletf.h), only the newly emitted particles are uploaded. --oit, alone or after
+*   --cpu/--gpu, blends the particles with weighted blended order independent transparency
+*   (particleoit.h) and composites them over the rlgl drawn content. --separate, after --cpu,
+*   makes close particles push each other apart, their neighbours are found with a spatial
+*   hash (spatialhash.h) rebuilt every frame. --nbody, after --cpu, makes all particles
+*   attract each other, summed with a Barnes-Hut quadtree (nbody.h). --cull, after --cpu,
+*   uploads and draws only the particles that can reach the screen (particlecull.h).
+*
+*   Linked programs are saved in the shadercache directory (glutil.h), later launches load
+*   them instead of compiling the shaders again. Time, viewport size and matrices are shared
+*   by all programs through one uniform buffer written once per frame (frameuniforms.h), the
+*   shaders include it with #include "frame_uniforms.glsl".
+*
 *   rlgl batched draw operations internally so we have to flush the current batch before
 *   doing our own OpenGL work (rlDrawRenderBatchActive()).
 *
+*   Our own bindings and blend/depth state go through a cache (glstate.h) that drops calls
+*   setting what is already set. The batch rlgl draws changes them behind the cache's back,
+*   so the cache is invalidated right after the flush. Redundant calls are counted per kind.
+*
 *   The example also demonstrates how to get the current model view projection matrix of
 *   raylib. That way raylib cameras and so on work as expected.
 *
 ********************************************************************************************/
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "raylib.h"
 /*
@@ -55,14 +78,40 @@
 #include <GL/glew.h>
 #include "GLFW/glfw3.h"         // Windows/Context and inputs management
 
-#define MAX_PARTICLES       999
+#define GL_WORKPOOL_IMPLEMENTATION
+#include "workpool.h"       // Required for: CreateWorkPool()
+#define GL_SIMDLEVEL_IMPLEMENTATION
+#include "simdlevel.h"      // Required for: GetSimdLevel()
+#define GL_PARTICLES_IMPLEMENTATION
+#include "particles.h"      // Required for: UpdateParticleSystem(), PackParticles()
+#define GL_SPATIALHASH_IMPLEMENTATION
+#include "spatialhash.h"    // Required for: BuildSpatialHash(), ForEachNeighbour()
+#define GL_NBODY_IMPLEMENTATION
+#include "nbody.h"          // Required for: BuildNBodyTree(), ComputeNBodyForces()
+#define GL_PARTICLECULL_IMPLEMENTATION
+#include "particlecull.h"   // Required for: CullParticles(), CopyCulledParticles()
+#define GL_STATE_IMPLEMENTATION
+#include "glstate.h"        // Required for: InvalidateGLState(), StateUseProgram(), PrintGLStateStats()
+#define GL_STREAMBUF_IMPLEMENTATION
+#include "streambuf.h"      // Required for: InitStreamBuffers()
+#define GL_FRAMEUNIFORMS_IMPLEMENTATION
+#include "frameuniforms.h"  // Required for: CreateFrameUniforms(), WriteFrameUniforms(), IncludeFrameUniforms()
+#define GL_PARTICLEGL_IMPLEMENTATION
+#include "particlegl.h"     // Required for: Particle, CreateParticleRenderer(), DrawParticles()
+#define GL_UTIL_IMPLEMENTATION
+#include "glutil.h"         // Required for: CreateShaderProgram(), InitProgramCache()
+#define GL_PARTICLETF_IMPLEMENTATION
+#include "particletf.h"     // Required for: UpdateParticleTF(), DrawParticleTF()
+#define GL_PARTICLEOIT_IMPLEMENTATION
+#include "particleoit.h"    // Required for: BeginParticleOIT(), EndParticleOIT()
 
-// Particle type
-typedef struct Particle {
-    float x;
-    float y;
-    float period;
-} Particle;
+#define DEFAULT_PARTICLES   100000
+#define NUM_FOUNTAINS       4
+#define SEPARATION_RADIUS   4.0f        // Particles closer than this push each other apart
+#define SEPARATION_STRENGTH 2000.0f     // Push at zero distance, units per second squared
+#define NBODY_PULL          8.0e6f      // All particles together pull this hard at distance 1
+#define JIGGLE_DISTANCE     100.0f      // Farthest point_particle_instanced.vs moves a particle
+#define PROGRAM_CACHE_DIR   "shadercache"
 
 GLFWwindow *window;
 static void ErrorCallback(int error, const char *description)
@@ -70,6 +119,79 @@ static void ErrorCallback(int error, const char *description)
     fprintf(stderr, "%s", description);
 }
 
+// Command line option after the particle count
+static int HasOption(int argc, char **argv, const char *option)
+{
+    for (int i = 2; i < argc; i++) if (strcmp(argv[i], option) == 0) return 1;
+    return 0;
+}
+
+// Separation of the CPU simulated particles, the velocity of every particle is pushed away
+// from its neighbours. Only reads positions, so the particles are processed in parallel.
+typedef struct Separation {
+    ParticleSystem *system;
+    const SpatialHash *hash;
+    float dt;
+} Separation;
+
+static void SeparationPush(void *ctx, int i, int j, float dx, float dy, float dist2)
+{
+    float *push = (float *)ctx;
+    float dist = sqrtf(dist2);
+
+    if (dist > 0.0f)
+    {
+        push[0] -= dx/dist*(1.0f - dist/SEPARATION_RADIUS);
+        push[1] -= dy/dist*(1.0f - dist/SEPARATION_RADIUS);
+    }
+}
+
+static void SeparationTask(void *ctx, int task, int worker)
+{
+    Separation *job = (Separation *)ctx;
+    int first = task*PARTICLE_CHUNK;
+    int last = (first + PARTICLE_CHUNK < job->system->count)? first + PARTICLE_CHUNK : job->system->count;
+
+    for (int i = first; i < last; i++)
+    {
+        float push[2] = { 0.0f, 0.0f };
+        ForEachNeighbour(job->hash, i, SEPARATION_RADIUS, SeparationPush, push);
+        job->system->vx[i] += push[0]*SEPARATION_STRENGTH*job->dt;
+        job->system->vy[i] += push[1]*SEPARATION_STRENGTH*job->dt;
+    }
+}
+
+// LoadShader() through the program binary cache of glutil.h, the sources are only compiled
+// when no binary saved by an earlier run matches them and the driver. The shaders may include
+// the per frame uniform block (frameuniforms.h), it is read from the frame uniform buffer.
+static Shader LoadShaderCached(const char *vsFileName, const char *fsFileName)
+{
+    Shader shader = { 0 };
+    char *vsFile = LoadFileText(vsFileName);
+    char *fsFile = LoadFileText(fsFileName);
+    char *vsCode = (vsFile != NULL)? IncludeFrameUniforms(vsFile) : NULL;
+    char *fsCode = (fsFile != NULL)? IncludeFrameUniforms(fsFile) : NULL;
+
+    if ((vsCode != NULL) && (fsCode != NULL)) shader.id = CreateShaderProgram(vsCode, fsCode);
+    UnloadFileText(vsFile);
+    UnloadFileText(fsFile);
+    free(vsCode);
+    free(fsCode);
+    if (shader.id == 0) return LoadShader(vsFileName, fsFileName);     // Falls back to the default shader
+    BindFrameUniforms(shader.id);
+
+    // Same locations as LoadShaderFromMemory(), UnloadShader() frees them
+    shader.locs = (int *)MemAlloc(RL_MAX_SHADER_LOCATIONS*sizeof(int));
+    for (int i = 0; i < RL_MAX_SHADER_LOCATIONS; i++) shader.locs[i] = -1;
+    shader.locs[SHADER_LOC_VERTEX_POSITION] = GetShaderLocationAttrib(shader, "vertexPosition");
+    shader.locs[SHADER_LOC_VERTEX_TEXCOORD01] = GetShaderLocationAttrib(shader, "vertexTexCoord");
+    shader.locs[SHADER_LOC_VERTEX_COLOR] = GetShaderLocationAttrib(shader, "vertexColor");
+    shader.locs[SHADER_LOC_MATRIX_MVP] = GetShaderLocation(shader, "mvp");
+    shader.locs[SHADER_LOC_COLOR_DIFFUSE] = GetShaderLocation(shader, "colDiffuse");
+    shader.locs[SHADER_LOC_MAP_DIFFUSE] = GetShaderLocation(shader, "texture0");
+    return shader;
+}
+
 // GLFW3: Keyboard callback
 static void KeyCallback(GLFWwindow *window, int key, int scancode, int action, int mods)
 {
@@ -82,12 +204,19 @@ static void KeyCallback(GLFWwindow *window, int key, int scancode, int action, i
 //------------------------------------------------------------------------------------
 // Program main entry point
 //------------------------------------------------------------------------------------
-int main(void)
+int main(int argc, char **argv)
 {
     // Initialization
     //--------------------------------------------------------------------------------------
     const int screenWidth = 800;
     const int screenHeight = 600;
+    const int numParticles = (argc > 1 && atoi(argv[1]) > 0)? atoi(argv[1]) : DEFAULT_PARTICLES;
+    const int simulate = HasOption(argc, argv, "--cpu");
+    const int gpuSimulate = !simulate && HasOption(argc, argv, "--gpu");
+    const int orderIndependent = HasOption(argc, argv, "--oit");
+    const int separate = simulate && HasOption(argc, argv, "--separate");
+    const int attract = simulate && HasOption(argc, argv, "--nbody");
+    const int cull = simulate && HasOption(argc, argv, "--cull");
     
     glfwSetErrorCallback(ErrorCallback);
     if (!glfwInit())
@@ -145,19 +274,32 @@ int main(void)
         /* Problem: glewInit failed, something is seriously wrong. */
         fprintf(stderr, "Error: %s\n", glewGetErrorString(err));
     }
-    
-    Shader shader = LoadShader(TextFormat("resources/shaders/glsl%i/point_particle.vs", GLSL_VERSION),
-                               TextFormat("resources/shaders/glsl%i/point_particle.fs", GLSL_VERSION));
+    InvalidateGLState();            // Nothing known about the context rlgl set up
+    if (InitStreamBuffers(glfwGetProcAddress)) printf("Streaming particles through persistent mapped buffers\n");
+    if (InitProgramCache(PROGRAM_CACHE_DIR, glfwGetProcAddress)) printf("Caching program binaries in %s\n", PROGRAM_CACHE_DIR);
 
-    int currentTimeLoc = GetShaderLocation(shader, "currentTime");
-    int colorLoc = GetShaderLocation(shader, "color");
+    // Time, viewport size and matrices go to every program at once, written once per frame
+    FrameUniforms frameUniforms;
+    if (!CreateFrameUniforms(&frameUniforms)) exit(3);
+    frameUniforms.data.resolution[0] = (float)screenWidth;
+    frameUniforms.data.resolution[1] = (float)screenHeight;
+    
+    // The OIT fragment shader writes the accumulation and revealage targets instead of a color
+    Shader shader = LoadShaderCached(TextFormat("resources/shaders/glsl%i/point_particle_instanced.vs", GLSL_VERSION),
+                                     TextFormat("resources/shaders/glsl%i/%s.fs", GLSL_VERSION,
+                                                orderIndependent? "point_particle_oit" : "point_particle_instanced"));
 
     rlClearScreenBuffers();             // Clear current framebuffer
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);       
     // Initialize the vertex buffer for the particles and assign each particle random values
-    Particle particles[MAX_PARTICLES] = { 0 };
+    Particle *particles = (Particle *)calloc(numParticles, sizeof(Particle));
+    if (particles == NULL)
+    {
+        fprintf(stderr, "Can not allocate %i particles\n", numParticles);
+        exit(3);
+    }
 
-    for (int i = 0; i < MAX_PARTICLES; i++)
+    for (int i = 0; i < numParticles; i++)
     {
         particles[i].x = GetRandomValue(20, 800 - 20)/2*50;
         particles[i].y = GetRandomValue(50, 600 - 20);
@@ -170,27 +312,116 @@ int main(void)
     rlClearColor(0, 0, 0, 0);                   // Define clear color
     rlEnableDepthTest();                          // Enable DEPTH_TEST for 3D
 
-    // Create a plain OpenGL vertex buffer with the data and an vertex array object 
-    // that feeds the data from the buffer into the vertexPosition shader attribute.
-    GLuint vao = 0;
-    GLuint vbo = 0;
-    unsigned int vao2 = rlLoadVertexArray();
-    
-    glGenVertexArrays(3, &vao);
-    glBindVertexArray(vao);    
-        glGenBuffers(1, &vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, (int)MAX_PARTICLES*sizeof(Particle), particles, GL_STATIC_DRAW);
-        
-        // Note: LoadShader() automatically fetches the attribute index of "vertexPosition" and saves it in shader.locs[SHADER_LOC_VERTEX_POSITION]
-        rlSetVertexAttribute(shader.locs[SHADER_LOC_VERTEX_POSITION], 3, GL_FLOAT, GL_FALSE, 0, 0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_TRUE, 0, 0);
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-    
-    // Allows the vertex shader to set the point size of each particle individually
-    glEnable(GL_PROGRAM_POINT_SIZE);
+    // Create a plain OpenGL vertex buffer with the data and an vertex array object
+    // that feeds the data from the buffer into the vertexPosition shader attribute,
+    // once per instance.
+    ParticleRenderer renderer;
+    if (!CreateParticleRenderer(&renderer, shader.id, numParticles) ||
+        !UploadParticles(&renderer, particles, numParticles))
+    {
+        fprintf(stderr, "Can not upload %i particles\n", numParticles);
+        exit(3);
+    }
+    printf("Drawing %i particles\n", numParticles);
+
+    // The fountains emit just enough particles to keep numParticles of them alive.
+    WorkPool pool = { 0 };
+    ParticleSystem system = { 0 };
+    if (simulate)
+    {
+        if (!CreateWorkPool(&pool, 0) || !InitParticleSystem(&system, numParticles))
+        {
+            fprintf(stderr, "Can not simulate %i particles\n", numParticles);
+            exit(3);
+        }
+        system.gravity_y = 200.0f;
+        system.drag = 0.2f;
+        for (int i = 0; i < NUM_FOUNTAINS; i++)
+        {
+            ParticleEmitter fountain = { 0 };
+            fountain.x = screenWidth*(i + 0.5f)/NUM_FOUNTAINS;
+            fountain.y = screenHeight - 20.0f;
+            fountain.rate = numParticles/2.0f/NUM_FOUNTAINS;     // average life is 2 seconds
+            fountain.angle = -PI/2.0f;
+            fountain.spread = PI/6.0f;
+            fountain.speed_min = 200.0f;
+            fountain.speed_max = 450.0f;
+            fountain.life_min = 1.0f;
+            fountain.life_max = 3.0f;
+            fountain.period_min = 2.0f;                         // Same periods as the static particles
+            fountain.period_max = 6.0f;
+            AddParticleEmitter(&system, &fountain);
+        }
+        printf("Simulating on %i threads\n", GetWorkPoolSize(&pool));
+    }
+    SpatialHash neighbours = { 0 };
+    if (separate)
+    {
+        if (!InitSpatialHash(&neighbours, numParticles, SEPARATION_RADIUS))
+        {
+            fprintf(stderr, "Can not hash %i particles\n", numParticles);
+            exit(3);
+        }
+        printf("Separating particles closer than %.1f\n", SEPARATION_RADIUS);
+    }
+    NBody bodies = { 0 };
+    float *pull = NULL;
+    if (attract)
+    {
+        pull = (float *)malloc(sizeof(float)*2*numParticles);
+        if (pull == NULL || !InitNBody(&bodies, numParticles))
+        {
+            fprintf(stderr, "Can not attract %i particles\n", numParticles);
+            exit(3);
+        }
+        bodies.gravity = NBODY_PULL/numParticles;   // Same pull whatever the count
+        bodies.softening = 10.0f;
+        bodies.theta = 0.7f;
+        printf("Attracting particles, theta %.2f\n", bodies.theta);
+    }
+    ParticleCull culler = { 0 };
+    if (cull)
+    {
+        if (!InitParticleCull(&culler, numParticles))
+        {
+            fprintf(stderr, "Can not cull %i particles\n", numParticles);
+            exit(3);
+        }
+        culler.radius = 5.0f;                   // Points are up to 10 pixels wide
+        culler.margin = JIGGLE_DISTANCE;
+        culler.lod = PARTICLE_LOD_DROP;
+        printf("Culling particles off screen\n");
+    }
+    free(particles);
+
+    ParticleTF gpuSystem = { 0 };
+    float spawnDue = 0.0f;
+    if (gpuSimulate)
+    {
+        // Spawned at numParticles/2 per second and living up to 3 seconds, numParticles*3/2 slots
+        // keep every particle until it dies
+        if (!CreateParticleTF(&gpuSystem, shader.id, numParticles*3/2))
+        {
+            fprintf(stderr, "Can not simulate %i particles on the GPU\n", numParticles);
+            exit(3);
+        }
+        gpuSystem.gravity_y = 200.0f;
+        gpuSystem.drag = 0.2f;
+        printf("Simulating on the GPU\n");
+    }
+
+    ParticleOIT oit = { 0 };
+    if (orderIndependent)
+    {
+        if (!CreateParticleOIT(&oit, screenWidth, screenHeight))
+        {
+            fprintf(stderr, "Can not create the order independent transparency targets\n");
+            exit(3);
+        }
+        printf("Blending particles order independent\n");
+    }
+    double lastTime = glfwGetTime();
+
     SetTargetFPS(60);
     //--------------------------------------------------------------------------------------
     unsigned int framesCounter = 0;
@@ -199,12 +430,82 @@ int main(void)
     {
         framesCounter++; //printf("frame: %d\n", framesCounter); 
         if (framesCounter%1800 == 0) framesCounter=0;
+
+        // Update
+        //----------------------------------------------------------------------------------
+        double now = glfwGetTime();
+        float frameTime = (float)(now - lastTime);
+        lastTime = now;
+        if (simulate)
+        {
+            float dt = (frameTime < 0.1f)? frameTime : 0.1f;
+            UpdateParticleSystem(&system, &pool, dt);
+            if (separate)
+            {
+                // Indices are stable until the next update, the pushes move the particles then
+                Separation job = { &system, &neighbours, dt };
+                BuildSpatialHash(&neighbours, &pool, system.x, system.y, system.count);
+                RunWorkPool(&pool, (system.count + PARTICLE_CHUNK - 1)/PARTICLE_CHUNK, SeparationTask, &job);
+            }
+            if (attract && BuildNBodyTree(&bodies, &pool, system.x, system.y, NULL, system.count))
+            {
+                ComputeNBodyForces(&bodies, &pool, pull, pull + numParticles);
+                for (int i = 0; i < system.count; i++)
+                {
+                    system.vx[i] += pull[i]*dt;
+                    system.vy[i] += pull[numParticles + i]*dt;
+                }
+            }
+            if (cull)
+            {
+                // Only the particles on screen go to the stream buffer, the draw takes their count
+                Matrix matCull = MatrixOrtho(0.0, screenWidth, screenHeight, 0.0, 0.0, 1.0);
+                SetParticleCullView(&culler, MatrixToFloat(matCull), (float)screenWidth, (float)screenHeight);
+                int visible = CullParticles(&culler, &pool, system.x, system.y, system.period, system.count);
+                Particle *mapped = MapParticles(&renderer, visible);
+                if (mapped != NULL)
+                {
+                    CopyCulledParticles(&culler, &pool, (float *)mapped);
+                    UnmapParticles(&renderer);
+                }
+            }
+            else
+            {
+                // Pack straight into the stream buffer the particles are drawn from
+                Particle *mapped = MapParticles(&renderer, system.count);
+                if (mapped != NULL)
+                {
+                    PackParticles(&system, &pool, (float *)mapped);
+                    UnmapParticles(&renderer);
+                }
+            }
+        }
+        else if (gpuSimulate)
+        {
+            // Same fountains and rate as the CPU simulation
+            float dt = (frameTime < 0.1f)? frameTime : 0.1f;
+            for (spawnDue += numParticles/2.0f*dt; spawnDue >= 1.0f; spawnDue -= 1.0f)
+            {
+                int fountain = GetRandomValue(0, NUM_FOUNTAINS - 1);
+                float angle = -PI/2.0f + GetRandomValue(-500, 500)/1000.0f*PI/6.0f;
+                float speed = (float)GetRandomValue(200, 450);
+                ParticleSpawn spawn = { screenWidth*(fountain + 0.5f)/NUM_FOUNTAINS, screenHeight - 20.0f,
+                                        cosf(angle)*speed, sinf(angle)*speed,
+                                        GetRandomValue(1000, 3000)/1000.0f, GetRandomValue(10, 30)/5.0f };
+                if (!SpawnParticleTF(&gpuSystem, &spawn)) break;
+            }
+            if (spawnDue >= 1.0f) spawnDue = 0.0f;      // spawn buffer full, drop the rest
+            UpdateParticleTF(&gpuSystem, dt);
+        }
         Matrix matProj = MatrixOrtho(0.0, screenWidth, screenHeight, 0.0, 0.0, 1.0);
         Matrix matView = MatrixIdentity();
 
         rlSetMatrixModelview(matView);    // Set internal modelview matrix (default shader)
         rlSetMatrixProjection(matProj);   // Set internal projection matrix (default shader)
         Matrix modelViewProjection = MatrixMultiply(matView, matProj);
+        memcpy(frameUniforms.data.project, MatrixToFloat(matProj), sizeof(frameUniforms.data.project));
+        memcpy(frameUniforms.data.modelview, MatrixToFloat(matView), sizeof(frameUniforms.data.modelview));
+        frameUniforms.data.time = (float)GetTime();
         
         // Draw
         //----------------------------------------------------------------------------------
@@ -212,26 +513,30 @@ int main(void)
 
             DrawRectangle(10, 10, 780, 30, RAYWHITE);
             rlDrawRenderBatchActive();      // Draw iternal buffers data (previous draw calls)
+            InvalidateGLState();            // rlgl changed bindings and blend state drawing it
 
             // Switch to plain OpenGL
             //------------------------------------------------------------------------------
-            glUseProgram(shader.id);
-            
-                glUniform1f(currentTimeLoc, GetTime());
+            WriteFrameUniforms(&frameUniforms);
+            StateUseProgram(shader.id);
 
-                Vector4 color = ColorNormalize((Color){ 0, 0, 255, 128 });
-                glUniform4fv(colorLoc, 1, (float *)&color);
-
-                // Get the current modelview and projection matrix so the particle system is displayed and transformed
+                // The current modelview and projection matrix went to the frame uniforms above, so the
+                // particle system is displayed and transformed like the rlgl content
                 //Matrix modelViewProjection = MatrixMultiply(rlGetMatrixModelview(), rlGetMatrixProjection());
-                //modelViewProjection
-                glUniformMatrix4fv(shader.locs[SHADER_LOC_MATRIX_MVP], 1, false, MatrixToFloat(matProj));
 
-                glBindVertexArray(vao);
-                    glDrawArrays(GL_POINTS, 0, (int)MAX_PARTICLES);
-                glBindVertexArray(0);
+                if (orderIndependent)
+                {
+                    // The blend and depth state rlgl draws with, restored after the composite. rlgl
+                    // does not set it again and the cache knows nothing since the flush.
+                    StateEnable(GL_BLEND, GL_TRUE);
+                    StateBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                    StateEnable(GL_DEPTH_TEST, GL_TRUE);
+                    BeginParticleOIT(&oit, 0);      // rlgl draws to the default framebuffer
+                }
+                if (gpuSimulate) DrawParticleTF(&gpuSystem);
+                else DrawParticles(&renderer);
+                if (orderIndependent) EndParticleOIT(&oit);   // Composite over the rlgl content
                 
-            glUseProgram(0);
             //------------------------------------------------------------------------------
             
         //EndDrawing();
@@ -242,9 +547,27 @@ int main(void)
 
     // De-Initialization
     //--------------------------------------------------------------------------------------
-    glDeleteBuffers(1, &vbo);
-    glDeleteVertexArrays(1, &vao);
+    printf("%lu particle uploads, %lu stalled\n", renderer.stream.maps, renderer.stream.stalls);
+    printf("%lu programs loaded from the cache, %lu compiled\n", program_cache.hits, program_cache.misses);
+    if (cull) printf("%i of %i particles drawn, %i off screen\n", culler.visible, system.count, culler.offscreen);
+    PrintGLStateStats();
+    DeleteParticleRenderer(&renderer);
+    if (cull) FreeParticleCull(&culler);
+    if (separate) FreeSpatialHash(&neighbours);
+    if (attract)
+    {
+        FreeNBody(&bodies);
+        free(pull);
+    }
+    if (simulate)
+    {
+        FreeParticleSystem(&system);
+        DestroyWorkPool(&pool);
+    }
+    if (gpuSimulate) DeleteParticleTF(&gpuSystem);
+    if (orderIndependent) DeleteParticleOIT(&oit);
 
+    DeleteFrameUniforms(&frameUniforms);
     UnloadShader(shader);   // Unload shader
 
     CloseWindow();          // Close window and OpenGL context
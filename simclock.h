@@ -0,0 +1,96 @@
+#ifndef GL_SIMCLOCK_H
+#define GL_SIMCLOCK_H
+
+#include <string.h>
+
+/**********************************************************************
+ * Fixed timestep simulation clock
+ *********************************************************************/
+
+/* Turns the wall clock into a whole number of fixed simulation steps per
+ * frame. The time left over after the last step is kept for the next
+ * frame and gives the interpolation factor alpha between the previous and
+ * the current simulation state, so the picture moves smoothly whatever
+ * the ratio of frame rate to step rate.
+ *
+ * A frame never runs more than max_steps steps. After a stall the extra
+ * steps are dropped and the simulation falls behind the wall clock
+ * instead of making the next frames longer and longer. Steps run as
+ * catch-up, beyond the first one of a frame, are counted as late.
+ */
+typedef struct SimClock
+{
+    double step;
+    int max_steps;
+    double last_time;
+    double accumulator;
+    double sim_time;
+    float alpha;
+    unsigned long step_count;
+    unsigned long late_steps;
+    unsigned long dropped_steps;
+} SimClock;
+
+    static void  InitSimClock(SimClock* sim, double step, int max_steps, double now);
+    static int   TickSimClock(SimClock* sim, double now);
+    static float LerpSimClock(const SimClock* sim, float previous, float current);
+
+
+#endif /* GL_SIMCLOCK_H */
+
+#if defined GL_SIMCLOCK_IMPLEMENTATION
+    /* implementation here */
+
+    /* Start the clock at the wall time now, in seconds. step can be changed
+     * between two ticks, the time already accumulated is kept.
+     */
+    static void InitSimClock(SimClock* sim, double step, int max_steps, double now)
+    {
+        memset(sim, 0, sizeof(*sim));
+        sim->step = step;
+        sim->max_steps = (max_steps > 0) ? max_steps : 1;
+        sim->last_time = now;
+    }
+
+
+    /* Account for the wall time elapsed since the previous tick and return
+     * the number of steps to run this frame. Run them all before drawing
+     * with the updated alpha.
+     */
+    static int TickSimClock(SimClock* sim, double now)
+    {
+        double elapsed = now - sim->last_time;
+        int num_steps;
+
+        sim->last_time = now;
+        if (elapsed > 0.0)
+            sim->accumulator += elapsed;
+
+        num_steps = (int) (sim->accumulator / sim->step);
+        if (num_steps > sim->max_steps)
+        {
+            sim->dropped_steps += (unsigned long) (num_steps - sim->max_steps);
+            sim->accumulator -= (double) (num_steps - sim->max_steps) * sim->step;
+            num_steps = sim->max_steps;
+        }
+        if (num_steps > 1)
+            sim->late_steps += (unsigned long) (num_steps - 1);
+
+        sim->accumulator -= (double) num_steps * sim->step;
+        sim->sim_time += (double) num_steps * sim->step;
+        sim->step_count += (unsigned long) num_steps;
+        sim->alpha = (float) (sim->accumulator / sim->step);
+        if (sim->alpha > 1.0f)
+            sim->alpha = 1.0f;
+        return num_steps;
+    }
+
+
+    /* Value to draw between the state before and after the last step
+     */
+    static float LerpSimClock(const SimClock* sim, float previous, float current)
+    {
+        return previous + (current - previous) * sim->alpha;
+    }
+
+#endif
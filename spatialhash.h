@@ -0,0 +1,286 @@
+#ifndef GL_SPATIALHASH_H
+#define GL_SPATIALHASH_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* Points or cells handled per worker pool task */
+#define SPATIAL_HASH_CHUNK 16384
+
+/* Most distinct buckets a neighbour query visits */
+#define SPATIAL_HASH_QUERY_CELLS 9
+
+/**********************************************************************
+ * Uniform grid spatial hash
+ *********************************************************************/
+
+/* Points binned into square cells of cell_size, so the neighbours within
+ * cell_size of a point are in its own cell or the 8 around it. Cells are
+ * unbounded: a cell (cx, cy) is hashed into a table of num_cells buckets,
+ * a power of two no smaller than capacity, so particles can fly anywhere.
+ * Two cells may share a bucket, queries filter by distance anyway.
+ *
+ * BuildSpatialHash() sorts the point indices by bucket with a counting
+ * sort on the worker pool: count the points per bucket, prefix sum the
+ * counts into cell_start, scatter the indices into entries. Bucket b then
+ * holds entries[cell_start[b]] to entries[cell_start[b + 1] - 1]. With
+ * worker threads the counts are atomic and the order within a bucket
+ * depends on the thread timing; a pool without threads uses plain
+ * increments, which are several times faster.
+ *
+ * Rebuild once per frame after the positions and indices settled, e.g.
+ * after UpdateParticleSystem() compacted the particles. The hash keeps
+ * pointers to the positions it was built from. Include workpool.h first.
+ */
+typedef struct SpatialHash
+{
+    float cell_size;
+    float inv_cell_size;
+    int capacity;
+    int num_cells;
+    int count;
+    const float* x;
+    const float* y;
+    int* cell_of;
+    int* entries;
+    int* cell_start;
+    int* counts;
+    int* block_sums;
+    int atomic;
+} SpatialHash;
+
+/* Called for every neighbour jj of particle ii, (dx, dy) is the position
+ * of jj minus the position of ii and dist2 its squared length
+ */
+typedef void (*NeighbourFunc)(void* ctx, int ii, int jj, float dx, float dy, float dist2);
+
+    static int  InitSpatialHash(SpatialHash* hash, int capacity, float cell_size);
+    static void FreeSpatialHash(SpatialHash* hash);
+    static void BuildSpatialHash(SpatialHash* hash, WorkPool* pool, const float* x, const float* y, int count);
+    static int  GetSpatialHashCells(const SpatialHash* hash, float x, float y, int* buckets);
+    static void ForEachNeighbour(const SpatialHash* hash, int ii, float radius, NeighbourFunc func, void* ctx);
+
+
+#endif /* GL_SPATIALHASH_H */
+
+#if defined GL_SPATIALHASH_IMPLEMENTATION
+    /* implementation here */
+
+    /* Room for capacity points in cells of cell_size. Returns 0 when the
+     * allocation failed.
+     */
+    static int InitSpatialHash(SpatialHash* hash, int capacity, float cell_size)
+    {
+        int num_blocks;
+
+        memset(hash, 0, sizeof(*hash));
+        hash->cell_size = cell_size;
+        hash->inv_cell_size = 1.0f / cell_size;
+        hash->capacity = capacity;
+        hash->num_cells = 1;
+        while (hash->num_cells < capacity)
+            hash->num_cells *= 2;
+        num_blocks = (hash->num_cells + SPATIAL_HASH_CHUNK - 1) / SPATIAL_HASH_CHUNK;
+
+        hash->cell_of = (int*) malloc(sizeof(int) * (size_t) capacity);
+        hash->entries = (int*) malloc(sizeof(int) * (size_t) capacity);
+        hash->cell_start = (int*) calloc((size_t) hash->num_cells + 1, sizeof(int));
+        hash->counts = (int*) malloc(sizeof(int) * (size_t) hash->num_cells);
+        hash->block_sums = (int*) malloc(sizeof(int) * (size_t) num_blocks);
+        if (hash->cell_of == NULL || hash->entries == NULL || hash->cell_start == NULL ||
+            hash->counts == NULL || hash->block_sums == NULL)
+        {
+            FreeSpatialHash(hash);
+            return 0;
+        }
+        return 1;
+    }
+
+
+    static void FreeSpatialHash(SpatialHash* hash)
+    {
+        free(hash->cell_of);
+        free(hash->entries);
+        free(hash->cell_start);
+        free(hash->counts);
+        free(hash->block_sums);
+        memset(hash, 0, sizeof(*hash));
+    }
+
+
+    static int SpatialHashBucket(const SpatialHash* hash, int cx, int cy)
+    {
+        return (int) (((unsigned) cx * 73856093u ^ (unsigned) cy * 19349663u) & (unsigned) (hash->num_cells - 1));
+    }
+
+    static int SpatialHashCell(float v, float inv_cell_size)
+    {
+        return (int) floorf(v * inv_cell_size);
+    }
+
+
+    /**********************************************************************
+     * Counting sort
+     *********************************************************************/
+
+    static void SpatialHashCountTask(void* ctx, int task, int worker)
+    {
+        SpatialHash* hash = (SpatialHash*) ctx;
+        const int i0 = task * SPATIAL_HASH_CHUNK;
+        const int i1 = (i0 + SPATIAL_HASH_CHUNK < hash->count) ? i0 + SPATIAL_HASH_CHUNK : hash->count;
+        int ii, bucket;
+
+        (void) worker;
+        for (ii = i0 ; ii < i1 ; ++ii)
+        {
+            bucket = SpatialHashBucket(hash, SpatialHashCell(hash->x[ii], hash->inv_cell_size),
+                                       SpatialHashCell(hash->y[ii], hash->inv_cell_size));
+            hash->cell_of[ii] = bucket;
+            if (hash->atomic)
+                __atomic_fetch_add(&hash->counts[bucket], 1, __ATOMIC_RELAXED);
+            else
+                ++hash->counts[bucket];
+        }
+    }
+
+    static void SpatialHashBlockSumTask(void* ctx, int task, int worker)
+    {
+        SpatialHash* hash = (SpatialHash*) ctx;
+        const int c0 = task * SPATIAL_HASH_CHUNK;
+        const int c1 = (c0 + SPATIAL_HASH_CHUNK < hash->num_cells) ? c0 + SPATIAL_HASH_CHUNK : hash->num_cells;
+        int cc, sum = 0;
+
+        (void) worker;
+        for (cc = c0 ; cc < c1 ; ++cc)
+            sum += hash->counts[cc];
+        hash->block_sums[task] = sum;
+    }
+
+    /* Exclusive prefix sum of the block, starting at the block offset. The
+     * counts become the scatter cursors.
+     */
+    static void SpatialHashScanTask(void* ctx, int task, int worker)
+    {
+        SpatialHash* hash = (SpatialHash*) ctx;
+        const int c0 = task * SPATIAL_HASH_CHUNK;
+        const int c1 = (c0 + SPATIAL_HASH_CHUNK < hash->num_cells) ? c0 + SPATIAL_HASH_CHUNK : hash->num_cells;
+        int cc, sum = hash->block_sums[task];
+
+        (void) worker;
+        for (cc = c0 ; cc < c1 ; ++cc)
+        {
+            const int num = hash->counts[cc];
+
+            hash->cell_start[cc] = sum;
+            hash->counts[cc] = sum;
+            sum += num;
+        }
+    }
+
+    static void SpatialHashScatterTask(void* ctx, int task, int worker)
+    {
+        SpatialHash* hash = (SpatialHash*) ctx;
+        const int i0 = task * SPATIAL_HASH_CHUNK;
+        const int i1 = (i0 + SPATIAL_HASH_CHUNK < hash->count) ? i0 + SPATIAL_HASH_CHUNK : hash->count;
+        int ii;
+
+        (void) worker;
+        if (hash->atomic)
+            for (ii = i0 ; ii < i1 ; ++ii)
+                hash->entries[__atomic_fetch_add(&hash->counts[hash->cell_of[ii]], 1, __ATOMIC_RELAXED)] = ii;
+        else
+            for (ii = i0 ; ii < i1 ; ++ii)
+                hash->entries[hash->counts[hash->cell_of[ii]]++] = ii;
+    }
+
+
+    /* Sort points [0, count) at (x[i], y[i]) into the hash, count is
+     * clamped to the capacity.
+     */
+    static void BuildSpatialHash(SpatialHash* hash, WorkPool* pool, const float* x, const float* y, int count)
+    {
+        const int num_blocks = (hash->num_cells + SPATIAL_HASH_CHUNK - 1) / SPATIAL_HASH_CHUNK;
+        int num_chunks, bb, sum;
+
+        hash->x = x;
+        hash->y = y;
+        hash->count = (count < hash->capacity) ? count : hash->capacity;
+        num_chunks = (hash->count + SPATIAL_HASH_CHUNK - 1) / SPATIAL_HASH_CHUNK;
+        hash->atomic = (GetWorkPoolSize(pool) > 1);
+        memset(hash->counts, 0, sizeof(int) * (size_t) hash->num_cells);
+
+        RunWorkPool(pool, num_chunks, SpatialHashCountTask, hash);
+        RunWorkPool(pool, num_blocks, SpatialHashBlockSumTask, hash);
+        for (bb = 0, sum = 0 ; bb < num_blocks ; ++bb)
+        {
+            const int num = hash->block_sums[bb];
+
+            hash->block_sums[bb] = sum;
+            sum += num;
+        }
+        hash->cell_start[hash->num_cells] = sum;
+        RunWorkPool(pool, num_blocks, SpatialHashScanTask, hash);
+        RunWorkPool(pool, num_chunks, SpatialHashScatterTask, hash);
+    }
+
+
+    /**********************************************************************
+     * Neighbour queries
+     *********************************************************************/
+
+    /* Write the distinct buckets of the cell of (x, y) and the 8 cells
+     * around it to buckets, SPATIAL_HASH_QUERY_CELLS entries. Returns how
+     * many were written. Every point within cell_size of (x, y) is in one of
+     * them.
+     */
+    static int GetSpatialHashCells(const SpatialHash* hash, float x, float y, int* buckets)
+    {
+        const int cx = SpatialHashCell(x, hash->inv_cell_size);
+        const int cy = SpatialHashCell(y, hash->inv_cell_size);
+        int dx, dy, kk, num = 0;
+
+        for (dy = -1 ; dy <= 1 ; ++dy)
+            for (dx = -1 ; dx <= 1 ; ++dx)
+            {
+                const int bucket = SpatialHashBucket(hash, cx + dx, cy + dy);
+
+                for (kk = 0 ; kk < num && buckets[kk] != bucket ; ++kk)
+                    ;
+                if (kk == num)
+                    buckets[num++] = bucket;
+            }
+        return num;
+    }
+
+
+    /* Call func for every point other than ii within radius of point ii,
+     * radius is at most cell_size. Points are at the positions of the last
+     * build. Only reads the hash, so the points can be queried in parallel.
+     */
+    static void ForEachNeighbour(const SpatialHash* hash, int ii, float radius, NeighbourFunc func, void* ctx)
+    {
+        const float px = hash->x[ii], py = hash->y[ii];
+        const float r2 = radius * radius;
+        int buckets[SPATIAL_HASH_QUERY_CELLS];
+        int num, bb, kk;
+
+        num = GetSpatialHashCells(hash, px, py, buckets);
+        for (bb = 0 ; bb < num ; ++bb)
+        {
+            const int k1 = hash->cell_start[buckets[bb] + 1];
+
+            for (kk = hash->cell_start[buckets[bb]] ; kk < k1 ; ++kk)
+            {
+                const int jj = hash->entries[kk];
+                const float dx = hash->x[jj] - px;
+                const float dy = hash->y[jj] - py;
+                const float d2 = dx * dx + dy * dy;
+
+                if (d2 < r2 && jj != ii)
+                    func(ctx, ii, jj, dx, dy, d2);
+            }
+        }
+    }
+
+#endif
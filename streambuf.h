@@ -0,0 +1,213 @@
+#ifndef GL_STREAMBUF_H
+#define GL_STREAMBUF_H
+
+#include <string.h>
+
+#ifndef GL_MAP_PERSISTENT_BIT
+ #define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+ #define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+/* Regions of a persistently mapped stream buffer: one is written while the
+ * GPU may still read the two written before it
+ */
+#define STREAM_BUFFER_REGIONS 3
+
+/* Regions start on multiples of this many bytes */
+#define STREAM_BUFFER_ALIGN 256
+
+/**********************************************************************
+ * Streaming vertex buffer
+ *********************************************************************/
+
+/* A buffer written by the CPU every frame and read by the GPU the same
+ * frame, e.g. dynamic vertices.
+ *
+ * With ARB_buffer_storage (or OpenGL 4.4) the buffer holds
+ * STREAM_BUFFER_REGIONS regions of size bytes and stays mapped, persistent
+ * and coherent, for its whole life. Each MapStreamBuffer() hands out the
+ * next region, so no data is copied by the driver. A fence goes after the
+ * draws reading a region, and the region is only handed out again once the
+ * GPU passed it; having to wait for the fence counts as a stall, which
+ * means the GPU is more than two frames behind.
+ *
+ * Without the extension each map orphans the buffer and maps it write-only
+ * at offset 0, the driver hands out fresh storage instead of waiting.
+ *
+ * Data is read from the returned offset, e.g. as the last argument of
+ * glVertexAttribPointer(). Issue the draws reading a region before the
+ * next MapStreamBuffer(), the fence for a region goes in at that call.
+ *
+ * Buffers are bound through the state cache, include glstate.h first.
+ */
+typedef struct StreamBuffer
+{
+    GLenum target;
+    GLuint buffer;
+    GLsizeiptr region_size;
+    int persistent;
+    int region;
+    unsigned char* mapped;
+    GLsync fences[STREAM_BUFFER_REGIONS];
+    unsigned long maps;
+    unsigned long stalls;
+} StreamBuffer;
+
+/* Function loader, e.g. glfwGetProcAddress */
+typedef void (*StreamBufferProc)(void);
+typedef StreamBufferProc (*StreamBufferLoadFunc)(const char* name);
+
+    static int   InitStreamBuffers(StreamBufferLoadFunc load);
+    static int   CreateStreamBuffer(StreamBuffer* stream, GLenum target, GLsizeiptr size);
+    static void  DeleteStreamBuffer(StreamBuffer* stream);
+    static void* MapStreamBuffer(StreamBuffer* stream, GLsizeiptr size, GLintptr* offset);
+    static void  UnmapStreamBuffer(StreamBuffer* stream);
+
+
+#endif /* GL_STREAMBUF_H */
+
+#if defined GL_STREAMBUF_IMPLEMENTATION
+    /* implementation here */
+
+    typedef void (GLAPIENTRY* StreamBufferStorageFunc)(GLenum target, GLsizeiptr size,
+                                                       const void* data, GLbitfield flags);
+
+    static StreamBufferStorageFunc stream_buffer_storage = NULL;
+
+    /* Look for ARB_buffer_storage in the current context and load
+     * glBufferStorage() with load. Stream buffers created before, or without
+     * calling this at all, orphan. Returns 1 when persistent mapping is used.
+     */
+    static int InitStreamBuffers(StreamBufferLoadFunc load)
+    {
+        GLint major = 0, minor = 0, num_extensions = 0, ii;
+        int found;
+
+        stream_buffer_storage = NULL;
+        if (load == NULL)
+            return 0;
+
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        found = (major > 4 || (major == 4 && minor >= 4));
+        glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+        for (ii = 0 ; ii < num_extensions && !found ; ++ii)
+            found = (strcmp((const char*) glGetStringi(GL_EXTENSIONS, (GLuint) ii), "GL_ARB_buffer_storage") == 0);
+
+        if (found)
+            stream_buffer_storage = (StreamBufferStorageFunc) load("glBufferStorage");
+        return stream_buffer_storage != NULL;
+    }
+
+
+    /* Create a stream buffer for up to size bytes per map, target is the
+     * binding used to map it. Returns 0 on failure.
+     */
+    static int CreateStreamBuffer(StreamBuffer* stream, GLenum target, GLsizeiptr size)
+    {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+        memset(stream, 0, sizeof(*stream));
+        stream->target = target;
+        stream->region_size = (size + STREAM_BUFFER_ALIGN - 1) & ~(GLsizeiptr) (STREAM_BUFFER_ALIGN - 1);
+        stream->region = STREAM_BUFFER_REGIONS - 1;
+
+        glGenBuffers(1, &stream->buffer);
+        StateBindBuffer(target, stream->buffer);
+        if (stream_buffer_storage != NULL)
+        {
+            stream_buffer_storage(target, stream->region_size * STREAM_BUFFER_REGIONS, NULL, flags);
+            stream->mapped = (unsigned char*) glMapBufferRange(target, 0,
+                    stream->region_size * STREAM_BUFFER_REGIONS, flags);
+            stream->persistent = (stream->mapped != NULL);
+            if (!stream->persistent)
+            {
+                /* immutable storage can not be orphaned, start over */
+                StateDeleteBuffers(1, &stream->buffer);
+                glGenBuffers(1, &stream->buffer);
+                StateBindBuffer(target, stream->buffer);
+            }
+        }
+        if (!stream->persistent)
+            glBufferData(target, stream->region_size, NULL, GL_STREAM_DRAW);
+
+        if (glGetError() == GL_OUT_OF_MEMORY)
+        {
+            DeleteStreamBuffer(stream);
+            return 0;
+        }
+        return 1;
+    }
+
+
+    static void DeleteStreamBuffer(StreamBuffer* stream)
+    {
+        int ii;
+
+        for (ii = 0 ; ii < STREAM_BUFFER_REGIONS ; ++ii)
+            if (stream->fences[ii] != NULL)
+                glDeleteSync(stream->fences[ii]);
+        StateDeleteBuffers(1, &stream->buffer);
+        memset(stream, 0, sizeof(*stream));
+    }
+
+
+    /* Start writing up to size bytes, returns where to write them or NULL
+     * when size is larger than the buffer or the map failed. offset is the
+     * byte offset of the data in the buffer. Call UnmapStreamBuffer() once
+     * written.
+     */
+    static void* MapStreamBuffer(StreamBuffer* stream, GLsizeiptr size, GLintptr* offset)
+    {
+        GLsync fence;
+        void* data;
+
+        *offset = 0;
+        if (size > stream->region_size || stream->buffer == 0u)
+            return NULL;
+
+        ++stream->maps;
+        if (!stream->persistent)
+        {
+            StateBindBuffer(stream->target, stream->buffer);
+            glBufferData(stream->target, stream->region_size, NULL, GL_STREAM_DRAW);
+            data = glMapBufferRange(stream->target, 0, size,
+                                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            return data;
+        }
+
+        /* the draws reading the region handed out last are issued by now */
+        if (stream->maps > 1)
+            stream->fences[stream->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        stream->region = (stream->region + 1) % STREAM_BUFFER_REGIONS;
+        fence = stream->fences[stream->region];
+        if (fence != NULL)
+        {
+            if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+            {
+                ++stream->stalls;
+                while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000u) == GL_TIMEOUT_EXPIRED)
+                    ;
+            }
+            glDeleteSync(fence);
+            stream->fences[stream->region] = NULL;
+        }
+
+        *offset = (GLintptr) stream->region * stream->region_size;
+        return stream->mapped + *offset;
+    }
+
+
+    /* Finish writing the data of the last MapStreamBuffer() */
+    static void UnmapStreamBuffer(StreamBuffer* stream)
+    {
+        if (stream->persistent)
+            return;
+        StateBindBuffer(stream->target, stream->buffer);
+        glUnmapBuffer(stream->target);
+    }
+
+#endif
@@ -0,0 +1,997 @@
+#ifndef GL_WAVE_H
+#define GL_WAVE_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef M_PI
+ #define M_PI 3.14159265358979323846
+#endif
+
+/* The vector kernels are picked at run time, include simdlevel.h first */
+
+/* Maximum delta T to allow for differential calculations */
+#define WAVE_MAX_DELTA_T (0.01)
+
+/* Animation speed (10.0 looks good) */
+#define WAVE_ANIMATION_SPEED (10.0)
+
+/* Pressure to vertex height ratio used when drawing the grid */
+#define WAVE_HEIGHT_SCALE (1.0f / 50.0f)
+
+/* Implicit integrator: target step and most steps run per AdvanceWaveGrid()
+ * call, longer steps are taken beyond that. One implicit step costs about
+ * WAVE_IMPLICIT_COST explicit ones, so the target step is well past the
+ * explicit stability limit, and shorter frames run explicit steps. Rows
+ * solved together.
+ */
+#ifndef WAVE_IMPLICIT_DELTA_T
+ #define WAVE_IMPLICIT_DELTA_T (0.15)
+#endif
+#ifndef WAVE_IMPLICIT_COST
+ #define WAVE_IMPLICIT_COST (10)
+#endif
+#ifndef WAVE_IMPLICIT_MAX_STEPS
+ #define WAVE_IMPLICIT_MAX_STEPS (2)
+#endif
+#define WAVE_IMPLICIT_ROWS (8)
+
+/* Largest supported grid side */
+#define WAVE_MAX_SIZE (4096)
+
+/* Tiled update: tile size in cells and number of time steps run on a
+ * tile while it stays in cache
+ */
+#ifndef WAVE_TILE_W
+ #define WAVE_TILE_W (512)
+#endif
+#ifndef WAVE_TILE_H
+ #define WAVE_TILE_H (64)
+#endif
+#ifndef WAVE_TIME_BLOCK
+ #define WAVE_TIME_BLOCK (8)
+#endif
+
+/* Sparse update: activity tile size in cells and number of steps between
+ * two activity checks, which must stay below the tile size
+ */
+#define WAVE_ACTIVE_TILE (32)
+#define WAVE_ACTIVE_INTERVAL (8)
+
+/**********************************************************************
+ * Wave grid state
+ *********************************************************************/
+
+/* The tiled update runs on the worker pool, include workpool.h first */
+
+/* Pressure and velocities of the grid, each stored as a contiguous
+ * row-major float array: the cell (x, y) lives at index y * width + x.
+ * The three arrays follow each other in a single allocation starting at p.
+ */
+typedef struct WaveGrid
+{
+    int width;
+    int height;
+    float* p;
+    float* vx;
+    float* vy;
+
+    /* Tiled and implicit update buffers, allocated by the first
+     * AdvanceWaveGridTiled() or SetWaveIntegrator()
+     */
+    float* back;
+    float* scratch;
+    int scratch_workers;
+
+    /* Sparse update state, allocated by SetWaveActivity() */
+    unsigned char* awake;
+    int tiles_x;
+    int tiles_y;
+    int steps_since_check;
+    float threshold;
+
+    int integrator;
+} WaveGrid;
+
+/* Time integration of AdvanceWaveGrid(). The explicit scheme is the one of
+ * reference/wave.c, the implicit one takes much longer steps at a higher
+ * cost per step.
+ */
+typedef enum WaveIntegrator
+{
+    WAVE_INTEGRATOR_EXPLICIT = 0,
+    WAVE_INTEGRATOR_IMPLICIT
+} WaveIntegrator;
+
+    static int  InitWaveGrid(WaveGrid* grid, int width, int height);
+    static void FreeWaveGrid(WaveGrid* grid);
+    static void ResetWaveGrid(WaveGrid* grid);
+    static void StepWaveGrid(WaveGrid* grid, double dt);
+    static void AdvanceWaveGrid(WaveGrid* grid, double dt_total);
+    static int  SetWaveIntegrator(WaveGrid* grid, WaveIntegrator integrator);
+    static void StepWaveGridImplicit(WaveGrid* grid, double dt);
+    static void CopyWaveHeights(const WaveGrid* grid, float* dst, size_t stride, float scale);
+    static void LerpWaveHeights(const WaveGrid* grid, const float* p_prev, float alpha,
+                                float* dst, size_t stride, float scale);
+    static SimdLevel SetWaveSimd(SimdLevel simd);
+    static void AdvanceWaveGridTiled(WaveGrid* grid, WorkPool* pool, double dt_total);
+    static int  SetWaveActivity(WaveGrid* grid, float threshold);
+    static int  CountWaveActiveTiles(const WaveGrid* grid);
+    static void DisturbWaveGrid(WaveGrid* grid, int cx, int cy, int radius, float amplitude);
+    static void UpdateWaveActivity(WaveGrid* grid);
+
+
+#endif /* GL_WAVE_H */
+
+#if defined GL_WAVE_IMPLEMENTATION
+    /* implementation here */
+
+    /**********************************************************************
+     * Wave grid life cycle
+     *********************************************************************/
+
+    /* Allocate a width x height grid and put the initial disturbance in it.
+     * Returns 0 when the size is invalid or the allocation failed.
+     */
+    static int InitWaveGrid(WaveGrid* grid, int width, int height)
+    {
+        size_t count;
+
+        memset(grid, 0, sizeof(*grid));
+        if (width < 2 || height < 2 || width > WAVE_MAX_SIZE || height > WAVE_MAX_SIZE)
+            return 0;
+
+        count = (size_t) width * (size_t) height;
+        /* p, vx and vy share one block so the tiled update can swap them */
+        grid->p = (float*) calloc(3 * count, sizeof(float));
+        if (grid->p == NULL)
+            return 0;
+        grid->vx = grid->p + count;
+        grid->vy = grid->vx + count;
+
+        grid->width = width;
+        grid->height = height;
+        ResetWaveGrid(grid);
+        return 1;
+    }
+
+
+    static void FreeWaveGrid(WaveGrid* grid)
+    {
+        free(grid->p);
+        free(grid->back);
+        free(grid->awake);
+        free(grid->scratch);
+        memset(grid, 0, sizeof(*grid));
+    }
+
+
+    /* Put a cosine shaped dip in the middle of a still grid, this is the
+     * init_grid() start condition of reference/wave.c
+     */
+    static void ResetWaveGrid(WaveGrid* grid)
+    {
+        const int w = grid->width;
+        const int h = grid->height;
+        int x, y;
+        double dx, dy, d;
+
+        for (y = 0 ; y < h ; ++y)
+        {
+            for (x = 0 ; x < w ; ++x)
+            {
+                float* pp = &grid->p[y * w + x];
+
+                dx = (double) (x - w / 2);
+                dy = (double) (y - h / 2);
+                d = sqrt(dx * dx + dy * dy);
+                if (d < 0.1 * (double) (w / 2))
+                {
+                    d = d * 10.0;
+                    *pp = (float) (-cos(d * (M_PI / (double) (w * 4))) * 100.0);
+                }
+                else
+                    *pp = 0.0f;
+            }
+        }
+        memset(grid->vx, 0, sizeof(float) * (size_t) w * (size_t) h);
+        memset(grid->vy, 0, sizeof(float) * (size_t) w * (size_t) h);
+        if (grid->awake != NULL)
+            memset(grid->awake, 1, (size_t) grid->tiles_x * grid->tiles_y);
+    }
+
+
+    /**********************************************************************
+     * Wave propagation
+     *********************************************************************/
+
+    /* Update the cells [x0, x1) of one row of the grid.
+     *
+     * This is calc_grid() of reference/wave.c fused into a single row-major
+     * pass. Walking the grid in row order, the velocities of a cell only
+     * read the pressure of the cell itself, its right neighbour and the one
+     * below, none of which have been written yet. The pressure of the cell
+     * then reads the velocities of the cell, its left neighbour and the one
+     * above, all of which are already updated. The first row and column
+     * keep their pressure, so the wrapped reads of the last row and column
+     * see the same values the reference does.
+     *
+     * p_next is the row below (row 0 for the last row) and vy_prev the row
+     * above, NULL for the first row which only updates its velocities.
+     */
+    typedef void (*WaveRowKernel)(float* p, float* vx, float* vy,
+            const float* p_next, const float* vy_prev, int w, int x0, int x1, float ts);
+
+    static WaveRowKernel wave_row_kernel = NULL;
+
+    static void WaveRowScalar(float* p, float* vx, float* vy,
+            const float* p_next, const float* vy_prev, int w, int x0, int x1, float ts)
+    {
+        const int end = (x1 == w) ? w - 1 : x1;
+        int x = x0;
+
+        if (vy_prev == NULL)
+        {
+            for ( ; x < end ; ++x)
+            {
+                vx[x] += (p[x] - p[x + 1]) * ts;
+                vy[x] += (p[x] - p_next[x]) * ts;
+            }
+            if (x1 == w)
+            {
+                vx[w - 1] += (p[w - 1] - p[0]) * ts;
+                vy[w - 1] += (p[w - 1] - p_next[w - 1]) * ts;
+            }
+            return;
+        }
+
+        /* left column, velocities only */
+        if (x == 0)
+        {
+            vx[0] += (p[0] - p[1]) * ts;
+            vy[0] += (p[0] - p_next[0]) * ts;
+            ++x;
+        }
+
+        for ( ; x < end ; ++x)
+        {
+            vx[x] += (p[x] - p[x + 1]) * ts;
+            vy[x] += (p[x] - p_next[x]) * ts;
+            p[x] += (vx[x - 1] - vx[x] + vy_prev[x] - vy[x]) * ts;
+        }
+
+        /* right column, the x neighbour wraps to the left column */
+        if (x1 == w)
+        {
+            vx[w - 1] += (p[w - 1] - p[0]) * ts;
+            vy[w - 1] += (p[w - 1] - p_next[w - 1]) * ts;
+            p[w - 1] += (vx[w - 2] - vx[w - 1] + vy_prev[w - 1] - vy[w - 1]) * ts;
+        }
+    }
+
+#if SIMD_X86
+    /* The vector kernels split the span in two sweeps that stay in L1: all
+     * velocities first, then all pressures. The velocity sweep reads the
+     * pressure before any of it is written and the pressure sweep reads the
+     * finished velocities, so the result is the same as the fused scalar
+     * loop. The wrapped right neighbour of the last column is peeled off so
+     * the interior loops are plain unaligned loads.
+     */
+    __attribute__((target("sse2")))
+    static void WaveRowSSE2(float* p, float* vx, float* vy,
+            const float* p_next, const float* vy_prev, int w, int x0, int x1, float ts)
+    {
+        const __m128 vts = _mm_set1_ps(ts);
+        const int end = (x1 == w) ? w - 1 : x1;
+        __m128 pc, div;
+        int x;
+
+        for (x = x0 ; x + 4 <= end ; x += 4)
+        {
+            pc = _mm_loadu_ps(p + x);
+            _mm_storeu_ps(vx + x, _mm_add_ps(_mm_loadu_ps(vx + x),
+                    _mm_mul_ps(_mm_sub_ps(pc, _mm_loadu_ps(p + x + 1)), vts)));
+            _mm_storeu_ps(vy + x, _mm_add_ps(_mm_loadu_ps(vy + x),
+                    _mm_mul_ps(_mm_sub_ps(pc, _mm_loadu_ps(p_next + x)), vts)));
+        }
+        for ( ; x < end ; ++x)
+        {
+            vx[x] += (p[x] - p[x + 1]) * ts;
+            vy[x] += (p[x] - p_next[x]) * ts;
+        }
+        if (x1 == w)
+        {
+            vx[w - 1] += (p[w - 1] - p[0]) * ts;
+            vy[w - 1] += (p[w - 1] - p_next[w - 1]) * ts;
+        }
+
+        if (vy_prev == NULL)
+            return;
+
+        for (x = (x0 > 0) ? x0 : 1 ; x + 4 <= x1 ; x += 4)
+        {
+            div = _mm_sub_ps(_mm_loadu_ps(vx + x - 1), _mm_loadu_ps(vx + x));
+            div = _mm_add_ps(div, _mm_loadu_ps(vy_prev + x));
+            div = _mm_sub_ps(div, _mm_loadu_ps(vy + x));
+            _mm_storeu_ps(p + x, _mm_add_ps(_mm_loadu_ps(p + x), _mm_mul_ps(div, vts)));
+        }
+        for ( ; x < x1 ; ++x)
+            p[x] += (vx[x - 1] - vx[x] + vy_prev[x] - vy[x]) * ts;
+    }
+
+    __attribute__((target("avx2")))
+    static void WaveRowAVX2(float* p, float* vx, float* vy,
+            const float* p_next, const float* vy_prev, int w, int x0, int x1, float ts)
+    {
+        const __m256 vts = _mm256_set1_ps(ts);
+        const int end = (x1 == w) ? w - 1 : x1;
+        __m256 pc, div;
+        int x;
+
+        for (x = x0 ; x + 8 <= end ; x += 8)
+        {
+            pc = _mm256_loadu_ps(p + x);
+            _mm256_storeu_ps(vx + x, _mm256_add_ps(_mm256_loadu_ps(vx + x),
+                    _mm256_mul_ps(_mm256_sub_ps(pc, _mm256_loadu_ps(p + x + 1)), vts)));
+            _mm256_storeu_ps(vy + x, _mm256_add_ps(_mm256_loadu_ps(vy + x),
+                    _mm256_mul_ps(_mm256_sub_ps(pc, _mm256_loadu_ps(p_next + x)), vts)));
+        }
+        for ( ; x < end ; ++x)
+        {
+            vx[x] += (p[x] - p[x + 1]) * ts;
+            vy[x] += (p[x] - p_next[x]) * ts;
+        }
+        if (x1 == w)
+        {
+            vx[w - 1] += (p[w - 1] - p[0]) * ts;
+            vy[w - 1] += (p[w - 1] - p_next[w - 1]) * ts;
+        }
+
+        if (vy_prev == NULL)
+            return;
+
+        for (x = (x0 > 0) ? x0 : 1 ; x + 8 <= x1 ; x += 8)
+        {
+            div = _mm256_sub_ps(_mm256_loadu_ps(vx + x - 1), _mm256_loadu_ps(vx + x));
+            div = _mm256_add_ps(div, _mm256_loadu_ps(vy_prev + x));
+            div = _mm256_sub_ps(div, _mm256_loadu_ps(vy + x));
+            _mm256_storeu_ps(p + x, _mm256_add_ps(_mm256_loadu_ps(p + x), _mm256_mul_ps(div, vts)));
+        }
+        for ( ; x < x1 ; ++x)
+            p[x] += (vx[x - 1] - vx[x] + vy_prev[x] - vy[x]) * ts;
+    }
+#endif
+
+
+    /* Select the propagation kernel at the level GetSimdLevel() gives
+     * simd, returns the level in use
+     */
+    static SimdLevel SetWaveSimd(SimdLevel simd)
+    {
+        SimdLevel level = GetSimdLevel(simd);
+
+        switch (level)
+        {
+#if SIMD_X86
+            case SIMD_AVX2: wave_row_kernel = WaveRowAVX2; break;
+            case SIMD_SSE2: wave_row_kernel = WaveRowSSE2; break;
+#endif
+            default: wave_row_kernel = WaveRowScalar; break;
+        }
+        return level;
+    }
+
+
+    /* Run one time step of dt seconds. With activity tracking on, only the
+     * awake tiles are updated, runs of awake tiles on a row in one span.
+     */
+    static void StepWaveGrid(WaveGrid* grid, double dt)
+    {
+        const int w = grid->width;
+        const int h = grid->height;
+        const float ts = (float) (dt * WAVE_ANIMATION_SPEED);
+        int y, tx, tx_end;
+
+        if (wave_row_kernel == NULL)
+            SetWaveSimd(SIMD_AUTO);
+
+        for (y = 0 ; y < h ; ++y)
+        {
+            float* p = grid->p + (size_t) y * w;
+            float* vx = grid->vx + (size_t) y * w;
+            float* vy = grid->vy + (size_t) y * w;
+            const float* p_next = grid->p + (size_t) ((y + 1 == h) ? 0 : y + 1) * w;
+            const float* vy_prev = (y == 0) ? NULL : vy - w;
+            const unsigned char* awake;
+
+            if (grid->awake == NULL)
+            {
+                wave_row_kernel(p, vx, vy, p_next, vy_prev, w, 0, w, ts);
+                continue;
+            }
+
+            awake = grid->awake + (size_t) (y / WAVE_ACTIVE_TILE) * grid->tiles_x;
+            for (tx = 0 ; tx < grid->tiles_x ; tx = tx_end)
+            {
+                if (!awake[tx])
+                {
+                    tx_end = tx + 1;
+                    continue;
+                }
+                for (tx_end = tx + 1 ; tx_end < grid->tiles_x && awake[tx_end] ; ++tx_end)
+                    ;
+                wave_row_kernel(p, vx, vy, p_next, vy_prev, w, tx * WAVE_ACTIVE_TILE,
+                        (tx_end * WAVE_ACTIVE_TILE < w) ? tx_end * WAVE_ACTIVE_TILE : w, ts);
+            }
+        }
+
+        if (grid->awake != NULL && ++grid->steps_since_check >= WAVE_ACTIVE_INTERVAL)
+            UpdateWaveActivity(grid);
+    }
+
+
+    /**********************************************************************
+     * Sparse activity tracking
+     *********************************************************************/
+
+    /* The grid is split in WAVE_ACTIVE_TILE square tiles that are either
+     * awake or asleep. Every WAVE_ACTIVE_INTERVAL steps, the tiles where a
+     * pressure or velocity reaches the threshold stay awake together with
+     * their eight neighbours (wrapping like the grid), all others sleep.
+     * A wave moves at most one cell per step and the interval is shorter
+     * than a tile, so it can never cross a sleeping tile unnoticed. The
+     * cells of a sleeping tile keep their last, below threshold, values.
+     */
+    static void UpdateWaveActivity(WaveGrid* grid)
+    {
+        const int w = grid->width;
+        const int h = grid->height;
+        const int tiles_x = grid->tiles_x;
+        const int tiles_y = grid->tiles_y;
+        const float limit = grid->threshold;
+        unsigned char* hot = grid->awake + (size_t) tiles_x * tiles_y;
+        int tx, ty, x, y, x1, y1, dx, dy;
+
+        memset(hot, 0, (size_t) tiles_x * tiles_y);
+        for (ty = 0 ; ty < tiles_y ; ++ty)
+        {
+            for (tx = 0 ; tx < tiles_x ; ++tx)
+            {
+                int found = 0;
+
+                if (!grid->awake[ty * tiles_x + tx])
+                    continue;
+                y1 = ((ty + 1) * WAVE_ACTIVE_TILE < h) ? (ty + 1) * WAVE_ACTIVE_TILE : h;
+                x1 = ((tx + 1) * WAVE_ACTIVE_TILE < w) ? (tx + 1) * WAVE_ACTIVE_TILE : w;
+                for (y = ty * WAVE_ACTIVE_TILE ; y < y1 && !found ; ++y)
+                {
+                    for (x = tx * WAVE_ACTIVE_TILE ; x < x1 ; ++x)
+                    {
+                        size_t ii = (size_t) y * w + x;
+                        if (fabsf(grid->p[ii]) >= limit || fabsf(grid->vx[ii]) >= limit ||
+                            fabsf(grid->vy[ii]) >= limit)
+                        {
+                            found = 1;
+                            break;
+                        }
+                    }
+                }
+                hot[ty * tiles_x + tx] = (unsigned char) found;
+            }
+        }
+
+        memset(grid->awake, 0, (size_t) tiles_x * tiles_y);
+        for (ty = 0 ; ty < tiles_y ; ++ty)
+            for (tx = 0 ; tx < tiles_x ; ++tx)
+                if (hot[ty * tiles_x + tx])
+                    for (dy = -1 ; dy <= 1 ; ++dy)
+                        for (dx = -1 ; dx <= 1 ; ++dx)
+                            grid->awake[((ty + dy + tiles_y) % tiles_y) * tiles_x +
+                                        (tx + dx + tiles_x) % tiles_x] = 1;
+        grid->steps_since_check = 0;
+    }
+
+
+    /* Only update the parts of the grid where something moves by at least
+     * threshold, 0 updates the whole grid again. Returns 0 if the tile
+     * state can't be allocated.
+     */
+    static int SetWaveActivity(WaveGrid* grid, float threshold)
+    {
+        free(grid->awake);
+        grid->awake = NULL;
+        grid->threshold = threshold;
+        if (threshold <= 0.0f)
+            return 1;
+
+        grid->tiles_x = (grid->width + WAVE_ACTIVE_TILE - 1) / WAVE_ACTIVE_TILE;
+        grid->tiles_y = (grid->height + WAVE_ACTIVE_TILE - 1) / WAVE_ACTIVE_TILE;
+        /* awake flags followed by the scratch flags of UpdateWaveActivity() */
+        grid->awake = (unsigned char*) malloc(2 * (size_t) grid->tiles_x * grid->tiles_y);
+        if (grid->awake == NULL)
+            return 0;
+        memset(grid->awake, 1, (size_t) grid->tiles_x * grid->tiles_y);
+        UpdateWaveActivity(grid);
+        return 1;
+    }
+
+
+    /* Number of tiles updated by the next step, all of them when activity
+     * tracking is off
+     */
+    static int CountWaveActiveTiles(const WaveGrid* grid)
+    {
+        int ii, count = 0;
+
+        if (grid->awake == NULL)
+            return ((grid->width + WAVE_ACTIVE_TILE - 1) / WAVE_ACTIVE_TILE) *
+                   ((grid->height + WAVE_ACTIVE_TILE - 1) / WAVE_ACTIVE_TILE);
+        for (ii = 0 ; ii < grid->tiles_x * grid->tiles_y ; ++ii)
+            count += grid->awake[ii];
+        return count;
+    }
+
+
+    /* Drop a cosine shaped dip of the given radius in cells around (cx, cy),
+     * e.g. a drop at the mouse position, and wake the tiles it touches
+     */
+    static void DisturbWaveGrid(WaveGrid* grid, int cx, int cy, int radius, float amplitude)
+    {
+        const int w = grid->width;
+        const int h = grid->height;
+        int x, y, tx, ty, tx0, tx1, ty0, ty1;
+        double d;
+
+        if (radius < 1)
+            radius = 1;
+        for (y = cy - radius ; y <= cy + radius ; ++y)
+        {
+            if (y < 1 || y >= h)
+                continue;
+            for (x = cx - radius ; x <= cx + radius ; ++x)
+            {
+                if (x < 1 || x >= w)
+                    continue;
+                d = sqrt((double) ((x - cx) * (x - cx) + (y - cy) * (y - cy))) / radius;
+                if (d < 1.0)
+                    grid->p[(size_t) y * w + x] -= amplitude * (float) (0.5 + 0.5 * cos(d * M_PI));
+            }
+        }
+
+        if (grid->awake == NULL)
+            return;
+        /* the grid is not periodic, tiles beyond its edges do not exist */
+        tx0 = (cx - radius) / WAVE_ACTIVE_TILE - 1;
+        tx1 = (cx + radius) / WAVE_ACTIVE_TILE + 1;
+        ty0 = (cy - radius) / WAVE_ACTIVE_TILE - 1;
+        ty1 = (cy + radius) / WAVE_ACTIVE_TILE + 1;
+        if (tx0 < 0)
+            tx0 = 0;
+        if (tx1 > grid->tiles_x - 1)
+            tx1 = grid->tiles_x - 1;
+        if (ty0 < 0)
+            ty0 = 0;
+        if (ty1 > grid->tiles_y - 1)
+            ty1 = grid->tiles_y - 1;
+        for (ty = ty0 ; ty <= ty1 ; ++ty)
+            for (tx = tx0 ; tx <= tx1 ; ++tx)
+                grid->awake[ty * grid->tiles_x + tx] = 1;
+    }
+
+
+    /* Advance the grid by dt_total seconds, split in steps no longer than
+     * WAVE_MAX_DELTA_T to keep the explicit scheme stable. With the
+     * implicit integrator a frame longer than WAVE_IMPLICIT_COST of those
+     * steps runs at most WAVE_IMPLICIT_MAX_STEPS implicit steps instead.
+     */
+    static void AdvanceWaveGrid(WaveGrid* grid, double dt_total)
+    {
+        double dt;
+        int n;
+
+        /* a short frame needs fewer explicit steps than one implicit step costs */
+        if (grid->integrator == WAVE_INTEGRATOR_IMPLICIT &&
+            dt_total > WAVE_IMPLICIT_COST * WAVE_MAX_DELTA_T)
+        {
+            /* a long frame takes longer steps instead of more of them */
+            n = (int) ceil(dt_total / WAVE_IMPLICIT_DELTA_T - 1e-6);
+            if (n < 1)
+                return;
+            if (n > WAVE_IMPLICIT_MAX_STEPS)
+                n = WAVE_IMPLICIT_MAX_STEPS;
+            for (dt = dt_total / (double) n ; n > 0 ; --n)
+                StepWaveGridImplicit(grid, dt);
+            return;
+        }
+
+        while (dt_total > 0.0)
+        {
+            dt = dt_total > WAVE_MAX_DELTA_T ? WAVE_MAX_DELTA_T : dt_total;
+            dt_total -= dt;
+            StepWaveGrid(grid, dt);
+        }
+    }
+
+
+    /**********************************************************************
+     * Implicit propagation
+     *********************************************************************/
+
+    /* Select the integrator used by AdvanceWaveGrid(). Returns 0 if the
+     * scratch grid of the implicit one can't be allocated.
+     */
+    static int SetWaveIntegrator(WaveGrid* grid, WaveIntegrator integrator)
+    {
+        if (integrator == WAVE_INTEGRATOR_IMPLICIT && grid->back == NULL)
+        {
+            grid->back = (float*) malloc(sizeof(float) * 3 * (size_t) grid->width * (size_t) grid->height);
+            if (grid->back == NULL)
+                return 0;
+        }
+        grid->integrator = integrator;
+        return 1;
+    }
+
+
+    /* Factor the n x n tridiagonal matrix with 1 + 2a on the diagonal and
+     * -a next to it for the Thomas algorithm: inv[i] is the inverse pivot
+     * of row i and upper[i] the eliminated upper diagonal entry.
+     */
+    static void WaveFactorTridiagonal(float* inv, float* upper, int n, float a)
+    {
+        float prev = 0.0f;
+        int ii;
+
+        for (ii = 0 ; ii < n ; ++ii)
+        {
+            inv[ii] = 1.0f / (1.0f + 2.0f * a + a * prev);
+            upper[ii] = -a * inv[ii];
+            prev = upper[ii];
+        }
+    }
+
+
+    /* Run one Crank-Nicolson step of dt seconds. The explicit scheme is
+     * only stable while dt * WAVE_ANIMATION_SPEED stays below 1 / sqrt(2),
+     * this one is stable for any step.
+     *
+     * With G the pressure difference of StepWaveGrid() and D the velocity
+     * divergence, the step is
+     *
+     *   v' = v + ts / 2 * G (p + p')
+     *   p' = p + ts / 2 * D (v + v')
+     *
+     * Substituting v' gives (1 - a L) (p' - p) = ts D v + 2 a L p for the
+     * cells that move, with L = D G the 5 point Laplacian and a = ts^2 / 4.
+     * 1 - a L is replaced by (1 - a Lx) (1 - a Ly), which only adds a third
+     * order term, so the pressure change comes from one tridiagonal solve
+     * along the rows and one along the columns instead of an iterative
+     * solver. The fixed first row and column close every line of cells at
+     * both ends, the wrapped neighbour of the last cell being the first.
+     * Activity tracking is not used here, every cell is updated and every
+     * tile woken.
+     *
+     * The sweeps leave the quiet part of the grid full of denormal floats,
+     * which cost x86 cores a microcode assist each. They are flushed to
+     * zero (FTZ/DAZ) for the duration of the step.
+     */
+    static void StepWaveGridImplicit(WaveGrid* grid, double dt)
+    {
+        const int w = grid->width;
+        const int h = grid->height;
+        const size_t count = (size_t) w * (size_t) h;
+        const float ts = (float) (dt * WAVE_ANIMATION_SPEED);
+        const float a = 0.25f * ts * ts;
+        const float half = 0.5f * ts;
+        float* p = grid->p;
+        float* vx = grid->vx;
+        float* vy = grid->vy;
+        float* dp = grid->back;
+        float* inv_x = grid->back + count;
+        float* upper_x = inv_x + w;
+        float* inv_y = upper_x + w;
+        float* upper_y = inv_y + h;
+        int x, y;
+#if SIMD_X86 && defined(__SSE__)
+        const unsigned int csr = _mm_getcsr();
+
+        _mm_setcsr(csr | _MM_FLUSH_ZERO_ON | 0x0040u /* DAZ */);
+#endif
+
+        WaveFactorTridiagonal(inv_x, upper_x, w - 1, a);
+        WaveFactorTridiagonal(inv_y, upper_y, h - 1, a);
+
+        /* right hand side */
+        memset(dp, 0, sizeof(float) * (size_t) w);
+        for (y = 1 ; y < h ; ++y)
+        {
+            const float* row = p + (size_t) y * w;
+            const float* up = row - w;
+            const float* down = p + (size_t) ((y + 1 == h) ? 0 : y + 1) * w;
+            const float* rvx = vx + (size_t) y * w;
+            const float* rvy = vy + (size_t) y * w;
+            float* d = dp + (size_t) y * w;
+
+            d[0] = 0.0f;
+            for (x = 1 ; x < w - 1 ; ++x)
+                d[x] = ts * (rvx[x - 1] - rvx[x] + rvy[x - w] - rvy[x]) +
+                       2.0f * a * (row[x - 1] + row[x + 1] + up[x] + down[x] - 4.0f * row[x]);
+            d[w - 1] = ts * (rvx[w - 2] - rvx[w - 1] + rvy[-1] - rvy[w - 1]) +
+                       2.0f * a * (row[w - 2] + row[0] + up[w - 1] + down[w - 1] - 4.0f * row[w - 1]);
+        }
+
+        /* sweeps along x, on a few rows at once to overlap their latency */
+        for (y = 1 ; y < h ; y += WAVE_IMPLICIT_ROWS)
+        {
+            const int rows = (h - y < WAVE_IMPLICIT_ROWS) ? h - y : WAVE_IMPLICIT_ROWS;
+            float* d = dp + (size_t) y * w;
+            int r;
+
+            for (x = 1 ; x < w ; ++x)
+                for (r = 0 ; r < rows ; ++r)
+                    d[r * w + x] = (d[r * w + x] + a * d[r * w + x - 1]) * inv_x[x - 1];
+            for (x = w - 2 ; x >= 1 ; --x)
+                for (r = 0 ; r < rows ; ++r)
+                    d[r * w + x] -= upper_x[x - 1] * d[r * w + x + 1];
+        }
+
+        /* sweeps along y, a whole row at a time */
+        for (y = 1 ; y < h ; ++y)
+        {
+            float* d = dp + (size_t) y * w;
+            const float* d_prev = d - w;
+            const float fy = inv_y[y - 1];
+
+            for (x = 1 ; x < w ; ++x)
+                d[x] = (d[x] + a * d_prev[x]) * fy;
+        }
+        for (y = h - 2 ; y >= 1 ; --y)
+        {
+            float* d = dp + (size_t) y * w;
+            const float* d_next = d + w;
+            const float uy = upper_y[y - 1];
+
+            for (x = 1 ; x < w ; ++x)
+                d[x] -= uy * d_next[x];
+        }
+
+        /* v' from p + p' = 2 p + dp, then p' */
+        for (y = 0 ; y < h ; ++y)
+        {
+            const size_t row = (size_t) y * w;
+            const size_t next = (size_t) ((y + 1 == h) ? 0 : y + 1) * w;
+
+            for (x = 0 ; x < w - 1 ; ++x)
+            {
+                const float pc = 2.0f * p[row + x] + dp[row + x];
+                vx[row + x] += half * (pc - 2.0f * p[row + x + 1] - dp[row + x + 1]);
+                vy[row + x] += half * (pc - 2.0f * p[next + x] - dp[next + x]);
+            }
+            vx[row + w - 1] += half * (2.0f * p[row + w - 1] + dp[row + w - 1] - 2.0f * p[row] - dp[row]);
+            vy[row + w - 1] += half * (2.0f * p[row + w - 1] + dp[row + w - 1] -
+                                       2.0f * p[next + w - 1] - dp[next + w - 1]);
+        }
+        for (x = 0 ; x < (int) count ; ++x)
+            p[x] += dp[x];
+        /* every cell moved, explicit steps that follow must not skip any */
+        if (grid->awake != NULL)
+            memset(grid->awake, 1, (size_t) grid->tiles_x * grid->tiles_y);
+#if SIMD_X86 && defined(__SSE__)
+        _mm_setcsr(csr);
+#endif
+    }
+
+
+    /**********************************************************************
+     * Tiled parallel propagation
+     *********************************************************************/
+
+    /* The grid is cut in WAVE_TILE_W x WAVE_TILE_H tiles updated in parallel
+     * from a read-only copy of the grid into the back buffers. Each tile is
+     * gathered with a halo as wide as the number of steps it runs, wrapping
+     * around the grid edges like the neighbours do. The row kernels then run
+     * all steps on the local copy: the cells at the local border see wrong
+     * neighbours, and that error moves inwards by one cell per step, so after
+     * n steps the tile itself is still exact and gets written back.
+     *
+     * The first row and column of the grid never change pressure, local rows
+     * that map to grid row 0 only update their velocities and local columns
+     * that map to grid column 0 get their pressure restored after each row.
+     */
+    typedef struct WaveTileJob
+    {
+        WaveGrid* grid;
+        int tiles_x;
+        int halo;
+        int num_steps;
+        float ts[WAVE_TIME_BLOCK];
+    } WaveTileJob;
+
+    static int WaveWrap(int v, int n)
+    {
+        v %= n;
+        return (v < 0) ? v + n : v;
+    }
+
+    /* Copy the local row of lw cells starting at grid column x0, wrapping
+     */
+    static void WaveGatherRow(float* dst, const float* src, int x0, int lw, int w)
+    {
+        int x = WaveWrap(x0, w);
+        int n;
+
+        while (lw > 0)
+        {
+            n = (w - x < lw) ? w - x : lw;
+            memcpy(dst, src + x, sizeof(float) * (size_t) n);
+            dst += n;
+            lw -= n;
+            x = 0;
+        }
+    }
+
+    static void WaveTileTask(void* ctx, int task, int worker)
+    {
+        WaveTileJob* job = (WaveTileJob*) ctx;
+        WaveGrid* grid = job->grid;
+        const int w = grid->width;
+        const int h = grid->height;
+        const size_t count = (size_t) w * (size_t) h;
+        const int k = job->halo;
+        const int tw = (w < WAVE_TILE_W) ? w : WAVE_TILE_W;
+        const int th = (h < WAVE_TILE_H) ? h : WAVE_TILE_H;
+        const int tx0 = (task % job->tiles_x) * tw;
+        const int ty0 = (task / job->tiles_x) * th;
+        const int cw = (w - tx0 < tw) ? w - tx0 : tw;
+        const int ch = (h - ty0 < th) ? h - ty0 : th;
+        const int lw = cw + 2 * k;
+        const int lh = ch + 2 * k;
+        const size_t lcount = (size_t) lw * (size_t) lh;
+        const size_t scratch_size = (size_t) 3 * (WAVE_TILE_W + 2 * WAVE_TIME_BLOCK)
+                                               * (WAVE_TILE_H + 2 * WAVE_TIME_BLOCK);
+        float* lp = grid->scratch + (size_t) worker * scratch_size;
+        float* lvx = lp + lcount;
+        float* lvy = lvx + lcount;
+        float* dp = grid->back;
+        float* dvx = dp + count;
+        float* dvy = dvx + count;
+        int frozen[WAVE_TILE_W + 2 * WAVE_TIME_BLOCK];
+        int num_frozen = 0;
+        int r, i, s, gy;
+
+        for (r = 0 ; r < lh ; ++r)
+        {
+            gy = WaveWrap(ty0 - k + r, h);
+            WaveGatherRow(lp  + (size_t) r * lw, grid->p  + (size_t) gy * w, tx0 - k, lw, w);
+            WaveGatherRow(lvx + (size_t) r * lw, grid->vx + (size_t) gy * w, tx0 - k, lw, w);
+            WaveGatherRow(lvy + (size_t) r * lw, grid->vy + (size_t) gy * w, tx0 - k, lw, w);
+        }
+        for (i = 0 ; i < lw ; ++i)
+            if (WaveWrap(tx0 - k + i, w) == 0)
+                frozen[num_frozen++] = i;
+
+        for (s = 0 ; s < job->num_steps ; ++s)
+        {
+            for (r = 0 ; r < lh ; ++r)
+            {
+                float* p = lp + (size_t) r * lw;
+                float* vy = lvy + (size_t) r * lw;
+                const float* p_next = lp + (size_t) ((r + 1 == lh) ? 0 : r + 1) * lw;
+                float keep[WAVE_TILE_W + 2 * WAVE_TIME_BLOCK];
+                int row_frozen = (r == 0) || (WaveWrap(ty0 - k + r, h) == 0);
+
+                for (i = 0 ; i < num_frozen ; ++i)
+                    keep[i] = p[frozen[i]];
+                wave_row_kernel(p, lvx + (size_t) r * lw, vy, p_next,
+                        row_frozen ? NULL : vy - lw, lw, 0, lw, job->ts[s]);
+                for (i = 0 ; i < num_frozen ; ++i)
+                    p[frozen[i]] = keep[i];
+            }
+        }
+
+        for (r = 0 ; r < ch ; ++r)
+        {
+            size_t src = (size_t) (r + k) * lw + k;
+            size_t dst = (size_t) (ty0 + r) * w + tx0;
+
+            memcpy(dp  + dst, lp  + src, sizeof(float) * (size_t) cw);
+            memcpy(dvx + dst, lvx + src, sizeof(float) * (size_t) cw);
+            memcpy(dvy + dst, lvy + src, sizeof(float) * (size_t) cw);
+        }
+    }
+
+
+    /* Same as AdvanceWaveGrid() but the steps are run WAVE_TIME_BLOCK at a
+     * time on cache sized tiles spread over the worker pool. The result is
+     * identical to the single threaded update. Activity tracking is not
+     * used here, every tile is updated. Returns without stepping if the
+     * buffers can't be allocated.
+     */
+    static void AdvanceWaveGridTiled(WaveGrid* grid, WorkPool* pool, double dt_total)
+    {
+        const int w = grid->width;
+        const int h = grid->height;
+        const size_t count = (size_t) w * (size_t) h;
+        const size_t scratch_size = (size_t) 3 * (WAVE_TILE_W + 2 * WAVE_TIME_BLOCK)
+                                               * (WAVE_TILE_H + 2 * WAVE_TIME_BLOCK);
+        const int tw = (w < WAVE_TILE_W) ? w : WAVE_TILE_W;
+        const int th = (h < WAVE_TILE_H) ? h : WAVE_TILE_H;
+        WaveTileJob job;
+        double dt;
+        float* swap;
+
+        if (wave_row_kernel == NULL)
+            SetWaveSimd(SIMD_AUTO);
+
+        if (grid->back == NULL)
+        {
+            grid->back = (float*) malloc(sizeof(float) * 3 * count);
+            if (grid->back == NULL)
+                return;
+        }
+        if (grid->scratch_workers < GetWorkPoolSize(pool))
+        {
+            free(grid->scratch);
+            grid->scratch_workers = GetWorkPoolSize(pool);
+            grid->scratch = (float*) malloc(sizeof(float) * scratch_size * (size_t) grid->scratch_workers);
+            if (grid->scratch == NULL)
+            {
+                grid->scratch_workers = 0;
+                return;
+            }
+        }
+
+        job.grid = grid;
+        job.tiles_x = (w + tw - 1) / tw;
+        while (dt_total > 0.0)
+        {
+            job.num_steps = 0;
+            while (dt_total > 0.0 && job.num_steps < WAVE_TIME_BLOCK)
+            {
+                dt = dt_total > WAVE_MAX_DELTA_T ? WAVE_MAX_DELTA_T : dt_total;
+                dt_total -= dt;
+                job.ts[job.num_steps++] = (float) (dt * WAVE_ANIMATION_SPEED);
+            }
+            job.halo = job.num_steps;
+
+            RunWorkPool(pool, job.tiles_x * ((h + th - 1) / th), WaveTileTask, &job);
+
+            /* the back buffers hold the new state, p, vx and vy in a row */
+            swap = grid->back;
+            grid->back = grid->p;
+            grid->p = swap;
+            grid->vx = swap + count;
+            grid->vy = swap + 2 * count;
+        }
+    }
+
+
+    /* Write the scaled pressure of every cell in row-major order, stride is
+     * the distance in floats between two consecutive outputs
+     */
+    static void CopyWaveHeights(const WaveGrid* grid, float* dst, size_t stride, float scale)
+    {
+        const size_t count = (size_t) grid->width * (size_t) grid->height;
+        size_t ii;
+
+        for (ii = 0u ; ii < count ; ++ii)
+            dst[ii * stride] = grid->p[ii] * scale;
+    }
+
+
+    /* Same as CopyWaveHeights() for the pressure alpha of the way from
+     * p_prev, a copy of grid->p taken before the last step, to the current
+     * one, e.g. alpha of a SimClock
+     */
+    static void LerpWaveHeights(const WaveGrid* grid, const float* p_prev, float alpha,
+                                float* dst, size_t stride, float scale)
+    {
+        const size_t count = (size_t) grid->width * (size_t) grid->height;
+        size_t ii;
+
+        for (ii = 0u ; ii < count ; ++ii)
+            dst[ii * stride] = (p_prev[ii] + (grid->p[ii] - p_prev[ii]) * alpha) * scale;
+    }
+
+#endif
@@ -0,0 +1,199 @@
+#ifndef GL_WAVEGL_H
+#define GL_WAVEGL_H
+
+/* Index that ends a triangle strip in the wave index buffers */
+#define WAVE_RESTART_INDEX (0xFFFFFFFFu)
+
+/**********************************************************************
+ * Core profile wave renderer
+ *********************************************************************/
+
+/* Grid vertex (x, y) is vertex y * width + x. Only the pressure is
+ * streamed every frame, 4 bytes per vertex instead of the 24 of
+ * reference/wave.c. The vertex shader rebuilds position and color from the
+ * vertex index and the grid size, and scales the pressure to a height. The
+ * quads are drawn as one triangle strip per row from a static index buffer.
+ *
+ * Needs an OpenGL 3.3 context, include glstate.h, glutil.h, streambuf.h
+ * and wave.h first.
+ */
+typedef struct WaveMesh
+{
+    int width;
+    int height;
+    GLuint program;
+    GLint uloc_mvp;
+    GLuint vao;
+    StreamBuffer stream;
+    GLuint ibo;
+    GLsizei index_count;
+} WaveMesh;
+
+    static GLuint CreateWaveIndexBuffer(int width, int height, GLsizei* index_count);
+    static int  CreateWaveMesh(WaveMesh* mesh, const WaveGrid* grid);
+    static void DeleteWaveMesh(WaveMesh* mesh);
+    static void UpdateWaveMesh(WaveMesh* mesh, const WaveGrid* grid, const float* p_prev, float alpha);
+    static void DrawWaveMesh(const WaveMesh* mesh, const GLfloat* mvp);
+
+
+#endif /* GL_WAVEGL_H */
+
+#if defined GL_WAVEGL_IMPLEMENTATION
+    /* implementation here */
+
+    /* Position and color are the ones of init_vertices() */
+    static const char* wave_mesh_vs_text =
+    "#version 330\n"
+    "uniform mat4 mvp;\n"
+    "uniform ivec2 size;\n"
+    "uniform float height_scale;\n"
+    "layout(location = 0) in float pressure;\n"
+    "out vec3 color;\n"
+    "void main()\n"
+    "{\n"
+    "    ivec2 c = ivec2(gl_VertexID % size.x, gl_VertexID / size.x);\n"
+    "    ivec2 center = size / 2;\n"
+    "    color.r = ((c.x % 4 < 2) != (c.y % 4 < 2)) ? 0.0 : 1.0;\n"
+    "    color.g = float(c.y) / float(size.y);\n"
+    "    color.b = 1.0 - (float(c.x) / float(size.x) + float(c.y) / float(size.y)) / 2.0;\n"
+    "    gl_Position = mvp * vec4(vec2(c - center) / vec2(center), pressure * height_scale, 1.0);\n"
+    "}\n";
+
+    static const char* wave_mesh_fs_text =
+    "#version 330\n"
+    "in vec3 color;\n"
+    "out vec4 finalColor;\n"
+    "void main()\n"
+    "{\n"
+    "    finalColor = vec4(color, 1.0);\n"
+    "}\n";
+
+
+    /* Create a static index buffer with one triangle strip per row of quads,
+     * the strips are separated by WAVE_RESTART_INDEX. The buffer is left
+     * bound to GL_ELEMENT_ARRAY_BUFFER, so bind the target VAO first.
+     */
+    static GLuint CreateWaveIndexBuffer(int width, int height, GLsizei* index_count)
+    {
+        GLuint ibo = 0u;
+        GLuint* indices;
+        int x, y, k;
+
+        *index_count = (height - 1) * (2 * width + 1);
+        indices = (GLuint*) malloc(sizeof(GLuint) * (size_t) *index_count);
+        if (indices == NULL)
+            return 0u;
+
+        k = 0;
+        for (y = 0 ; y < height - 1 ; ++y)
+        {
+            for (x = 0 ; x < width ; ++x)
+            {
+                indices[k++] = (GLuint) ((y + 1) * width + x);
+                indices[k++] = (GLuint) (y * width + x);
+            }
+            indices[k++] = WAVE_RESTART_INDEX;
+        }
+
+        glGenBuffers(1, &ibo);
+        StateBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * (size_t) *index_count,
+                     indices, GL_STATIC_DRAW);
+        free(indices);
+        return ibo;
+    }
+
+
+    /* Create the program, buffers and vertex array to draw a grid of the
+     * same size as grid. Returns 0 on failure.
+     */
+    static int CreateWaveMesh(WaveMesh* mesh, const WaveGrid* grid)
+    {
+        const int w = grid->width;
+        const int h = grid->height;
+
+        memset(mesh, 0, sizeof(*mesh));
+        mesh->width = w;
+        mesh->height = h;
+
+        mesh->program = CreateShaderProgram(wave_mesh_vs_text, wave_mesh_fs_text);
+        if (mesh->program == 0u)
+            return 0;
+        mesh->uloc_mvp = glGetUniformLocation(mesh->program, "mvp");
+        StateUseProgram(mesh->program);
+        glUniform2i(glGetUniformLocation(mesh->program, "size"), w, h);
+        glUniform1f(glGetUniformLocation(mesh->program, "height_scale"), WAVE_HEIGHT_SCALE);
+
+        if (!CreateStreamBuffer(&mesh->stream, GL_ARRAY_BUFFER, sizeof(GLfloat) * (size_t) w * (size_t) h))
+        {
+            DeleteWaveMesh(mesh);
+            return 0;
+        }
+        glGenVertexArrays(1, &mesh->vao);
+        StateBindVertexArray(mesh->vao);
+        StateBindBuffer(GL_ARRAY_BUFFER, mesh->stream.buffer);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 1, GL_FLOAT, GL_FALSE, 0, (void*) 0);
+
+        mesh->ibo = CreateWaveIndexBuffer(w, h, &mesh->index_count);
+        if (mesh->ibo == 0u)
+        {
+            DeleteWaveMesh(mesh);
+            return 0;
+        }
+
+        UpdateWaveMesh(mesh, grid, NULL, 1.0f);
+        return 1;
+    }
+
+
+    static void DeleteWaveMesh(WaveMesh* mesh)
+    {
+        StateDeleteBuffers(1, &mesh->ibo);
+        DeleteStreamBuffer(&mesh->stream);
+        StateDeleteVertexArrays(1, &mesh->vao);
+        glDeleteProgram(mesh->program);
+        memset(mesh, 0, sizeof(*mesh));
+    }
+
+
+    /* Stream the current pressure, or the pressure alpha of the way from
+     * p_prev to it if p_prev is not NULL (see LerpWaveHeights()). The
+     * pressure is written straight into the stream buffer (see
+     * streambuf.h), the vertex array is pointed at where it landed.
+     */
+    static void UpdateWaveMesh(WaveMesh* mesh, const WaveGrid* grid, const float* p_prev, float alpha)
+    {
+        const size_t size = sizeof(GLfloat) * (size_t) mesh->width * (size_t) mesh->height;
+        GLfloat* pressure;
+        GLintptr offset;
+
+        pressure = (GLfloat*) MapStreamBuffer(&mesh->stream, (GLsizeiptr) size, &offset);
+        if (pressure == NULL)
+            return;
+        if (p_prev != NULL)
+            LerpWaveHeights(grid, p_prev, alpha, pressure, 1, 1.0f);
+        else
+            memcpy(pressure, grid->p, size);
+        UnmapStreamBuffer(&mesh->stream);
+
+        StateBindVertexArray(mesh->vao);
+        StateBindBuffer(GL_ARRAY_BUFFER, mesh->stream.buffer);
+        glVertexAttribPointer(0, 1, GL_FLOAT, GL_FALSE, 0, (void*) offset);
+    }
+
+
+    /* Draw the grid, mvp is a column-major 4x4 matrix
+     */
+    static void DrawWaveMesh(const WaveMesh* mesh, const GLfloat* mvp)
+    {
+        StateUseProgram(mesh->program);
+        glUniformMatrix4fv(mesh->uloc_mvp, 1, GL_FALSE, mvp);
+        StateBindVertexArray(mesh->vao);
+        glEnable(GL_PRIMITIVE_RESTART);
+        glPrimitiveRestartIndex(WAVE_RESTART_INDEX);
+        glDrawElements(GL_TRIANGLE_STRIP, mesh->index_count, GL_UNSIGNED_INT, 0);
+        glDisable(GL_PRIMITIVE_RESTART);
+    }
+
+#endif
@@ -0,0 +1,330 @@
+#ifndef GL_WAVEGPU_H
+#define GL_WAVEGPU_H
+
+/**********************************************************************
+ * GPU wave simulation
+ *********************************************************************/
+
+/* The grid state lives in two RGBA32F textures holding (p, vx, vy, 0) per
+ * cell, texel (x, y) being the cell y * width + x of a WaveGrid. Every time
+ * step renders the next state from the current one into the other texture,
+ * and the grid is drawn straight from the current texture so no simulation
+ * data goes through the CPU between UploadWaveGpu() and ReadWaveGpu().
+ *
+ * Needs an OpenGL 3.2 context, include glstate.h, glutil.h, wave.h and
+ * wavegl.h first.
+ */
+typedef struct WaveGpu
+{
+    int width;
+    int height;
+    int current;
+    GLuint state[2];
+    GLuint fbo[2];
+    GLuint step_program;
+    GLint uloc_ts;
+    GLuint draw_program;
+    GLint uloc_mvp;
+    GLint uloc_alpha;
+    GLuint vao;
+    GLuint ibo;
+    GLsizei index_count;
+} WaveGpu;
+
+    static int  CreateWaveGpu(WaveGpu* gpu, const WaveGrid* grid);
+    static void DeleteWaveGpu(WaveGpu* gpu);
+    static void UploadWaveGpu(WaveGpu* gpu, const WaveGrid* grid);
+    static void ReadWaveGpu(const WaveGpu* gpu, WaveGrid* grid);
+    static void StepWaveGpu(WaveGpu* gpu, int num_steps, double dt);
+    static void AdvanceWaveGpu(WaveGpu* gpu, double dt_total);
+    static void DrawWaveGpu(const WaveGpu* gpu, const GLfloat* mvp, GLfloat alpha);
+
+
+#endif /* GL_WAVEGPU_H */
+
+#if defined GL_WAVEGPU_IMPLEMENTATION
+    /* implementation here */
+
+    /**********************************************************************
+     * Shader programs
+     *********************************************************************/
+
+    /* Full screen triangle, the fragment shader runs once per cell */
+    static const char* wave_step_vs_text =
+    "#version 150\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);\n"
+    "    gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);\n"
+    "}\n";
+
+    /* One calc_grid() step of reference/wave.c. The velocities of the left
+     * and upper neighbours are recomputed from the previous state, so the
+     * whole step is a single pass.
+     */
+    static const char* wave_step_fs_text =
+    "#version 150\n"
+    "uniform sampler2D state;\n"
+    "uniform float ts;\n"
+    "out vec4 next;\n"
+    "void main()\n"
+    "{\n"
+    "    ivec2 size = textureSize(state, 0);\n"
+    "    ivec2 c = ivec2(gl_FragCoord.xy);\n"
+    "    vec4 s = texelFetch(state, c, 0);\n"
+    "    float p_right = texelFetch(state, ivec2((c.x + 1) % size.x, c.y), 0).r;\n"
+    "    float p_next = texelFetch(state, ivec2(c.x, (c.y + 1) % size.y), 0).r;\n"
+    "    float vx = s.g + (s.r - p_right) * ts;\n"
+    "    float vy = s.b + (s.r - p_next) * ts;\n"
+    "    float p = s.r;\n"
+    "    if (c.x > 0 && c.y > 0)\n"
+    "    {\n"
+    "        vec4 l = texelFetch(state, ivec2(c.x - 1, c.y), 0);\n"
+    "        vec4 u = texelFetch(state, ivec2(c.x, c.y - 1), 0);\n"
+    "        float vx_left = l.g + (l.r - s.r) * ts;\n"
+    "        float vy_prev = u.b + (u.r - s.r) * ts;\n"
+    "        p += (vx_left - vx + vy_prev - vy) * ts;\n"
+    "    }\n"
+    "    next = vec4(p, vx, vy, 0.0);\n"
+    "}\n";
+
+    /* Grid vertex (x, y) is vertex y * width + x, its position and color
+     * are the ones of init_vertices() and its height comes from the state,
+     * alpha of the way from the previous one
+     */
+    static const char* wave_draw_vs_text =
+    "#version 150\n"
+    "uniform mat4 mvp;\n"
+    "uniform float height_scale;\n"
+    "uniform float alpha;\n"
+    "uniform sampler2D state;\n"
+    "uniform sampler2D prev_state;\n"
+    "out vec3 color;\n"
+    "void main()\n"
+    "{\n"
+    "    ivec2 size = textureSize(state, 0);\n"
+    "    ivec2 c = ivec2(gl_VertexID % size.x, gl_VertexID / size.x);\n"
+    "    ivec2 center = size / 2;\n"
+    "    float z = mix(texelFetch(prev_state, c, 0).r, texelFetch(state, c, 0).r, alpha) * height_scale;\n"
+    "    color.r = ((c.x % 4 < 2) != (c.y % 4 < 2)) ? 0.0 : 1.0;\n"
+    "    color.g = float(c.y) / float(size.y);\n"
+    "    color.b = 1.0 - (float(c.x) / float(size.x) + float(c.y) / float(size.y)) / 2.0;\n"
+    "    gl_Position = mvp * vec4(vec2(c - center) / vec2(center), z, 1.0);\n"
+    "}\n";
+
+    static const char* wave_draw_fs_text =
+    "#version 150\n"
+    "in vec3 color;\n"
+    "out vec4 finalColor;\n"
+    "void main()\n"
+    "{\n"
+    "    finalColor = vec4(color, 1.0);\n"
+    "}\n";
+
+
+    /**********************************************************************
+     * GPU wave life cycle
+     *********************************************************************/
+
+    /* Create the state textures, programs and index buffer for a grid of
+     * the same size as grid and upload its state. Returns 0 on failure.
+     */
+    static int CreateWaveGpu(WaveGpu* gpu, const WaveGrid* grid)
+    {
+        const int w = grid->width;
+        const int h = grid->height;
+        GLenum status;
+        int ii;
+
+        memset(gpu, 0, sizeof(*gpu));
+        gpu->width = w;
+        gpu->height = h;
+
+        gpu->step_program = CreateShaderProgram(wave_step_vs_text, wave_step_fs_text);
+        gpu->draw_program = CreateShaderProgram(wave_draw_vs_text, wave_draw_fs_text);
+        if (gpu->step_program == 0u || gpu->draw_program == 0u)
+        {
+            DeleteWaveGpu(gpu);
+            return 0;
+        }
+        gpu->uloc_ts = glGetUniformLocation(gpu->step_program, "ts");
+        gpu->uloc_mvp = glGetUniformLocation(gpu->draw_program, "mvp");
+        gpu->uloc_alpha = glGetUniformLocation(gpu->draw_program, "alpha");
+        StateUseProgram(gpu->step_program);
+        glUniform1i(glGetUniformLocation(gpu->step_program, "state"), 0);
+        StateUseProgram(gpu->draw_program);
+        glUniform1i(glGetUniformLocation(gpu->draw_program, "state"), 0);
+        glUniform1i(glGetUniformLocation(gpu->draw_program, "prev_state"), 1);
+        glUniform1f(glGetUniformLocation(gpu->draw_program, "height_scale"), WAVE_HEIGHT_SCALE);
+
+        glGenTextures(2, gpu->state);
+        glGenFramebuffers(2, gpu->fbo);
+        for (ii = 0 ; ii < 2 ; ++ii)
+        {
+            StateBindTexture(0, GL_TEXTURE_2D, gpu->state[ii]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, w, h, 0, GL_RGBA, GL_FLOAT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+            glBindFramebuffer(GL_FRAMEBUFFER, gpu->fbo[ii]);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                   GL_TEXTURE_2D, gpu->state[ii], 0);
+            status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+            if (status != GL_FRAMEBUFFER_COMPLETE)
+            {
+                fprintf(stderr, "ERROR: Wave state framebuffer incomplete (0x%x)\n", status);
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                DeleteWaveGpu(gpu);
+                return 0;
+            }
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        glGenVertexArrays(1, &gpu->vao);
+        StateBindVertexArray(gpu->vao);
+        gpu->ibo = CreateWaveIndexBuffer(w, h, &gpu->index_count);
+        if (gpu->ibo == 0u)
+        {
+            DeleteWaveGpu(gpu);
+            return 0;
+        }
+
+        UploadWaveGpu(gpu, grid);
+        return 1;
+    }
+
+
+    static void DeleteWaveGpu(WaveGpu* gpu)
+    {
+        StateDeleteBuffers(1, &gpu->ibo);
+        StateDeleteVertexArrays(1, &gpu->vao);
+        glDeleteFramebuffers(2, gpu->fbo);
+        StateDeleteTextures(2, gpu->state);
+        glDeleteProgram(gpu->draw_program);
+        glDeleteProgram(gpu->step_program);
+        memset(gpu, 0, sizeof(*gpu));
+    }
+
+
+    /* Replace the GPU state with the one of grid, e.g. after ResetWaveGrid().
+     * Both textures are written so there is nothing left to interpolate from.
+     */
+    static void UploadWaveGpu(WaveGpu* gpu, const WaveGrid* grid)
+    {
+        const size_t count = (size_t) gpu->width * (size_t) gpu->height;
+        GLfloat* texels;
+        size_t ii;
+
+        texels = (GLfloat*) malloc(sizeof(GLfloat) * 4 * count);
+        if (texels == NULL)
+            return;
+        for (ii = 0u ; ii < count ; ++ii)
+        {
+            texels[4 * ii + 0] = grid->p[ii];
+            texels[4 * ii + 1] = grid->vx[ii];
+            texels[4 * ii + 2] = grid->vy[ii];
+            texels[4 * ii + 3] = 0.0f;
+        }
+        for (ii = 0u ; ii < 2u ; ++ii)
+        {
+            StateBindTexture(0, GL_TEXTURE_2D, gpu->state[ii]);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, gpu->width, gpu->height,
+                            GL_RGBA, GL_FLOAT, texels);
+        }
+        free(texels);
+    }
+
+
+    /* Copy the GPU state back into grid. This stalls until the GPU is done,
+     * it is meant for tests and debugging, not for every frame.
+     */
+    static void ReadWaveGpu(const WaveGpu* gpu, WaveGrid* grid)
+    {
+        const size_t count = (size_t) gpu->width * (size_t) gpu->height;
+        GLfloat* texels;
+        size_t ii;
+
+        texels = (GLfloat*) malloc(sizeof(GLfloat) * 4 * count);
+        if (texels == NULL)
+            return;
+        glBindFramebuffer(GL_FRAMEBUFFER, gpu->fbo[gpu->current]);
+        glReadPixels(0, 0, gpu->width, gpu->height, GL_RGBA, GL_FLOAT, texels);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        for (ii = 0u ; ii < count ; ++ii)
+        {
+            grid->p[ii] = texels[4 * ii + 0];
+            grid->vx[ii] = texels[4 * ii + 1];
+            grid->vy[ii] = texels[4 * ii + 2];
+        }
+        free(texels);
+    }
+
+
+    /**********************************************************************
+     * GPU wave propagation and drawing
+     *********************************************************************/
+
+    /* Run num_steps steps of dt seconds, one render pass per step. The
+     * default framebuffer and the viewport are restored afterwards.
+     */
+    static void StepWaveGpu(WaveGpu* gpu, int num_steps, double dt)
+    {
+        GLint viewport[4];
+
+        if (num_steps <= 0 || dt <= 0.0)
+            return;
+
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glViewport(0, 0, gpu->width, gpu->height);
+        StateUseProgram(gpu->step_program);
+        glUniform1f(gpu->uloc_ts, (GLfloat) (dt * WAVE_ANIMATION_SPEED));
+        StateBindVertexArray(gpu->vao);
+        for ( ; num_steps > 0 ; --num_steps)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, gpu->fbo[gpu->current ^ 1]);
+            StateBindTexture(0, GL_TEXTURE_2D, gpu->state[gpu->current]);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            gpu->current ^= 1;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    }
+
+
+    /* Advance the state by dt_total seconds in steps no longer than
+     * WAVE_MAX_DELTA_T
+     */
+    static void AdvanceWaveGpu(WaveGpu* gpu, double dt_total)
+    {
+        int full;
+
+        if (dt_total <= 0.0)
+            return;
+
+        full = (int) (dt_total / WAVE_MAX_DELTA_T);
+        StepWaveGpu(gpu, full, WAVE_MAX_DELTA_T);
+        StepWaveGpu(gpu, 1, dt_total - (double) full * WAVE_MAX_DELTA_T);
+    }
+
+
+    /* Draw the grid as triangle strips, mvp is a column-major 4x4 matrix.
+     * alpha blends the heights from the state before the last step (0) to
+     * the current one (1).
+     */
+    static void DrawWaveGpu(const WaveGpu* gpu, const GLfloat* mvp, GLfloat alpha)
+    {
+        StateUseProgram(gpu->draw_program);
+        glUniformMatrix4fv(gpu->uloc_mvp, 1, GL_FALSE, mvp);
+        glUniform1f(gpu->uloc_alpha, alpha);
+        StateBindTexture(1, GL_TEXTURE_2D, gpu->state[gpu->current ^ 1]);
+        StateBindTexture(0, GL_TEXTURE_2D, gpu->state[gpu->current]);
+        StateBindVertexArray(gpu->vao);
+        glEnable(GL_PRIMITIVE_RESTART);
+        glPrimitiveRestartIndex(WAVE_RESTART_INDEX);
+        glDrawElements(GL_TRIANGLE_STRIP, gpu->index_count, GL_UNSIGNED_INT, 0);
+        glDisable(GL_PRIMITIVE_RESTART);
+    }
+
+#endif
@@ -0,0 +1,199 @@
+#ifndef GL_WORKPOOL_H
+#define GL_WORKPOOL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/**********************************************************************
+ * Worker pool
+ *********************************************************************/
+
+/* A fixed set of threads running parallel for loops. RunWorkPool() hands
+ * out task indices [0, num_tasks) one at a time, the calling thread works
+ * on tasks too and the call returns once every task is done. worker is in
+ * [0, GetWorkPoolSize()) and can index per thread scratch memory.
+ */
+typedef void (*WorkFunc)(void* ctx, int task, int worker);
+
+typedef struct WorkPool
+{
+    int num_threads;
+    pthread_t* threads;
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    WorkFunc func;
+    void* ctx;
+    int num_tasks;
+    int next_task;
+    int active;
+    unsigned generation;
+    int quit;
+} WorkPool;
+
+    static int  CreateWorkPool(WorkPool* pool, int num_threads);
+    static void DestroyWorkPool(WorkPool* pool);
+    static void RunWorkPool(WorkPool* pool, int num_tasks, WorkFunc func, void* ctx);
+    static int  GetWorkPoolSize(const WorkPool* pool);
+
+
+#endif /* GL_WORKPOOL_H */
+
+#if defined GL_WORKPOOL_IMPLEMENTATION
+    /* implementation here */
+
+    typedef struct WorkPoolThread
+    {
+        WorkPool* pool;
+        int worker;
+    } WorkPoolThread;
+
+    static void WorkPoolDrain(WorkPool* pool, int worker)
+    {
+        int task;
+
+        while ((task = __atomic_fetch_add(&pool->next_task, 1, __ATOMIC_RELAXED)) < pool->num_tasks)
+            pool->func(pool->ctx, task, worker);
+    }
+
+    static void* WorkPoolMain(void* arg)
+    {
+        WorkPoolThread* self = (WorkPoolThread*) arg;
+        WorkPool* pool = self->pool;
+        int worker = self->worker;
+        unsigned seen = 0u;
+
+        free(self);
+        for (;;)
+        {
+            pthread_mutex_lock(&pool->lock);
+            while (pool->generation == seen && !pool->quit)
+                pthread_cond_wait(&pool->start, &pool->lock);
+            if (pool->quit)
+            {
+                pthread_mutex_unlock(&pool->lock);
+                return NULL;
+            }
+            seen = pool->generation;
+            pthread_mutex_unlock(&pool->lock);
+
+            WorkPoolDrain(pool, worker);
+
+            pthread_mutex_lock(&pool->lock);
+            if (--pool->active == 0)
+                pthread_cond_signal(&pool->done);
+            pthread_mutex_unlock(&pool->lock);
+        }
+    }
+
+
+    /* Start num_threads background threads, 0 starts one less than the
+     * number of online CPUs since the caller works as well. Returns 0 on
+     * failure.
+     */
+    static int CreateWorkPool(WorkPool* pool, int num_threads)
+    {
+        int ii;
+
+        memset(pool, 0, sizeof(*pool));
+        if (num_threads <= 0)
+        {
+            long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+            num_threads = (cpus > 1) ? (int) cpus - 1 : 0;
+        }
+
+        pthread_mutex_init(&pool->lock, NULL);
+        pthread_cond_init(&pool->start, NULL);
+        pthread_cond_init(&pool->done, NULL);
+        if (num_threads == 0)
+            return 1;
+
+        pool->threads = (pthread_t*) calloc((size_t) num_threads, sizeof(pthread_t));
+        if (pool->threads == NULL)
+            return 0;
+
+        for (ii = 0 ; ii < num_threads ; ++ii)
+        {
+            WorkPoolThread* self = (WorkPoolThread*) malloc(sizeof(WorkPoolThread));
+            if (self == NULL)
+                break;
+            self->pool = pool;
+            self->worker = ii;
+            if (pthread_create(&pool->threads[ii], NULL, WorkPoolMain, self) != 0)
+            {
+                free(self);
+                break;
+            }
+            pool->num_threads = ii + 1;
+        }
+        if (pool->num_threads != num_threads)
+        {
+            fprintf(stderr, "ERROR: Unable to start worker thread %d\n", pool->num_threads);
+            DestroyWorkPool(pool);
+            return 0;
+        }
+        return 1;
+    }
+
+
+    static void DestroyWorkPool(WorkPool* pool)
+    {
+        int ii;
+
+        pthread_mutex_lock(&pool->lock);
+        pool->quit = 1;
+        pthread_cond_broadcast(&pool->start);
+        pthread_mutex_unlock(&pool->lock);
+        for (ii = 0 ; ii < pool->num_threads ; ++ii)
+            pthread_join(pool->threads[ii], NULL);
+
+        free(pool->threads);
+        pthread_cond_destroy(&pool->done);
+        pthread_cond_destroy(&pool->start);
+        pthread_mutex_destroy(&pool->lock);
+        memset(pool, 0, sizeof(*pool));
+    }
+
+
+    /* Number of distinct worker indices passed to a WorkFunc
+     */
+    static int GetWorkPoolSize(const WorkPool* pool)
+    {
+        return pool->num_threads + 1;
+    }
+
+
+    static void RunWorkPool(WorkPool* pool, int num_tasks, WorkFunc func, void* ctx)
+    {
+        if (num_tasks <= 0)
+            return;
+
+        pool->func = func;
+        pool->ctx = ctx;
+        pool->num_tasks = num_tasks;
+        pool->next_task = 0;
+        if (pool->num_threads == 0 || num_tasks == 1)
+        {
+            WorkPoolDrain(pool, pool->num_threads);
+            return;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        pool->active = pool->num_threads;
+        ++pool->generation;
+        pthread_cond_broadcast(&pool->start);
+        pthread_mutex_unlock(&pool->lock);
+
+        /* the calling thread is the last worker */
+        WorkPoolDrain(pool, pool->num_threads);
+
+        pthread_mutex_lock(&pool->lock);
+        while (pool->active > 0)
+            pthread_cond_wait(&pool->done, &pool->lock);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+#endif